@@ -0,0 +1,6 @@
+# architecture-dependent additional targets and manual dependencies
+
+# Run the simulator with the script given in SCRIPT on the card image IMAGE,
+# BUS=iec runs it on the simulated IEC bus
+run: elf
+	$(Q)HOSTSIM_IMAGE=$(IMAGE) HOSTSIM_SCRIPT=$(SCRIPT) HOSTSIM_BUS=$(BUS) $(TARGET).elf
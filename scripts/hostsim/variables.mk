@@ -0,0 +1,39 @@
+# architecture-dependent variables
+
+#---------------- Source code ----------------
+ASMSRC =
+
+SRC += hostsim/card-image.c
+SRC += hostsim/crc.c
+SRC += hostsim/arch-eeprom.c
+SRC += hostsim/iec-bus.c
+SRC += hostsim/llfl-common.c
+SRC += lpc17xx/llfl-jiffydos.c
+SRC += lpc17xx/iec-tx.c
+SRC += hostsim/virtual-time.c
+SRC += hostsim/c64host.c
+SRC += hostsim/hostbus.c
+
+#---------------- Toolchain ----------------
+CC = gcc
+OBJCOPY = objcopy
+OBJDUMP = objdump
+SIZE = size
+NM = nm
+
+
+#---------------- Bootloader ----------------
+BINARY_LENGTH = 0
+CRCGEN        = true
+
+
+#---------------- Architecture variables ----------------
+# the code depends on unsigned chars and short enums as on AVR and ARM
+ARCH_CFLAGS  = -funsigned-char -funsigned-bitfields -fshort-enums -D_GNU_SOURCE
+# newer host compilers report false positives, e.g. in fl-krill.c
+ARCH_CFLAGS += -Wno-maybe-uninitialized
+ARCH_ASFLAGS =
+ARCH_LDFLAGS =
+
+#---------------- Config ----------------
+# currently no stack tracking supported
@@ -4,6 +4,7 @@
 ASMSRC = lpc17xx/pseudoboot.S lpc17xx/startup.S lpc17xx/crc.S
 
 SRC += lpc17xx/iec-bus.c
+SRC += lpc17xx/iec-tx.c
 SRC += lpc17xx/llfl-common.c
 SRC += lpc17xx/llfl-jiffydos.c
 SRC += lpc17xx/llfl-turbodisk.c
@@ -11,6 +11,11 @@
 #define ATA_CMD_SPINUP       0xe1
 #define ATA_CMD_READ_EXT     0x24
 #define ATA_CMD_WRITE_EXT    0x34
+#define ATA_CMD_READ_MULTIPLE      0xc4 /* READ MULTIPLE */
+#define ATA_CMD_WRITE_MULTIPLE     0xc5 /* WRITE MULTIPLE */
+#define ATA_CMD_SET_MULTIPLE       0xc6 /* SET MULTIPLE MODE */
+#define ATA_CMD_READ_MULTIPLE_EXT  0x29
+#define ATA_CMD_WRITE_MULTIPLE_EXT 0x39
 
 /* ATA register bit definitions */
 #define ATA_LBA3_LBA         0x40
@@ -66,6 +71,7 @@
 #define STA_FIRSTTIME        0x80
 
 #define RESET_DELAY          100   /* ms to hold RESET line low to init CF and IDE */
+#define ATA_MAX_MULTIPLE     16    /* upper limit for sectors per DRQ block */
 
 /* These functions are weak-aliased to disk_... */
 void ata_init(void);
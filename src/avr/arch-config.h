@@ -1498,6 +1498,16 @@ static inline uint8_t display_intrq_active(void) {
 #  define P00CACHE_ATTRIB
 #endif
 
+/* in-RAM BAM is in bss by default */
+#ifndef FULLBAM_ATTRIB
+#  define FULLBAM_ATTRIB
+#endif
+
+/* Dxx image sector cache is in bss by default */
+#ifndef IMAGECACHE_ATTRIB
+#  define IMAGECACHE_ATTRIB
+#endif
+
 /* -- ensure that the timing for Dolphin is achievable        -- */
 /* the C64 will switch to an alternate, not-implemented protocol */
 /* if the answer to the XQ/XZ commands is too late and the       */
@@ -40,6 +40,7 @@
 
 
 static DSTATUS ATA_drv_flags[2];
+static BYTE    ATA_drv_multiple[2]; /* sectors per DRQ block */
 
 #define ATA_WRITE_CMD(cmd) { ata_write_reg(ATA_REG_CMD,cmd); }
 
@@ -200,7 +201,8 @@ void disk_init(void) __attribute__ ((weak, alias("ata_init")));
 /*-----------------------------------------------------------------------*/
 
 DSTATUS ata_initialize (BYTE drv) {
-  BYTE data[(83 - 49 + 1) * 2];
+  BYTE data[(83 - 47 + 1) * 2];
+  BYTE m;
   DWORD i = DELAY_VALUE(ATA_INIT_TIMEOUT);
 
   if(drv>1) return STA_NOINIT;
@@ -231,10 +233,28 @@ DSTATUS ata_initialize (BYTE drv) {
   } while(ata_read_reg(ATA_REG_STATUS) & ATA_STATUS_BSY);  /* Wait cmd ready */
   ATA_WRITE_CMD(ATA_CMD_IDENTIFY);
   if(!ata_wait_data()) goto di_error;
-  ata_read_part(data, 49, 83 - 49 + 1);
-  if(!(data[1] & 0x02)) goto di_error; /* No LBA support */
-  if(data[(83 - 49) * 2 + 1] & 0x04)   /* 48 bit addressing... */
+  ata_read_part(data, 47, 83 - 47 + 1);
+  if(!(data[(49 - 47) * 2 + 1] & 0x02)) goto di_error; /* No LBA support */
+  if(data[(83 - 47) * 2 + 1] & 0x04)   /* 48 bit addressing... */
     ATA_drv_flags[drv] |= STA_48BIT;
+
+  /* Use the largest power of two sectors per DRQ block the drive allows */
+  ATA_drv_multiple[drv] = 1;
+  m = data[0];
+  if(m > ATA_MAX_MULTIPLE)
+    m = ATA_MAX_MULTIPLE;
+  while(m & (m - 1))
+    m &= m - 1;
+  if(m > 1) {
+    ata_write_reg(ATA_REG_COUNT, m);
+    ATA_WRITE_CMD(ATA_CMD_SET_MULTIPLE);
+    i = DELAY_VALUE(1000);
+    while((ata_read_reg(ATA_REG_STATUS) & ATA_STATUS_BSY) && --i) ;  /* Wait cmd ready */
+    /* Keep single sector transfers if the drive times out or rejects it */
+    if(i && !(ata_read_reg(ATA_REG_STATUS) & ATA_STATUS_ERR))
+      ATA_drv_multiple[drv] = m;
+  }
+
   ATA_drv_flags[drv] &= (BYTE)~( STA_NOINIT | STA_NODISK);
 
   disk_state = DISK_OK;
@@ -264,22 +284,44 @@ DSTATUS disk_status (BYTE drv) __attribute__ ((weak, alias("ata_status")));
 /*-----------------------------------------------------------------------*/
 
 DRESULT ata_read (BYTE drv, BYTE *data, DWORD sector, BYTE count) {
-  BYTE c, iord_l, iord_h;
+  BYTE c, blk, cmd, iord_l, iord_h;
 
   if (drv > 1 || !count) return RES_PARERR;
   if (ATA_drv_flags[drv] & STA_NOINIT) return RES_NOTRDY;
 
-  /* Issue Read Sector(s) command */
+  /* Issue Read Sector(s)/Read Multiple command */
   ata_select_sector(drv, sector, count);
-  ATA_WRITE_CMD(ATA_drv_flags[drv] & STA_48BIT ? ATA_CMD_READ_EXT : ATA_CMD_READ);
+  if (ATA_drv_multiple[drv] > 1)
+    cmd = ATA_drv_flags[drv] & STA_48BIT ? ATA_CMD_READ_MULTIPLE_EXT : ATA_CMD_READ_MULTIPLE;
+  else
+    cmd = ATA_drv_flags[drv] & STA_48BIT ? ATA_CMD_READ_EXT : ATA_CMD_READ;
+  ATA_WRITE_CMD(cmd);
 
   iord_h = ATA_REG_DATA;
   iord_l = ATA_REG_DATA & (BYTE)~ATA_PIN_RD;
+  blk = 0;
   do {
-    if (!ata_wait_data()) return RES_ERROR; /* Wait data ready */
-    ATA_PORT_CTRL_OUT = ATA_REG_DATA;
-    c = 0;
+    if (!blk) {
+      /* The drive asserts DRQ once per block of sectors */
+      if (!ata_wait_data()) return RES_ERROR; /* Wait data ready */
+      ATA_PORT_CTRL_OUT = ATA_REG_DATA;
+      blk = ATA_drv_multiple[drv];
+    }
+    blk--;
+    c = 128;
     do {
+      /* two words per iteration */
+      ATA_PORT_CTRL_OUT = iord_l;       /* IORD = L */
+      ATA_PORT_CTRL_OUT = iord_l;       /* delay */
+      ATA_PORT_CTRL_OUT = iord_l;       /* delay */
+      ATA_PORT_CTRL_OUT = iord_l;       /* delay */
+      ATA_PORT_CTRL_OUT = iord_l;       /* delay */
+      *data++ = ATA_PORT_DATA_LO_IN;    /* Get even data */
+      *data++ = ATA_PORT_DATA_HI_IN;    /* Get odd data */
+      ATA_PORT_CTRL_OUT = iord_h;       /* IORD = H */
+      ATA_PORT_CTRL_OUT = iord_h;       /* delay */
+      ATA_PORT_CTRL_OUT = iord_h;       /* delay */
+      ATA_PORT_CTRL_OUT = iord_h;       /* delay */
       ATA_PORT_CTRL_OUT = iord_l;       /* IORD = L */
       ATA_PORT_CTRL_OUT = iord_l;       /* delay */
       ATA_PORT_CTRL_OUT = iord_l;       /* delay */
@@ -291,7 +333,7 @@ DRESULT ata_read (BYTE drv, BYTE *data, DWORD sector, BYTE count) {
       ATA_PORT_CTRL_OUT = iord_h;       /* delay */
       ATA_PORT_CTRL_OUT = iord_h;       /* delay */
       ATA_PORT_CTRL_OUT = iord_h;       /* delay */
-    } while (++c);
+    } while (--c);
   } while (--count);
 
   ata_read_reg(ATA_REG_ALTSTAT);
@@ -308,29 +350,48 @@ DRESULT disk_read (BYTE drv, BYTE *data, DWORD sector, BYTE count) __attribute__
 
 #if _READONLY == 0
 DRESULT ata_write (BYTE drv, const BYTE *data, DWORD sector, BYTE count) {
-  BYTE s, c, iowr_l, iowr_h;
+  BYTE s, c, blk, cmd, iowr_l, iowr_h;
 
   if (drv > 1 || !count) return RES_PARERR;
   if (ATA_drv_flags[drv] & STA_NOINIT) return RES_NOTRDY;
 
-  /* Issue Write Setor(s) command */
+  /* Issue Write Sector(s)/Write Multiple command */
   ata_select_sector(drv,sector,count);
-  ATA_WRITE_CMD(ATA_drv_flags[drv] & STA_48BIT ? ATA_CMD_WRITE_EXT : ATA_CMD_WRITE);
+  if (ATA_drv_multiple[drv] > 1)
+    cmd = ATA_drv_flags[drv] & STA_48BIT ? ATA_CMD_WRITE_MULTIPLE_EXT : ATA_CMD_WRITE_MULTIPLE;
+  else
+    cmd = ATA_drv_flags[drv] & STA_48BIT ? ATA_CMD_WRITE_EXT : ATA_CMD_WRITE;
+  ATA_WRITE_CMD(cmd);
 
   iowr_h = ATA_REG_DATA;
   iowr_l = ATA_REG_DATA & (BYTE)~ATA_PIN_WR;
+  blk = 0;
   do {
-    if (!ata_wait_data()) return RES_ERROR;
-    ATA_PORT_CTRL_OUT = ATA_REG_DATA;
-    ATA_PORT_DATA_LO_DDR = 0xff;      /* bring to output */
-    ATA_PORT_DATA_HI_DDR = 0xff;      /* bring to output */
-    c = 0;
+    if (!blk) {
+      /* The drive asserts DRQ once per block of sectors */
+      ATA_PORT_DATA_LO_OUT = 0xff;    /* Set D0-D15 as input */
+      ATA_PORT_DATA_HI_OUT = 0xff;
+      ATA_PORT_DATA_LO_DDR = 0x00;    /* bring to input */
+      ATA_PORT_DATA_HI_DDR = 0x00;    /* bring to input */
+      if (!ata_wait_data()) return RES_ERROR;
+      ATA_PORT_CTRL_OUT = ATA_REG_DATA;
+      ATA_PORT_DATA_LO_DDR = 0xff;    /* bring to output */
+      ATA_PORT_DATA_HI_DDR = 0xff;    /* bring to output */
+      blk = ATA_drv_multiple[drv];
+    }
+    blk--;
+    c = 128;
     do {
+      /* two words per iteration */
+      ATA_PORT_DATA_LO_OUT = *data++; /* Set even data */
+      ATA_PORT_DATA_HI_OUT = *data++; /* Set odd data */
+      ATA_PORT_CTRL_OUT = iowr_l;     /* IOWR = L */
+      ATA_PORT_CTRL_OUT = iowr_h;     /* IOWR = H */
       ATA_PORT_DATA_LO_OUT = *data++; /* Set even data */
       ATA_PORT_DATA_HI_OUT = *data++; /* Set odd data */
       ATA_PORT_CTRL_OUT = iowr_l;     /* IOWR = L */
       ATA_PORT_CTRL_OUT = iowr_h;     /* IOWR = H */
-    } while (++c);
+    } while (--c);
   } while (--count);
   ATA_PORT_DATA_LO_OUT = 0xff;        /* Set D0-D15 as input */
   ATA_PORT_DATA_HI_OUT = 0xff;
@@ -43,6 +43,25 @@ static uint8_t bufferdata[CONFIG_BUFFER_COUNT*256];
 /// Number of active data buffers + 16 * number of dirty buffers
 uint8_t active_buffers;
 
+#ifdef CONFIG_TALK_PREFETCH
+/// Block read in advance by buffer_prefetch
+static struct {
+  buffer_t *owner;     // buffer the block belongs to, NULL: none
+  buffer_t *shadow;    // system buffer holding the block
+  buffer_t *running;   // buffer whose refill callback runs in advance
+  uint8_t   failed;    // the refill callback returned an error
+  uint8_t   error;     // error set by the refill callback
+  uint8_t   track;
+  uint8_t   sector;
+  uint8_t   lastused;  // state of the owner after the refill
+  uint8_t   sendeoi;
+  uint32_t  fptr;
+  uint8_t   pvt[sizeof(((buffer_t *)0)->pvt)]; // state before the refill
+} prefetch;
+
+static void prefetch_cancel(void);
+#endif
+
 /**
  * callback_dummy - dummy function for the buffer callbacks
  * @buf: pointer to a buffer
@@ -111,6 +130,14 @@ buffer_t *alloc_system_buffer(void) {
     }
   }
 
+#ifdef CONFIG_TALK_PREFETCH
+  /* Take the buffer back from a prefetched block */
+  if (prefetch.shadow != NULL) {
+    prefetch_cancel();
+    return alloc_system_buffer();
+  }
+#endif
+
   set_error(ERROR_NO_CHANNEL);
   return NULL;
 }
@@ -163,6 +190,12 @@ buffer_t *alloc_linked_buffers(uint8_t count) {
   }
 
   if (freebufs < count) {
+#ifdef CONFIG_TALK_PREFETCH
+    if (prefetch.shadow != NULL) {
+      prefetch_cancel();
+      return alloc_linked_buffers(count);
+    }
+#endif
     set_error(ERROR_NO_CHANNEL);
     return NULL;
   }
@@ -210,6 +243,11 @@ void free_buffer(buffer_t *buffer) {
   if (buffer->secondary == 15) return;
   if (!buffer->allocated) return;
 
+#ifdef CONFIG_TALK_PREFETCH
+  /* A refill that fails in advance frees the buffer when it is needed */
+  if (buffer == prefetch.running) return;
+#endif
+
   buffer->allocated = 0;
 
   if (buffer->dirty)
@@ -217,6 +255,11 @@ void free_buffer(buffer_t *buffer) {
   if (buffer->secondary < BUFFER_SEC_SYSTEM)
     active_buffers--;
 
+#ifdef CONFIG_TALK_PREFETCH
+  if (buffer == prefetch.owner || buffer == prefetch.shadow)
+    prefetch_cancel();
+#endif
+
   update_leds();
 }
 
@@ -270,6 +313,170 @@ buffer_t *find_buffer(uint8_t secondary) {
   return NULL;
 }
 
+#ifdef CONFIG_TALK_PREFETCH
+/**
+ * prefetch_cancel - drop the block read in advance
+ *
+ * This function frees the buffer holding the block read by
+ * buffer_prefetch and restores the file state of its owner, so the
+ * next refill reads the same block again.
+ */
+static void prefetch_cancel(void) {
+  buffer_t *shadow = prefetch.shadow;
+
+  if (prefetch.owner != NULL)
+    memcpy(&prefetch.owner->pvt, prefetch.pvt, sizeof(prefetch.pvt));
+
+  prefetch.owner  = NULL;
+  prefetch.shadow = NULL;
+  free_buffer(shadow);
+}
+
+/**
+ * buffer_prefetch - refill a buffer in advance
+ * @buf: buffer that is currently sent to the bus
+ *
+ * This function runs the refill callback of @buf with the data pointer
+ * redirected to a free system buffer, so the next block of the file is
+ * ready when the last byte of the current one has been sent. The bus
+ * code calls it at a point where it may delay the transfer of the
+ * current byte. Only one block is read ahead, for buffers that have
+ * their prefetch flag set. Nothing is done if no buffer is free.
+ * If the refill fails, @buf stays allocated and the error is held
+ * back until buffer_prefetched is called for the block.
+ */
+void buffer_prefetch(buffer_t *buf) {
+  buffer_t *shadow = NULL;
+  uint8_t  *data;
+  uint8_t   i, position, lastused, sendeoi, olderror;
+  uint32_t  fptr;
+
+  if (!buf->prefetch || buf->sendeoi || buf->random || buf->recordlen ||
+      prefetch.owner != NULL)
+    return;
+
+  for (i=0;i<CONFIG_BUFFER_COUNT;i++) {
+    if (!buffers[i].allocated) {
+      alloc_specific_buffer(i);
+      shadow = &buffers[i];
+      break;
+    }
+  }
+
+  if (shadow == NULL)
+    return;
+
+  /* Save the state of the block that is sent */
+  memcpy(prefetch.pvt, &buf->pvt, sizeof(prefetch.pvt));
+  data     = buf->data;
+  position = buf->position;
+  lastused = buf->lastused;
+  sendeoi  = buf->sendeoi;
+  fptr     = buf->fptr;
+
+  /* The link bytes of the current block are needed for D64 */
+  shadow->data[0] = data[0];
+  shadow->data[1] = data[1];
+  buf->data = shadow->data;
+
+  /* Errors are held back until the block is needed, see set_error_ts */
+  olderror          = current_error;
+  prefetch.error    = ERROR_OK;
+  prefetch.track    = 0;
+  prefetch.sector   = 0;
+  prefetch.running  = buf;
+  prefetch.failed   = buf->refill(buf);
+  prefetch.running  = NULL;
+  current_error     = olderror;
+  prefetch.lastused = buf->lastused;
+  prefetch.sendeoi  = buf->sendeoi;
+  prefetch.fptr     = buf->fptr;
+
+  buf->data     = data;
+  buf->position = position;
+  buf->lastused = lastused;
+  buf->sendeoi  = sendeoi;
+  buf->fptr     = fptr;
+
+  prefetch.owner = buf;
+  if (prefetch.failed)
+    free_buffer(shadow);
+  else
+    prefetch.shadow = shadow;
+}
+
+/**
+ * buffer_prefetched - use the block read in advance
+ * @buf: buffer to be refilled
+ *
+ * This function is called at the start of refill callbacks that
+ * support buffer_prefetch. If the next block of @buf was read in
+ * advance, it is copied into the buffer and PREFETCH_OK is returned.
+ * Returns PREFETCH_FAILED if reading it failed, after setting the error
+ * and freeing @buf like the callback does on a failed read, and
+ * PREFETCH_NONE if there is no such block, in which case the callback
+ * must read it.
+ */
+uint8_t buffer_prefetched(buffer_t *buf) {
+  buffer_t *shadow = prefetch.shadow;
+
+  if (prefetch.owner != buf)
+    return PREFETCH_NONE;
+
+  prefetch.owner  = NULL;
+  prefetch.shadow = NULL;
+
+  if (prefetch.failed) {
+    /* Complete the refill that failed in advance */
+    set_error_ts(prefetch.error, prefetch.track, prefetch.sector);
+    free_buffer(buf);
+    return PREFETCH_FAILED;
+  }
+
+  memcpy(buf->data, shadow->data, 256);
+  buf->position = 2;
+  buf->lastused = prefetch.lastused;
+  buf->sendeoi  = prefetch.sendeoi;
+  buf->fptr     = prefetch.fptr;
+
+  free_buffer(shadow);
+  return PREFETCH_OK;
+}
+
+/**
+ * buffer_prefetch_error - hold back an error of buffer_prefetch
+ * @errornum: error number
+ * @track   : track number
+ * @sector  : sector number
+ *
+ * This function is called by set_error_ts. While buffer_prefetch runs
+ * a refill callback, the error is stored instead of being shown, so
+ * buffer_prefetched can report it when the block is needed. Returns 1
+ * if the error was stored, 0 otherwise.
+ */
+uint8_t buffer_prefetch_error(uint8_t errornum, uint8_t track, uint8_t sector) {
+  if (prefetch.running == NULL)
+    return 0;
+
+  prefetch.error  = errornum;
+  prefetch.track  = track;
+  prefetch.sector = sector;
+  return 1;
+}
+
+/**
+ * buffer_cancel_prefetch - drop the block read in advance for a buffer
+ * @buf: buffer
+ *
+ * This function must be called before the file position of @buf is
+ * changed by other means than its refill callback.
+ */
+void buffer_cancel_prefetch(buffer_t *buf) {
+  if (prefetch.owner == buf)
+    prefetch_cancel();
+}
+#endif
+
 /**
  * mark_buffer_dirty - mark a buffer as dirty
  * @buf: pointer to the buffer
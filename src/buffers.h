@@ -70,6 +70,7 @@ typedef enum { DIR_FMT_CBM, DIR_FMT_CMD_SHORT, DIR_FMT_CMD_LONG } dirformat_t;
  * @sendeoi  : Flags if the last byte should be sent with EOI
  * @sticky   : Flags if the buffer will survive garbage collection
  * @random   : Flags if the buffer is used for random access (not closed at eof)
+ * @prefetch : Flags if the refill callback may be called early, see buffer_prefetch
  * @refill   : Callback to refill/write out the buffer, returns true on error
  * @cleanup  : Callback to clean up and save remaining data, returns true on error
  *
@@ -96,6 +97,7 @@ typedef struct buffer_s {
   int     sendeoi:1;
   int     sticky:1;
   int     random:1;
+  int     prefetch:1;
   uint8_t (*seek) (struct buffer_s *buffer, uint32_t position, uint8_t index);
   uint8_t (*refill)(struct buffer_s *buffer);
   uint8_t (*cleanup)(struct buffer_s *buffer);
@@ -195,6 +197,30 @@ static inline void mark_write_buffer(buffer_t *buf) {
   stick_buffer(buf);
 }
 
+/* Return values of buffer_prefetched */
+#define PREFETCH_NONE   0
+#define PREFETCH_OK     1
+#define PREFETCH_FAILED 2
+
+#ifdef CONFIG_TALK_PREFETCH
+/* Run the refill callback of a buffer that is sent in advance */
+void buffer_prefetch(buffer_t *buf);
+
+/* Use the data read by buffer_prefetch, called by the refill callbacks */
+uint8_t buffer_prefetched(buffer_t *buf);
+
+/* Store an error of buffer_prefetch, called by set_error_ts */
+uint8_t buffer_prefetch_error(uint8_t errornum, uint8_t track, uint8_t sector);
+
+/* Undo buffer_prefetch before the file position changes */
+void buffer_cancel_prefetch(buffer_t *buf);
+#else
+#  define buffer_prefetch(buf)        do {} while (0)
+#  define buffer_prefetched(buf)      PREFETCH_NONE
+#  define buffer_prefetch_error(e,t,s) 0
+#  define buffer_cancel_prefetch(buf) do {} while (0)
+#endif
+
 /* Mark a buffer as dirty */
 void mark_buffer_dirty(buffer_t *buf);
 
@@ -95,8 +95,8 @@ static inline void board_init(void) {
 #endif
 
 #if defined(CONFIG_FAST_SERIAL)
-#  if !defined(__AVR__) || !defined(IEC_SRQ_INT)
-#    error "CONFIG_FAST_SERIAL needs AVR hardware with a dedicated SRQ interrupt!"
+#  if !defined(IEC_SRQ_INT)
+#    error "CONFIG_FAST_SERIAL needs hardware with a dedicated SRQ interrupt!"
 #  endif
 #endif
 
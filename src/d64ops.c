@@ -36,6 +36,7 @@
 #include "rtc.h"
 #include "ustring.h"
 #include "wrapops.h"
+#include "dirindex.h"
 #include "d64ops.h"
 
 #define D41_SIZE_MIN      D41_SIZE
@@ -80,6 +81,18 @@
 /* used for error info only */
 #define MAX_SECTORS_PER_TRACK 40
 
+/* REL file side sectors */
+#define REL_SIDE_OFS_NUMBER     2
+#define REL_SIDE_OFS_RECORDLEN  3
+#define REL_SIDE_OFS_GROUP      4
+#define REL_SIDE_OFS_BLOCKS    16
+#define REL_SIDE_BLOCKS       120
+#define REL_SIDE_GROUP          6
+#define REL_SUPER_OFS_MARKER    2
+#define REL_SUPER_OFS_GROUPS    3
+#define REL_SUPER_MARKER     0xfe
+#define REL_SUPER_GROUPS      126
+
 typedef enum { BAM_BITFIELD, BAM_FREECOUNT } bamdata_t;
 
 struct {
@@ -93,6 +106,55 @@ static buffer_t *bam_buffer;  // recently-used buffer
 static buffer_t *bam_buffer2; // secondary buffer
 static uint8_t   bam_refcount;
 
+#ifdef CONFIG_FULL_BAM
+#  if CONFIG_FULL_BAM > 32
+#    error "CONFIG_FULL_BAM must not be larger than 32"
+#  endif
+/* complete BAM of one image, see fullbam_use */
+static FULLBAM_ATTRIB struct {
+  uint8_t  part;                    // partition, 255: unused
+  uint8_t  sectors;                 // number of BAM sectors of the image
+  uint8_t  current;                 // sector of the last move_bam_window
+  uint8_t  used;                    // last move_bam_window pointed here
+  uint8_t  last_track;              // last track with BAM information
+  uint16_t firstfree;               // first track that may have free sectors
+  uint32_t dirty;                   // modified sectors, one bit per sector
+  uint16_t freecount[256];          // free sectors per track
+  uint8_t  data[CONFIG_FULL_BAM][256];
+} fullbam;
+#endif
+
+#ifdef CONFIG_IMAGE_CACHE
+#  if CONFIG_IMAGE_CACHE < 2 || CONFIG_IMAGE_CACHE > 255
+#    error "CONFIG_IMAGE_CACHE must be between 2 and 255"
+#  endif
+/* maximum number of sectors read by one cache fill */
+#  define IMAGECACHE_FILL (CONFIG_IMAGE_CACHE / 2)
+
+/* sector cache of the mounted images, see cached_read */
+static IMAGECACHE_ATTRIB struct {
+  uint16_t clock;                   // use counter for the LRU replacement
+  uint8_t  part[CONFIG_IMAGE_CACHE];  // partition, 255: unused
+  uint16_t lba[CONFIG_IMAGE_CACHE];   // LBA sector number
+  uint16_t used[CONFIG_IMAGE_CACHE];  // value of clock at the last use
+  uint8_t  data[CONFIG_IMAGE_CACHE][256];
+} imagecache;
+#endif
+
+#ifdef CONFIG_D64_ALLOC_RUN
+#  if CONFIG_D64_ALLOC_RUN < 1 || CONFIG_D64_ALLOC_RUN > 255
+#    error "CONFIG_D64_ALLOC_RUN must be between 1 and 255"
+#  endif
+/* sectors allocated in advance for a file that is written, see allocrun_fill */
+static struct {
+  buffer_t *owner;                  // buffer of the file, NULL: unused
+  uint8_t   part;                   // partition of the sectors
+  uint8_t   count;                  // number of sectors in ts
+  uint8_t   next;                   // next sector to hand out
+  uint8_t   ts[CONFIG_D64_ALLOC_RUN][2];
+} allocrun;
+#endif
+
 /* ------------------------------------------------------------------------- */
 /*  Forward declarations                                                     */
 /* ------------------------------------------------------------------------- */
@@ -140,7 +202,7 @@ static uint8_t get_param(uint8_t part, param_t param) {
 }
 
 /**
- * sector_lba - Transform a track/sector pair into a LBA sector number
+ * calc_sector_lba - Transform a track/sector pair into a LBA sector number
  * @part  : partition number
  * @track : Track number
  * @sector: Sector number
@@ -148,7 +210,7 @@ static uint8_t get_param(uint8_t part, param_t param) {
  * Calculates an LBA-style sector number for a given track/sector pair.
  */
 /* This version used the least code of all tested variants. */
-static uint16_t sector_lba(uint8_t part, uint8_t track, const uint8_t sector) {
+static uint16_t calc_sector_lba(uint8_t part, uint8_t track, const uint8_t sector) {
   uint16_t offset = 0;
 
   track--; /* Track numbers are 1-based */
@@ -179,26 +241,14 @@ static uint16_t sector_lba(uint8_t part, uint8_t track, const uint8_t sector) {
 }
 
 /**
- * sector_offset - Transform a track/sector pair into a D64 offset
- * @part  : partition number
- * @track : Track number
- * @sector: Sector number
- *
- * Calculates an offset into a D64 file from a track and sector number.
- */
-static uint32_t sector_offset(uint8_t part, uint8_t track, const uint8_t sector) {
-  return 256L * sector_lba(part,track,sector);
-}
-
-/**
- * d64_sectors_per_track - number of sectors on given track
+ * calc_sectors_per_track - number of sectors on given track
  * @part : partition number
  * @track: Track number
  *
- * This function returns the number of sectors on the given track
+ * This function calculates the number of sectors on the given track
  * of a 1541/71/81 disk. Invalid track numbers will return invalid results.
  */
-uint16_t d64_sectors_per_track(uint8_t part, uint8_t track) {
+static uint16_t calc_sectors_per_track(uint8_t part, uint8_t track) {
   switch (partition[part].imagetype & D64_TYPE_MASK) {
   case D64_TYPE_D71:
   default:
@@ -222,6 +272,244 @@ uint16_t d64_sectors_per_track(uint8_t part, uint8_t track) {
   }
 }
 
+#ifdef CONFIG_D64_TRACKTABLE
+/**
+ * build_tracktable - precalculate the track layout of an image
+ * @part: partition number
+ *
+ * This function fills the track tables of the partition with the
+ * first LBA sector number and the number of sectors of every track,
+ * so the sector address calculations for the mounted image are a
+ * simple table lookup. The imagetype of the partition must be set.
+ */
+static void build_tracktable(uint8_t part) {
+  for (uint8_t t = 0; t < D64_TRACKTABLE_SIZE; t++) {
+    partition[part].tracklba[t] = calc_sector_lba(part, t, 0);
+    /* 256 sectors (DNP) are stored as 0 */
+    partition[part].trackspt[t] = (uint8_t)calc_sectors_per_track(part, t);
+  }
+}
+#else
+#  define build_tracktable(part) do {} while (0)
+#endif
+
+/**
+ * sector_lba - Transform a track/sector pair into a LBA sector number
+ * @part  : partition number
+ * @track : Track number
+ * @sector: Sector number
+ *
+ * Calculates an LBA-style sector number for a given track/sector pair.
+ */
+static uint16_t sector_lba(uint8_t part, uint8_t track, const uint8_t sector) {
+#ifdef CONFIG_D64_TRACKTABLE
+  if (track < D64_TRACKTABLE_SIZE)
+    return partition[part].tracklba[track] + sector;
+#endif
+  return calc_sector_lba(part, track, sector);
+}
+
+/**
+ * sector_offset - Transform a track/sector pair into a D64 offset
+ * @part  : partition number
+ * @track : Track number
+ * @sector: Sector number
+ *
+ * Calculates an offset into a D64 file from a track and sector number.
+ */
+static uint32_t sector_offset(uint8_t part, uint8_t track, const uint8_t sector) {
+  return 256L * sector_lba(part,track,sector);
+}
+
+/**
+ * d64_sectors_per_track - number of sectors on given track
+ * @part : partition number
+ * @track: Track number
+ *
+ * This function returns the number of sectors on the given track
+ * of a 1541/71/81 disk. Invalid track numbers will return invalid results.
+ */
+uint16_t d64_sectors_per_track(uint8_t part, uint8_t track) {
+#ifdef CONFIG_D64_TRACKTABLE
+  if (track < D64_TRACKTABLE_SIZE) {
+    uint8_t sectors = partition[part].trackspt[track];
+
+    return sectors ? sectors : 256;
+  }
+#endif
+  return calc_sectors_per_track(part, track);
+}
+
+#ifdef CONFIG_IMAGE_CACHE
+/**
+ * imagecache_invalidate - remove the sectors of a partition from the cache
+ * @part: partition number, 255 for all partitions
+ */
+static void imagecache_invalidate(uint8_t part) {
+  for (uint8_t i = 0; i < CONFIG_IMAGE_CACHE; i++)
+    if (part == 255 || imagecache.part[i] == part)
+      imagecache.part[i] = 255;
+}
+
+/**
+ * imagecache_lookup - find a sector in the cache
+ * @part: partition number
+ * @lba : LBA sector number
+ *
+ * Returns the cache line holding the sector or 255 if it is not cached.
+ */
+static uint8_t imagecache_lookup(uint8_t part, uint16_t lba) {
+  for (uint8_t i = 0; i < CONFIG_IMAGE_CACHE; i++)
+    if (imagecache.part[i] == part && imagecache.lba[i] == lba)
+      return i;
+
+  return 255;
+}
+
+/**
+ * imagecache_touch - mark a cache line as used
+ * @line: cache line
+ */
+static void imagecache_touch(uint8_t line) {
+  if (++imagecache.clock == 0) {
+    /* Restart the ages of all lines */
+    memset(imagecache.used, 0, sizeof(imagecache.used));
+    imagecache.clock = 1;
+  }
+  imagecache.used[line] = imagecache.clock;
+}
+
+/**
+ * imagecache_fill - read sectors of one track into the cache
+ * @part  : partition number
+ * @track : track number
+ * @sector: sector number that must be in the cache
+ *
+ * This function reads the complete track, or as much of it following
+ * @sector as fits into IMAGECACHE_FILL lines, with a single image_read
+ * call. The sectors replace the run of consecutive lines whose most
+ * recent use is the oldest. Returns the line of @sector or 255 if the
+ * sectors could not be read.
+ */
+static uint8_t imagecache_fill(uint8_t part, uint8_t track, uint8_t sector) {
+  uint16_t spt   = d64_sectors_per_track(part, track);
+  uint8_t  first = 0;
+  uint8_t  count, i, j, start;
+  uint16_t lba, newest, best;
+
+  if (spt > IMAGECACHE_FILL) {
+    first = sector;
+    if (spt - sector > IMAGECACHE_FILL)
+      spt = sector + IMAGECACHE_FILL;
+  }
+  count = spt - first;
+  lba   = sector_lba(part, track, first);
+
+  /* Find the least recently used run of lines */
+  start = 0;
+  best  = 0xffff;
+  for (i = 0; i + count <= CONFIG_IMAGE_CACHE; i++) {
+    newest = 0;
+    for (j = i; j < i + count; j++)
+      if (imagecache.part[j] != 255 && imagecache.used[j] > newest)
+        newest = imagecache.used[j];
+
+    if (newest < best) {
+      best  = newest;
+      start = i;
+      if (newest == 0)
+        break;
+    }
+  }
+
+  /* Drop copies of the sectors in other lines */
+  for (i = 0; i < CONFIG_IMAGE_CACHE; i++)
+    if (imagecache.part[i] == part &&
+        (uint16_t)(imagecache.lba[i] - lba) < count)
+      imagecache.part[i] = 255;
+
+  for (i = start; i < start + count; i++)
+    imagecache.part[i] = 255;
+
+  if (image_read(part, 256L * lba, imagecache.data[start], 256 * count))
+    return 255;
+
+  for (i = 0; i < count; i++) {
+    imagecache.part[start + i] = part;
+    imagecache.lba[start + i]  = lba + i;
+    imagecache.used[start + i] = imagecache.clock;
+  }
+
+  return start + sector - first;
+}
+
+/**
+ * cached_read - read the start of a sector through the cache
+ * @part  : partition number
+ * @track : track number
+ * @sector: sector number
+ * @buf   : pointer to where the data should be read to
+ * @len   : number of bytes to be read, at most 256
+ *
+ * This function copies the start of a sector from the image sector cache,
+ * filling the cache with the sector's track if it is not there yet.
+ * Returns the same as image_read.
+ */
+static uint8_t cached_read(uint8_t part, uint8_t track, uint8_t sector,
+                           uint8_t *buf, uint16_t len) {
+  uint16_t lba  = sector_lba(part, track, sector);
+  uint8_t  line = imagecache_lookup(part, lba);
+
+  if (line == 255) {
+    line = imagecache_fill(part, track, sector);
+    if (line == 255)
+      return image_read(part, 256L * lba, buf, len);
+  }
+
+  imagecache_touch(line);
+  memcpy(buf, imagecache.data[line], len);
+  return 0;
+}
+
+/**
+ * cached_write - write data to the image and update the cache
+ * @part  : partition number
+ * @offset: offset in the image file
+ * @buffer: pointer to the data to be written
+ * @bytes : number of bytes to write
+ * @flush : Flags if written data should be flushed to disk immediately
+ *
+ * This function copies the data into all cached sectors it overlaps
+ * and writes it to the image with image_write. Returns the same as
+ * image_write.
+ */
+static uint8_t cached_write(uint8_t part, DWORD offset, void *buffer,
+                            uint16_t bytes, uint8_t flush) {
+  for (uint8_t i = 0; i < CONFIG_IMAGE_CACHE; i++) {
+    DWORD start, end, linestart;
+
+    if (imagecache.part[i] != part)
+      continue;
+
+    linestart = 256L * imagecache.lba[i];
+    start     = offset > linestart ? offset : linestart;
+    end       = offset + bytes < linestart + 256 ? offset + bytes : linestart + 256;
+    if (start < end)
+      memcpy(imagecache.data[i] + (start - linestart),
+             (uint8_t *)buffer + (start - offset), end - start);
+  }
+
+  return image_write(part, offset, buffer, bytes, flush);
+}
+#else
+#  define imagecache_invalidate(part) do {} while (0)
+#  define imagecache_lookup(part, lba) 255
+#  define cached_read(part, track, sector, buf, len) \
+  image_read(part, sector_offset(part, track, sector), buf, len)
+#  define cached_write(part, offset, buffer, bytes, flush) \
+  image_write(part, offset, buffer, bytes, flush)
+#endif
+
 /**
  * checked_read - read a specified sector after range-checking
  * @part  : partition number
@@ -232,8 +520,8 @@ uint16_t d64_sectors_per_track(uint8_t part, uint8_t track) {
  * @error : error number to be flagged if the range check fails
  *
  * This function checks if the track and sector are within the
- * limits for the image format and calls image_read to read
- * the data if they are. Returns the result of image_read or
+ * limits for the image format and calls cached_read to read
+ * the data if they are. Returns the result of cached_read or
  * 2 if the range check failed.
  */
 static uint8_t checked_read(uint8_t part, uint8_t track, uint8_t sector, uint8_t *buf, uint16_t len, uint8_t error) {
@@ -259,7 +547,7 @@ static uint8_t checked_read(uint8_t part, uint8_t track, uint8_t sector, uint8_t
     /* 1 is OK, unknown values are accepted too */
   }
 
-  return image_read(part, sector_offset(part,track,sector), buf, len);
+  return cached_read(part, track, sector, buf, len);
 }
 
 /**
@@ -297,12 +585,13 @@ static void update_timestamp(uint8_t *buffer) {
  * @flush: if true, data is flushed to disk immediately
  *
  * This function writes a single directory entry specified by @dh
- * from the buffer @buf.
+ * from the buffer @buf and invalidates the directory name index.
  * Assumes that it is never called with an invalid track/sector.
  * Returns the same as image_write
  */
 static uint8_t write_entry(uint8_t part, struct d64dh *dh, uint8_t *buf, uint8_t flush) {
-  return image_write(part, sector_offset(part, dh->track, dh->sector) +
+  dirindex_invalidate();
+  return cached_write(part, sector_offset(part, dh->track, dh->sector) +
                            dh->entry * 32, buf, 32, flush);
 }
 
@@ -345,10 +634,11 @@ static void strnsubst(uint8_t *buffer, uint8_t len, uint8_t oldchar, uint8_t new
 /* fill a sector with 0 0xff 0* to generate a new empty directory sector */
 /* needs a 256 byte work area in *data */
 static uint8_t clear_dir_sector(uint8_t part, uint8_t t, uint8_t s, uint8_t *data) {
+  dirindex_invalidate();
   memset(data, 0, 256);
 
   data[1] = 0xff;
-  return image_write(part, sector_offset(part, t, s), data, 256, 0);
+  return cached_write(part, sector_offset(part, t, s), data, 256, 0);
 }
 
 
@@ -367,7 +657,7 @@ static uint8_t bam_buffer_flush(buffer_t *buf) {
   uint8_t res;
 
   if (buf->mustflush && buf->pvt.bam.part < max_part) {
-    res = image_write(buf->pvt.bam.part,
+    res = cached_write(buf->pvt.bam.part,
                       sector_offset(buf->pvt.bam.part,
                                     buf->pvt.bam.track,
                                     buf->pvt.bam.sector),
@@ -433,172 +723,402 @@ static uint8_t bam_buffer_match(buffer_t *buf, uint8_t part,
 }
 
 /**
- * move_bam_window - read correct BAM sector into window.
+ * bam_location - find the BAM information of a track
  * @part  : partition
  * @track : track number
- * @type  : type of pointer requested
- * @ptr   : pointer to track information in BAM sector
+ * @type  : type of information requested
+ * @t     : pointer to a variable for the track of the BAM sector
+ * @s     : pointer to a variable for the sector of the BAM sector
+ * @pos   : pointer to a variable for the offset in the BAM sector
  *
- * This function reads the correct BAM sector into memory for the requested
- * track, flushing an existing BAM sector to disk if needed.  It also
- * calculates the correct pointer into the BAM sector for the appropriate
- * track.  Since the BAM contains both sector counts and sector allocation
- * bitmaps, type is used to signal which reference is desired.
- * This function may swap the BAM buffer pointers, after it returns
- * bam_buffer is always the buffer with the requested sector.
- * Returns 0 if successful, != 0 otherwise.
+ * This function calculates where the sector count or the allocation
+ * bitmap of the given track is stored. Returns the index of the BAM
+ * sector within the BAM of the image.
  */
-static uint8_t move_bam_window(uint8_t part, uint8_t track, bamdata_t type, uint8_t **ptr) {
-  uint8_t res;
-  uint8_t t,s, pos;
-
+static uint8_t bam_location(uint8_t part, uint8_t track, bamdata_t type,
+                            uint8_t *t, uint8_t *s, uint8_t *pos) {
   switch(partition[part].imagetype & D64_TYPE_MASK) {
   case D64_TYPE_D41:
   default:
-    t   = D41_BAM_TRACK;
-    s   = D41_BAM_SECTOR;
-    pos = D41_BAM_BYTES_PER_TRACK * track + (type == BAM_BITFIELD ? 1:0);
-    break;
+    *t   = D41_BAM_TRACK;
+    *s   = D41_BAM_SECTOR;
+    *pos = D41_BAM_BYTES_PER_TRACK * track + (type == BAM_BITFIELD ? 1:0);
+    return 0;
 
   case D64_TYPE_D71:
     if (track > 35 && type == BAM_BITFIELD) {
-      t   = D71_BAM2_TRACK;
-      s   = D71_BAM2_SECTOR;
-      pos = (track - 36) * D71_BAM2_BYTES_PER_TRACK;
+      *t   = D71_BAM2_TRACK;
+      *s   = D71_BAM2_SECTOR;
+      *pos = (track - 36) * D71_BAM2_BYTES_PER_TRACK;
+      return 1;
+    }
+    *t = D41_BAM_TRACK;
+    *s = D41_BAM_SECTOR;
+    if (track > 35) {
+      *pos = (track - 36) + D71_BAM_COUNTER2OFFSET;
     } else {
-      t = D41_BAM_TRACK;
-      s = D41_BAM_SECTOR;
-      if (track > 35) {
-        pos = (track - 36) + D71_BAM_COUNTER2OFFSET;
-      } else {
-        pos = D41_BAM_BYTES_PER_TRACK * track + (type == BAM_BITFIELD ? 1:0);
-      }
+      *pos = D41_BAM_BYTES_PER_TRACK * track + (type == BAM_BITFIELD ? 1:0);
     }
-    break;
+    return 0;
 
   case D64_TYPE_D81:
-    t   = D81_BAM_TRACK;
-    s   = (track < 41 ? D81_BAM_SECTOR1 : D81_BAM_SECTOR2);
+    *t   = D81_BAM_TRACK;
+    *s   = (track < 41 ? D81_BAM_SECTOR1 : D81_BAM_SECTOR2);
     if (track > 40)
       track -= 40;
-    pos = D81_BAM_OFFSET + track * D81_BAM_BYTES_PER_TRACK + (type == BAM_BITFIELD ? 1:0);
-    break;
+    *pos = D81_BAM_OFFSET + track * D81_BAM_BYTES_PER_TRACK + (type == BAM_BITFIELD ? 1:0);
+    return *s - D81_BAM_SECTOR1;
 
   case D64_TYPE_DNP:
-    t   = DNP_BAM_TRACK;
-    s   = DNP_BAM_SECTOR + (track >> 3);
-    pos = (track & 0x07) * 32;
-    break;
+    *t   = DNP_BAM_TRACK;
+    *s   = DNP_BAM_SECTOR + (track >> 3);
+    *pos = (track & 0x07) * 32;
+    return track >> 3;
   }
+}
 
-  if (!bam_buffer_match(bam_buffer, part, t, s)) {
-    /* check if the second BAM buffer exists */
-    if (bam_buffer2) {
-      /* unconditionally swap to the other BAM buffer        */
-      /* either it has the data or it was less-recently used */
+/**
+ * count_free - count the free sectors of a track
+ * @part    : partition
+ * @trackmap: pointer to the sector count of the track in the BAM
+ *
+ * This function returns the number of free sectors of a track, based on
+ * its BAM information as returned by move_bam_window for BAM_FREECOUNT.
+ */
+static uint16_t count_free(uint8_t part, uint8_t *trackmap) {
+  if ((partition[part].imagetype & D64_TYPE_MASK) == D64_TYPE_DNP) {
+    /* DNP has no counter in its BAM */
+    uint16_t blocks = 0;
+    for (uint8_t i=0;i < DNP_BAM_BYTES_PER_TRACK;i++) {
+      // From http://everything2.com/title/counting%25201%2520bits
+      uint8_t b = (trackmap[i] & 0x55) + (trackmap[i]>>1 & 0x55);
+      b = (b & 0x33) + (b >> 2 & 0x33);
+      b = (b & 0x0f) + (b >> 4 & 0x0f);
+      blocks += b;
+    }
+    return blocks;
+  }
 
-      /* Note for future optimization:
-       * If buf1 is invalid and buf2 valid but not matching this will swap and
-       * use buf2 for the data instead of buf1 - using buf1
-       * while keeping buf2 without swapping would be better.
-       */
-      bam_buffer_swap();
+  return *trackmap;
+}
 
-      /* check again, now in the other buffer */
-      if (bam_buffer_match(bam_buffer, part, t, s))
-        goto found;
-    } else {
-      /* allocate and swap to the second BAM buffer if the first one is valid */
-      if (bam_buffer->pvt.bam.part != 255) {
-        if (bam_buffer_alloc(&bam_buffer2)) {
-          /* allocation failed, reset error and continue with just one buffer */
-          set_error(ERROR_OK);
-        } else {
-          /* switch to the new buffer */
-          bam_buffer_swap();
-        }
-      }
-    }
+#ifdef CONFIG_FULL_BAM
+/**
+ * fullbam_sector - get the location of a BAM sector
+ * @part  : partition
+ * @index : index of the sector within the BAM
+ * @t     : pointer to a variable for the track of the BAM sector
+ * @s     : pointer to a variable for the sector of the BAM sector
+ *
+ * This function calculates track and sector of the index-th BAM
+ * sector of the image on partition part.
+ */
+static void fullbam_sector(uint8_t part, uint8_t index, uint8_t *t, uint8_t *s) {
+  uint8_t track, pos;
 
-    /* Need to read the BAM sector - flush only the target buffer */
-    if (bam_buffer->cleanup(bam_buffer))
-      return 1;
+  /* first track whose BAM information is stored in this sector */
+  switch (partition[part].imagetype & D64_TYPE_MASK) {
+  case D64_TYPE_D71:
+    track = index ? 36 : 1;
+    break;
 
-    res = image_read(part, sector_offset(part, t, s), bam_buffer->data, 256);
-    if(res)
-      return res;
+  case D64_TYPE_D81:
+    track = index ? 41 : 1;
+    break;
 
-    bam_buffer->pvt.bam.part   = part;
-    bam_buffer->pvt.bam.track  = t;
-    bam_buffer->pvt.bam.sector = s;
+  default:
+    track = index << 3;
+    break;
   }
 
- found:
-  *ptr = bam_buffer->data + pos;
-  return 0;
+  bam_location(part, track, BAM_BITFIELD, t, s, &pos);
 }
 
 /**
- * is_free - checks if the given sector is marked as free
- * @part  : partition
- * @track : track number
- * @sector: sector number
+ * fullbam_flush - write the modified sectors of the in-RAM BAM to disk
  *
- * This function checks if the given sector is marked as free in
- * the BAM of drive "part". Returns 0 if allocated, >0 if free, <0 on error.
+ * This function writes all BAM sectors of the in-RAM BAM that were
+ * changed since they were read to the disk image. Returns 0 if
+ * successful, != 0 otherwise.
  */
-static int8_t is_free(uint8_t part, uint8_t track, uint8_t sector) {
-  uint8_t res;
-  uint8_t *ptr = NULL;
+static uint8_t fullbam_flush(void) {
+  uint8_t i, t, s, res = 0;
 
-  res = move_bam_window(part,track,BAM_BITFIELD,&ptr);
-  if(res)
-    return -1;
+  if (fullbam.part >= max_part)
+    return 0;
 
-  if (partition[part].imagetype == D64_TYPE_DNP)
-    return (ptr[sector>>3] & (0x80>>(sector&7))) != 0;
-  else
-    return (ptr[sector>>3] & (1<<(sector&7))) != 0;
+  for (i = 0; i < fullbam.sectors; i++) {
+    if (!(fullbam.dirty & (1UL << i)))
+      continue;
+
+    fullbam_sector(fullbam.part, i, &t, &s);
+    res |= cached_write(fullbam.part, sector_offset(fullbam.part, t, s),
+                       fullbam.data[i], 256, 1);
+  }
+  fullbam.dirty = 0;
+
+  return res;
 }
 
 /**
- * sectors_free - returns the number of free sectors on a given track
- * @part  : partition
- * @track : track number
+ * fullbam_use - make sure that the in-RAM BAM holds an image
+ * @part: partition
  *
- * This function returns the number of free sectors on the given track
- * of partition part.
+ * This function loads the complete BAM of the image mounted on partition
+ * part into RAM if it is not there already, writing back the BAM of the
+ * previous image if needed. Returns 1 if the in-RAM BAM holds the BAM of
+ * the image, 0 if the image has to use the BAM buffers instead because
+ * its BAM is too large or could not be read.
  */
-static uint16_t sectors_free(uint8_t part, uint8_t track) {
-  uint8_t *trackmap = NULL;
+static uint8_t fullbam_use(uint8_t part) {
+  uint8_t i, t, s, pos, index, sectors;
+  uint8_t last_track = get_param(part, LAST_BAM_TRACK);
 
-  if (track < 1 || track > get_param(part, LAST_BAM_TRACK))
-    return 0;
+  if (fullbam.part == part)
+    return 1;
 
   switch (partition[part].imagetype & D64_TYPE_MASK) {
+  case D64_TYPE_D71:
+  case D64_TYPE_D81:
+    sectors = 2;
+    break;
 
   case D64_TYPE_DNP:
-    if(move_bam_window(part,track,BAM_FREECOUNT,&trackmap))
-      return 0;
+    sectors = (last_track >> 3) + 1;
+    break;
 
-    uint16_t blocks = 0;
-    for (uint8_t i=0;i < DNP_BAM_BYTES_PER_TRACK;i++) {
-      // From http://everything2.com/title/counting%25201%2520bits
-      uint8_t b = (trackmap[i] & 0x55) + (trackmap[i]>>1 & 0x55);
-      b = (b & 0x33) + (b >> 2 & 0x33);
-      b = (b & 0x0f) + (b >> 4 & 0x0f);
-      blocks += b;
-    }
-    return blocks;
-
-  case D64_TYPE_D71:
-  case D64_TYPE_D81:
   case D64_TYPE_D41:
   default:
-    if(move_bam_window(part,track,BAM_FREECOUNT,&trackmap))
+    sectors = 1;
+    break;
+  }
+
+  if (sectors > CONFIG_FULL_BAM)
+    return 0;
+
+  /* The BAM buffers may hold newer data for this image */
+  if (bam_buffer && bam_buffer->pvt.bam.part == part) {
+    bam_buffer->cleanup(bam_buffer);
+    bam_buffer->pvt.bam.part = 255;
+  }
+  if (bam_buffer2 && bam_buffer2->pvt.bam.part == part) {
+    bam_buffer2->cleanup(bam_buffer2);
+    bam_buffer2->pvt.bam.part = 255;
+  }
+
+  if (fullbam_flush())
+    return 0;
+  fullbam.part = 255;
+
+  for (i = 0; i < sectors; i++) {
+    fullbam_sector(part, i, &t, &s);
+    if (image_read(part, sector_offset(part, t, s), fullbam.data[i], 256))
       return 0;
-    return *trackmap;
   }
+
+  fullbam.part       = part;
+  fullbam.sectors    = sectors;
+  fullbam.last_track = last_track;
+  fullbam.dirty      = 0;
+
+  /* Count the free sectors of every track */
+  fullbam.firstfree = last_track + 1;
+  for (i = last_track; i > 0; i--) {
+    index = bam_location(part, i, BAM_FREECOUNT, &t, &s, &pos);
+    fullbam.freecount[i] = count_free(part, fullbam.data[index] + pos);
+    if (fullbam.freecount[i])
+      fullbam.firstfree = i;
+  }
+
+  return 1;
+}
+
+/**
+ * fullbam_adjust - update the free sector count of a track
+ * @track: track number
+ * @delta: change of the number of free sectors
+ *
+ * This function updates the free sector count and the first free track
+ * of the in-RAM BAM after the last BAM sector returned by move_bam_window
+ * was modified.
+ */
+static void fullbam_adjust(uint8_t track, int8_t delta) {
+  if (!fullbam.used)
+    return;
+
+  fullbam.freecount[track] += delta;
+
+  if (fullbam.freecount[track] == 0) {
+    if (track == fullbam.firstfree)
+      while (fullbam.firstfree <= fullbam.last_track &&
+             fullbam.freecount[fullbam.firstfree] == 0)
+        fullbam.firstfree++;
+  } else if (track < fullbam.firstfree) {
+    fullbam.firstfree = track;
+  }
+}
+#else
+#  define fullbam_adjust(track, delta) do {} while (0)
+#endif
+
+/**
+ * bam_dirty - mark the current BAM sector as modified
+ *
+ * This function marks the BAM sector returned by the last call of
+ * move_bam_window as modified, so it is written back to the image.
+ */
+static void bam_dirty(void) {
+#ifdef CONFIG_FULL_BAM
+  if (fullbam.used) {
+    fullbam.dirty |= 1UL << fullbam.current;
+    return;
+  }
+#endif
+  bam_buffer->mustflush = 1;
+}
+
+/**
+ * bam_data - get the current BAM sector
+ *
+ * This function returns a pointer to the data of the BAM sector returned
+ * by the last call of move_bam_window.
+ */
+static uint8_t *bam_data(void) {
+#ifdef CONFIG_FULL_BAM
+  if (fullbam.used)
+    return fullbam.data[fullbam.current];
+#endif
+  return bam_buffer->data;
+}
+
+/**
+ * move_bam_window - read correct BAM sector into window.
+ * @part  : partition
+ * @track : track number
+ * @type  : type of pointer requested
+ * @ptr   : pointer to track information in BAM sector
+ *
+ * This function reads the correct BAM sector into memory for the requested
+ * track, flushing an existing BAM sector to disk if needed.  It also
+ * calculates the correct pointer into the BAM sector for the appropriate
+ * track.  Since the BAM contains both sector counts and sector allocation
+ * bitmaps, type is used to signal which reference is desired.
+ * If the image fits into the in-RAM BAM, the pointer points there.
+ * Otherwise this function may swap the BAM buffer pointers, after it
+ * returns bam_buffer is always the buffer with the requested sector.
+ * Use bam_data and bam_dirty to access the whole sector.
+ * Returns 0 if successful, != 0 otherwise.
+ */
+static uint8_t move_bam_window(uint8_t part, uint8_t track, bamdata_t type, uint8_t **ptr) {
+  uint8_t res;
+  uint8_t t,s, pos, index;
+
+  index = bam_location(part, track, type, &t, &s, &pos);
+
+#ifdef CONFIG_FULL_BAM
+  fullbam.used = fullbam_use(part);
+  if (fullbam.used) {
+    fullbam.current = index;
+    *ptr = fullbam.data[index] + pos;
+    return 0;
+  }
+#else
+  (void)index;
+#endif
+
+  if (!bam_buffer_match(bam_buffer, part, t, s)) {
+    /* check if the second BAM buffer exists */
+    if (bam_buffer2) {
+      /* unconditionally swap to the other BAM buffer        */
+      /* either it has the data or it was less-recently used */
+
+      /* Note for future optimization:
+       * If buf1 is invalid and buf2 valid but not matching this will swap and
+       * use buf2 for the data instead of buf1 - using buf1
+       * while keeping buf2 without swapping would be better.
+       */
+      bam_buffer_swap();
+
+      /* check again, now in the other buffer */
+      if (bam_buffer_match(bam_buffer, part, t, s))
+        goto found;
+    } else {
+      /* allocate and swap to the second BAM buffer if the first one is valid */
+      if (bam_buffer->pvt.bam.part != 255) {
+        if (bam_buffer_alloc(&bam_buffer2)) {
+          /* allocation failed, reset error and continue with just one buffer */
+          set_error(ERROR_OK);
+        } else {
+          /* switch to the new buffer */
+          bam_buffer_swap();
+        }
+      }
+    }
+
+    /* Need to read the BAM sector - flush only the target buffer */
+    if (bam_buffer->cleanup(bam_buffer))
+      return 1;
+
+    res = image_read(part, sector_offset(part, t, s), bam_buffer->data, 256);
+    if(res)
+      return res;
+
+    bam_buffer->pvt.bam.part   = part;
+    bam_buffer->pvt.bam.track  = t;
+    bam_buffer->pvt.bam.sector = s;
+  }
+
+ found:
+  *ptr = bam_buffer->data + pos;
+  return 0;
+}
+
+/**
+ * is_free - checks if the given sector is marked as free
+ * @part  : partition
+ * @track : track number
+ * @sector: sector number
+ *
+ * This function checks if the given sector is marked as free in
+ * the BAM of drive "part". Returns 0 if allocated, >0 if free, <0 on error.
+ */
+static int8_t is_free(uint8_t part, uint8_t track, uint8_t sector) {
+  uint8_t res;
+  uint8_t *ptr = NULL;
+
+  res = move_bam_window(part,track,BAM_BITFIELD,&ptr);
+  if(res)
+    return -1;
+
+  if (partition[part].imagetype == D64_TYPE_DNP)
+    return (ptr[sector>>3] & (0x80>>(sector&7))) != 0;
+  else
+    return (ptr[sector>>3] & (1<<(sector&7))) != 0;
+}
+
+/**
+ * sectors_free - returns the number of free sectors on a given track
+ * @part  : partition
+ * @track : track number
+ *
+ * This function returns the number of free sectors on the given track
+ * of partition part.
+ */
+static uint16_t sectors_free(uint8_t part, uint8_t track) {
+  uint8_t *trackmap = NULL;
+
+  if (track < 1 || track > get_param(part, LAST_BAM_TRACK))
+    return 0;
+
+#ifdef CONFIG_FULL_BAM
+  if (fullbam_use(part))
+    return fullbam.freecount[track];
+#endif
+
+  if(move_bam_window(part,track,BAM_FREECOUNT,&trackmap))
+    return 0;
+
+  return count_free(part, trackmap);
 }
 
 /**
@@ -623,13 +1143,14 @@ static uint8_t allocate_sector(uint8_t part, uint8_t track, uint8_t sector) {
     if(move_bam_window(part,track,BAM_BITFIELD,&trackmap))
       return 1;
 
-    bam_buffer->mustflush = 1;
+    bam_dirty();
 
     if (partition[part].imagetype == D64_TYPE_DNP) {
       /* For some reason DNP has its bitfield reversed */
       trackmap[sector>>3] &= (uint8_t)~(0x80>>(sector&7));
 
       /* DNP has no counter in its BAM */
+      fullbam_adjust(track, -1);
       return 0;
     }
 
@@ -640,7 +1161,8 @@ static uint8_t allocate_sector(uint8_t part, uint8_t track, uint8_t sector) {
 
     if (trackmap[0] > 0) {
       trackmap[0]--;
-      bam_buffer->mustflush = 1;
+      bam_dirty();
+      fullbam_adjust(track, -1);
     }
   }
   return 0;
@@ -668,13 +1190,14 @@ static uint8_t free_sector(uint8_t part, uint8_t track, uint8_t sector) {
     if(move_bam_window(part,track,BAM_BITFIELD,&trackmap))
       return 1;
 
-    bam_buffer->mustflush = 1;
+    bam_dirty();
 
     if (partition[part].imagetype == D64_TYPE_DNP) {
       /* For some reason DNP has its bitfield reversed */
       trackmap[sector>>3] |= 0x80>>(sector&7);
 
       /* DNP has no counter in its BAM */
+      fullbam_adjust(track, 1);
       return 0;
     }
 
@@ -685,7 +1208,8 @@ static uint8_t free_sector(uint8_t part, uint8_t track, uint8_t sector) {
 
     if(trackmap[0] < d64_sectors_per_track(part, track)) {
       trackmap[0]++;
-      bam_buffer->mustflush = 1;
+      bam_dirty();
+      fullbam_adjust(track, 1);
     }
   }
   return 0;
@@ -714,6 +1238,12 @@ static uint8_t get_first_sector(uint8_t part, uint8_t *track, uint8_t *sector) {
   /* CMD drives, but track 1 seems to be semi-reserved for directory sectors.*/
   if (partition[part].imagetype == D64_TYPE_DNP) {
     *track = 2;
+#ifdef CONFIG_FULL_BAM
+    /* Skip the full tracks at the start of the disk */
+    if (fullbam_use(part) && fullbam.firstfree > 2 &&
+        fullbam.firstfree < get_param(part, LAST_BAM_TRACK))
+      *track = fullbam.firstfree;
+#endif
     while (sectors_free(part, *track) == 0) {
       (*track)++;
 
@@ -777,6 +1307,13 @@ static uint8_t get_next_sector(uint8_t part, uint8_t *track, uint8_t *sector) {
   if (partition[part].imagetype == D64_TYPE_DNP) {
     uint8_t newtrack = *track;
 
+#ifdef CONFIG_FULL_BAM
+    /* Skip the full tracks at the start of the disk */
+    if (fullbam_use(part) && newtrack < fullbam.firstfree &&
+        fullbam.firstfree < get_param(part, LAST_BAM_TRACK))
+      newtrack = fullbam.firstfree;
+#endif
+
     /* Find a track with free sectors */
     while (sectors_free(part, newtrack) == 0) {
       newtrack++;
@@ -879,6 +1416,102 @@ static uint8_t get_next_sector(uint8_t part, uint8_t *track, uint8_t *sector) {
   return 1;
 }
 
+#ifdef CONFIG_D64_ALLOC_RUN
+/**
+ * allocrun_release - free the unused sectors of the allocation run
+ *
+ * This function returns the sectors of the allocation run that have
+ * not been linked into a file yet to the BAM.
+ */
+static void allocrun_release(void) {
+  while (allocrun.next < allocrun.count) {
+    free_sector(allocrun.part, allocrun.ts[allocrun.next][0],
+                allocrun.ts[allocrun.next][1]);
+    allocrun.next++;
+  }
+
+  allocrun.owner = NULL;
+  allocrun.count = 0;
+  allocrun.next  = 0;
+}
+
+/**
+ * allocrun_fill - reserve sectors for a file that is written
+ * @buf: buffer of the file
+ *
+ * This function allocates up to CONFIG_D64_ALLOC_RUN sectors that follow
+ * the current sector of @buf in the order get_next_sector would choose
+ * them. Any sectors still reserved for another file are released first.
+ * Errors are not reported here; if the disk fills up, the allocation is
+ * repeated by d64_write when the run is used up so the error appears at
+ * the same point as without the run.
+ */
+static void allocrun_fill(buffer_t *buf) {
+  uint8_t part = buf->pvt.d64.part;
+  uint8_t t    = buf->pvt.d64.track;
+  uint8_t s    = buf->pvt.d64.sector;
+  uint8_t olderror = current_error;
+
+  allocrun_release();
+
+  allocrun.owner = buf;
+  allocrun.part  = part;
+
+  while (allocrun.count < CONFIG_D64_ALLOC_RUN) {
+    if (get_next_sector(part, &t, &s) || allocate_sector(part, t, s))
+      break;
+
+    allocrun.ts[allocrun.count][0] = t;
+    allocrun.ts[allocrun.count][1] = s;
+    allocrun.count++;
+  }
+
+  /* Keep the previous status, whatever it was */
+  if (current_error != olderror)
+    set_error(olderror);
+}
+
+/**
+ * allocrun_get - get the next reserved sector for a file
+ * @buf   : buffer of the file
+ * @track : pointer to a variable for the track
+ * @sector: pointer to a variable for the sector
+ *
+ * This function returns the next sector reserved for @buf in the
+ * variables pointed to by track/sector, refilling the run if
+ * necessary. Returns 1 if successful or 0 if no sector is available,
+ * in which case the caller must fall back to get_next_sector.
+ */
+static uint8_t allocrun_get(buffer_t *buf, uint8_t *track, uint8_t *sector) {
+  if (allocrun.owner != buf || allocrun.next >= allocrun.count)
+    allocrun_fill(buf);
+
+  if (allocrun.next >= allocrun.count)
+    return 0;
+
+  *track  = allocrun.ts[allocrun.next][0];
+  *sector = allocrun.ts[allocrun.next][1];
+  allocrun.next++;
+
+  return 1;
+}
+
+/**
+ * allocrun_close - release the allocation run of a file
+ * @buf: buffer of the file
+ *
+ * This function releases the sectors reserved for @buf, if any.
+ */
+static void allocrun_close(buffer_t *buf) {
+  if (allocrun.owner == buf)
+    allocrun_release();
+}
+#else
+#  define allocrun_fill(buf)      do {} while (0)
+#  define allocrun_get(buf, t, s) 0
+#  define allocrun_close(buf)     do {} while (0)
+#endif
+
 /**
  * nextdirentry - read the next dir entry to ops_scratch
  * @dh: directory handle
@@ -950,7 +1583,7 @@ static uint8_t find_empty_entry(path_t *path, dh_t *dh) {
     /* Link the old sector to the new */
     ops_scratch[0] = dh->dir.d64.track;
     ops_scratch[1] = dh->dir.d64.sector;
-    if (image_write(path->part, sector_offset(path->part,t,s), ops_scratch, 2, 0))
+    if (cached_write(path->part, sector_offset(path->part,t,s), ops_scratch, 2, 0))
       return 1;
 
     if (allocate_sector(path->part, dh->dir.d64.track, dh->dir.d64.sector))
@@ -976,7 +1609,7 @@ static uint8_t find_empty_entry(path_t *path, dh_t *dh) {
         (*blocks)++;
 
         /* Write new block count */
-        if (image_write(path->part,
+        if (cached_write(path->part,
                         sector_offset(path->part, ops_scratch[0], ops_scratch[1]) + ops_scratch[2] + DIR_OFS_SIZE_LOW - 2,
                         ops_scratch + 3, 2, 1))
           return 1;
@@ -1013,6 +1646,15 @@ static uint8_t find_empty_entry(path_t *path, dh_t *dh) {
  * This is the callback used as refill for files opened for reading.
  */
 static uint8_t d64_read(buffer_t *buf) {
+  /* Use the sector read in advance while the last one was sent */
+  switch (buffer_prefetched(buf)) {
+  case PREFETCH_OK:
+    return 0;
+
+  case PREFETCH_FAILED:
+    return 1;
+  }
+
   /* Store the current sector, used for append */
   buf->pvt.d64.track  = buf->data[0];
   buf->pvt.d64.sector = buf->data[1];
@@ -1031,6 +1673,14 @@ static uint8_t d64_read(buffer_t *buf) {
   } else {
     buf->lastused = 255;
     buf->sendeoi  = 0;
+
+    /* Read the linked sector ahead if it is valid and not cached */
+    if (buf->data[0] <= get_param(buf->pvt.d64.part, LAST_TRACK) &&
+        buf->data[1] < d64_sectors_per_track(buf->pvt.d64.part, buf->data[0]) &&
+        imagecache_lookup(buf->pvt.d64.part,
+                          sector_lba(buf->pvt.d64.part, buf->data[0], buf->data[1])) == 255)
+      image_readahead(buf->pvt.d64.part,
+                      sector_offset(buf->pvt.d64.part, buf->data[0], buf->data[1]));
   }
 
   return 0;
@@ -1074,29 +1724,34 @@ static uint8_t d64_write(buffer_t *buf) {
   buf->data[0] = 0;
   buf->data[1] = buf->lastused;
 
-  /* Find another free sector */
-  if (get_next_sector(buf->pvt.d64.part, &t, &s)) {
-    t = 0;
-    savederror = current_error;
-    goto storedata;
+  /* Use a sector allocated in advance if possible */
+  if (!allocrun_get(buf, &t, &s)) {
+    /* Find another free sector */
+    if (get_next_sector(buf->pvt.d64.part, &t, &s)) {
+      t = 0;
+      savederror = current_error;
+      goto storedata;
+    }
+
+    /* Allocate it */
+    if (allocate_sector(buf->pvt.d64.part, t, s)) {
+      allocrun_close(buf);
+      free_buffer(buf);
+      return 1;
+    }
   }
 
   buf->data[0] = t;
   buf->data[1] = s;
 
-  /* Allocate it */
-  if (allocate_sector(buf->pvt.d64.part, t, s)) {
-    free_buffer(buf);
-    return 1;
-  }
-
  storedata:
   /* Store data in the already-reserved sector */
-  if (image_write(buf->pvt.d64.part,
+  if (cached_write(buf->pvt.d64.part,
                   sector_offset(buf->pvt.d64.part,
                                 buf->pvt.d64.track,
                                 buf->pvt.d64.sector),
                   buf->data, 256, 1)) {
+    allocrun_close(buf);
     free_buffer(buf);
     return 1;
   }
@@ -1110,6 +1765,7 @@ static uint8_t d64_write(buffer_t *buf) {
 
   if (savederror) {
     set_error(savederror);
+    allocrun_close(buf);
     free_buffer(buf);
     return 1;
   } else
@@ -1118,6 +1774,7 @@ static uint8_t d64_write(buffer_t *buf) {
 
 static uint8_t d64_write_cleanup(buffer_t *buf) {
   uint8_t t,s;
+  uint8_t part = buf->pvt.d64.part;
 
   buf->data[0] = 0;
   buf->data[1] = buf->lastused;
@@ -1126,12 +1783,15 @@ static uint8_t d64_write_cleanup(buffer_t *buf) {
   s = buf->pvt.d64.sector;
   buf->pvt.d64.blocks++;
 
+  /* Return the sectors that were allocated in advance but not used */
+  allocrun_close(buf);
+
   /* Track=0 means that there was an error somewhere earlier */
   if (t == 0)
     return 1;
 
   /* Store data */
-  if (image_write(buf->pvt.d64.part, sector_offset(buf->pvt.d64.part,t,s), buf->data, 256, 1))
+  if (cached_write(buf->pvt.d64.part, sector_offset(buf->pvt.d64.part,t,s), buf->data, 256, 1))
     return 1;
 
   /* Update directory entry */
@@ -1149,7 +1809,11 @@ static uint8_t d64_write_cleanup(buffer_t *buf) {
   buf->cleanup = callback_dummy;
   free_buffer(buf);
 
-  return 0;
+  /* Write the BAM and sync the image once for the whole file */
+  if (d64_commit())
+    return 1;
+
+  return image_sync(part);
 }
 
 
@@ -1325,7 +1989,23 @@ uint8_t d64_mount(path_t *path, uint8_t *name) {
       return 1;
   }
 
+  /* The caches may still hold data of a previous image */
+  imagecache_invalidate(part);
+  dirindex_invalidate();
+
+  /* Contiguous images are accessed without going through the FAT chain */
+  partition[part].imagestart = l_contiguous(&partition[part].imagehandle);
+
+#ifdef CONFIG_IMAGE_LINKMAP
+  /* Map the clusters of fragmented images for fast sector access. If  */
+  /* this fails, the image can still be accessed through the FAT chain */
+  if (!partition[part].imagestart)
+    l_createlinkmap(&partition[part].imagehandle, partition[part].imagemap,
+                    LINKMAP_SIZE(CONFIG_IMAGE_LINKMAP));
+#endif
+
   partition[part].imagetype = imagetype;
+  build_tracktable(part);
   path->dir.dxx.track  = get_param(part, DIR_TRACK);
   path->dir.dxx.sector = get_param(part, DIR_START_SECTOR);
 
@@ -1426,198 +2106,900 @@ static uint8_t read_string_from_dirheader(path_t *path, uint8_t *buffer, param_t
                  buffer, size))
     return 1;
 
-  strnsubst(buffer, size, 0xa0, 0x20);
+  strnsubst(buffer, size, 0xa0, 0x20);
+  return 0;
+}
+
+static uint8_t d64_getdirlabel(path_t *path, uint8_t *label) {
+  return read_string_from_dirheader(path, label, LABEL_OFFSET, 16);
+}
+
+static uint8_t d64_getdisklabel(uint8_t part, uint8_t *label) {
+  if (partition[part].imagetype == D64_TYPE_DNP) {
+    /* Read directly from root dir header */
+    if (image_read(part, 256 + DNP_LABEL_OFFSET, label, 16))
+      return 1;
+  } else {
+    /* Use getdirlabel instead */
+    path_t curpath;
+
+    curpath.part = part;
+    curpath.dir = partition[part].current_dir;
+    if (d64_getdirlabel(&curpath, label))
+      return 1;
+  }
+
+  /* Zero-terminate label */
+  uint8_t *ptr = label+16;
+  *ptr-- = 0;
+  while (ptr != label && *ptr == ' ')
+    *ptr-- = 0;
+
+  return 0;
+}
+
+static uint8_t d64_getid(path_t *path, uint8_t *id) {
+  return read_string_from_dirheader(path, id, ID_OFFSET, 5);
+}
+
+static uint16_t d64_freeblocks(uint8_t part) {
+  uint16_t blocks = 0;
+  uint8_t i;
+
+  for (i = 1; i != 0 && i <= get_param(part, LAST_BAM_TRACK); i++) {
+    /* Skip directory track */
+    switch (partition[part].imagetype & D64_TYPE_MASK) {
+    case D64_TYPE_D81:
+      if (i == D81_BAM_TRACK)
+        continue;
+      break;
+
+    case D64_TYPE_DNP:
+      /* DNP reserves a partial track, handled below */
+      break;
+
+    case D64_TYPE_D41:
+    case D64_TYPE_D71:
+    default:
+      if (i == D41_BAM_TRACK || i == D71_BAM2_TRACK)
+        continue; // continue the for loop
+      break;      // break out of the switch
+
+    }
+
+    if ((partition[part].imagetype & D64_TYPE_MASK)
+        == D64_TYPE_DNP && i == 1) {
+      /* DNP: ignore sectors 0-63 on track 1 */
+      for (uint16_t j = 64; j < 256; j++) {
+        if (is_free(part, 1, j) > 0)
+          blocks++;
+      }
+
+    } else {
+      blocks += sectors_free(part,i);
+    }
+  }
+
+  return blocks;
+}
+
+static void d64_open_read(path_t *path, cbmdirent_t *dent, buffer_t *buf, uint8_t modify) {
+  (void)modify;
+
+  /* Read the directory entry of the file */
+  if (read_entry(path->part, &dent->pvt.dxx.dh, ops_scratch))
+    return;
+
+  buf->data[0] = ops_scratch[DIR_OFS_TRACK];
+  buf->data[1] = ops_scratch[DIR_OFS_SECTOR];
+
+  buf->pvt.d64.part = path->part;
+
+  buf->read     = 1;
+  buf->prefetch = 1;
+  buf->refill   = d64_read;
+  buf->seek     = d64_seek;
+  stick_buffer(buf);
+
+  buf->refill(buf);
+}
+
+static void d64_open_write(path_t *path, cbmdirent_t *dent, uint8_t type, buffer_t *buf, uint8_t append) {
+  dh_t dh;
+  uint8_t *ptr;
+
+  /* Check for read-only image file */
+  if (!(partition[path->part].imagehandle.flag & FA_WRITE)) {
+    set_error(ERROR_WRITE_PROTECT);
+    return;
+  }
+
+  if (append) {
+    /* Append case: Open the file and read the last sector */
+    d64_open_read(path, dent, buf, 0);
+    while (!current_error && buf->data[0])
+      buf->refill(buf);
+
+    if (current_error)
+      return;
+
+    /* Modify the buffer for writing */
+    buf->pvt.d64.dh     = dent->pvt.dxx.dh;
+    buf->pvt.d64.blocks = ops_scratch[DIR_OFS_SIZE_LOW] + 256 * ops_scratch[DIR_OFS_SIZE_HI]-1;
+    buf->read       = 0;
+    buf->prefetch   = 0;
+    buf->position   = buf->lastused+1;
+    if (buf->position == 0)
+      buf->mustflush = 1;
+    else
+      buf->mustflush = 0;
+    buf->refill     = d64_write;
+    buf->cleanup    = d64_write_cleanup;
+    buf->seek       = d64_seek;
+    mark_write_buffer(buf);
+
+    update_timestamp(ops_scratch);
+    write_entry(buf->pvt.d64.part, &buf->pvt.d64.dh, ops_scratch, 1);
+
+    allocrun_fill(buf);
+    return;
+  }
+
+  /* Non-append case */
+
+  /* Search for an empty directory entry */
+  if (find_empty_entry(path, &dh))
+    return;
+
+  /* update dh in dent to make load "*" work */
+  dent->pvt.dxx.dh = dh.dir.d64;
+
+  /* Create directory entry in ops_scratch */
+  uint8_t *name = dent->name;
+  memset(ops_scratch + 2, 0, sizeof(ops_scratch) - 2);  /* Don't overwrite the link pointer! */
+  memset(ops_scratch + DIR_OFS_FILE_NAME, 0xa0, CBM_NAME_LENGTH);
+  ptr = ops_scratch + DIR_OFS_FILE_NAME;
+  while (*name) *ptr++ = *name++;
+  ops_scratch[DIR_OFS_FILE_TYPE] = type;
+
+  /* Find a free sector and allocate it */
+  uint8_t t,s;
+
+  if (get_first_sector(path->part,&t,&s))
+    return;
+
+  ops_scratch[DIR_OFS_TRACK]  = t;
+  ops_scratch[DIR_OFS_SECTOR] = s;
+
+  if (allocate_sector(path->part,t,s))
+    return;
+
+  /* Write the directory entry */
+  update_timestamp(ops_scratch);
+  if (write_entry(path->part, &dh.dir.d64, ops_scratch, 1))
+    return;
+
+  /* Prepare the data buffer */
+  mark_write_buffer(buf);
+  buf->position       = 2;
+  buf->lastused       = 2;
+  buf->cleanup        = d64_write_cleanup;
+  buf->refill         = d64_write;
+  buf->seek           = d64_seek;
+  buf->data[2]        = 13; /* Verified on VICE */
+  buf->pvt.d64.dh     = dh.dir.d64;
+  buf->pvt.d64.part   = path->part;
+  buf->pvt.d64.track  = t;
+  buf->pvt.d64.sector = s;
+
+  /* Allocate the following sectors of the file in advance */
+  allocrun_fill(buf);
+}
+
+/* ------------------------------------------------------------------------- */
+/*  REL files                                                                */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * rel_has_super - check if REL files use a super side sector
+ * @part: partition number
+ *
+ * Returns true if REL files on the image in @part use a super side
+ * sector, which is the case for D81 and DNP images.
+ */
+static uint8_t rel_has_super(uint8_t part) {
+  uint8_t type = partition[part].imagetype & D64_TYPE_MASK;
+
+  return type == D64_TYPE_D81 || type == D64_TYPE_DNP;
+}
+
+/**
+ * rel_sector_io - read or write a part of a REL file sector
+ * @part  : partition number
+ * @t     : track
+ * @s     : sector
+ * @ofs   : offset in the sector
+ * @data  : pointer to the data
+ * @len   : number of bytes to transfer
+ * @write : write if true, read otherwise
+ *
+ * This function checks the track and sector and transfers @len bytes
+ * at offset @ofs of this sector. Returns 0 if successful, non-zero
+ * otherwise.
+ */
+static uint8_t rel_sector_io(uint8_t part, uint8_t t, uint8_t s, uint8_t ofs,
+                             uint8_t *data, uint8_t len, uint8_t write) {
+  if (t < 1 || t > get_param(part, LAST_TRACK) ||
+      s >= d64_sectors_per_track(part, t)) {
+    set_error_ts(ERROR_ILLEGAL_TS_LINK, t, s);
+    return 1;
+  }
+
+  if (write)
+    return cached_write(part, sector_offset(part, t, s) + ofs, data, len, 0);
+  else
+    return image_read(part, sector_offset(part, t, s) + ofs, data, len);
+}
+
+/**
+ * rel_load_group - load the side sector list of a side sector group
+ * @buf  : buffer of the REL file
+ * @group: group number
+ *
+ * This function reads the track/sector list of the given side sector
+ * group into the file handle, using the super side sector to find
+ * it. Returns 0 if successful, 1 otherwise.
+ */
+static uint8_t rel_load_group(buffer_t *buf, uint8_t group) {
+  uint8_t part = buf->pvt.d64.part;
+  uint8_t ts[2];
+
+  if (group == buf->pvt.d64.rel.group)
+    return 0;
+
+  if (buf->pvt.d64.rel.super[0] == 0 || group >= REL_SUPER_GROUPS) {
+    set_error(ERROR_RECORD_MISSING);
+    return 1;
+  }
+
+  if (rel_sector_io(part, buf->pvt.d64.rel.super[0], buf->pvt.d64.rel.super[1],
+                    REL_SUPER_OFS_GROUPS + 2 * group, ts, 2, 0) ||
+      rel_sector_io(part, ts[0], ts[1], REL_SIDE_OFS_GROUP,
+                    buf->pvt.d64.rel.side, sizeof(buf->pvt.d64.rel.side), 0))
+    return 1;
+
+  buf->pvt.d64.rel.group = group;
+  return 0;
+}
+
+/**
+ * rel_block - find a data block of a REL file
+ * @buf  : buffer of the REL file
+ * @block: number of the data block
+ * @t    : pointer to a variable for the track
+ * @s    : pointer to a variable for the sector
+ *
+ * This function looks up the track and sector of a data block in the
+ * side sector that covers it. Returns 0 if successful, 1 otherwise.
+ */
+static uint8_t rel_block(buffer_t *buf, uint16_t block, uint8_t *t, uint8_t *s) {
+  uint16_t side = block / REL_SIDE_BLOCKS;
+  uint8_t  idx  = side % REL_SIDE_GROUP;
+  uint8_t  ts[2];
+
+  if (rel_load_group(buf, side / REL_SIDE_GROUP))
+    return 1;
+
+  if (rel_sector_io(buf->pvt.d64.part,
+                    buf->pvt.d64.rel.side[2 * idx], buf->pvt.d64.rel.side[2 * idx + 1],
+                    REL_SIDE_OFS_BLOCKS + 2 * (block % REL_SIDE_BLOCKS), ts, 2, 0))
+    return 1;
+
+  *t = ts[0];
+  *s = ts[1];
+  return 0;
+}
+
+/**
+ * rel_transfer - read or write data of a REL file
+ * @buf  : buffer of the REL file
+ * @pos  : position in the file
+ * @data : pointer to the data
+ * @len  : number of bytes to transfer
+ * @write: write if true, read otherwise
+ *
+ * Returns 0 if successful, 1 otherwise.
+ */
+static uint8_t rel_transfer(buffer_t *buf, uint32_t pos, uint8_t *data,
+                            uint8_t len, uint8_t write) {
+  uint8_t t, s, ofs, bytes;
+
+  while (len) {
+    ofs   = pos % 254;
+    bytes = 254 - ofs;
+    if (bytes > len)
+      bytes = len;
+
+    if (rel_block(buf, pos / 254, &t, &s) ||
+        rel_sector_io(buf->pvt.d64.part, t, s, 2 + ofs, data, bytes, write))
+      return 1;
+
+    pos  += bytes;
+    data += bytes;
+    len  -= bytes;
+  }
+
+  return 0;
+}
+
+/* Returns the number of data bytes of a REL file */
+static uint32_t rel_size(buffer_t *buf) {
+  return (buf->pvt.d64.blocks - 1) * 254L + buf->pvt.d64.rel.lastbytes;
+}
+
+/* Fills data with empty records, pos is the position in the file */
+static void rel_fill(uint8_t *data, uint32_t pos, uint8_t len, uint8_t recordlen) {
+  uint8_t r = pos % recordlen;
+
+  while (len--) {
+    *data++ = (r == 0 ? 0xff : 0);
+    if (++r == recordlen)
+      r = 0;
+  }
+}
+
+/**
+ * rel_add_block - add a data block to the side sectors
+ * @buf: buffer of the REL file
+ * @tmp: buffer that can be used as scratch space
+ * @t  : track of the new data block
+ * @s  : sector of the new data block
+ *
+ * This function adds a new data block behind the current last block
+ * to the side sectors of the file, allocating a new side sector (and
+ * a new side sector group) if required. Returns 0 if successful,
+ * 1 otherwise.
+ */
+static uint8_t rel_add_block(buffer_t *buf, buffer_t *tmp, uint8_t t, uint8_t s) {
+  uint8_t  part  = buf->pvt.d64.part;
+  uint8_t *side  = buf->pvt.d64.rel.side;
+  uint16_t count = (buf->pvt.d64.blocks + REL_SIDE_BLOCKS - 1) / REL_SIDE_BLOCKS;
+  uint8_t  entry = buf->pvt.d64.blocks % REL_SIDE_BLOCKS;
+  uint8_t  idx, prev, i, nt, ns;
+  uint8_t  ts[2];
+
+  /* Load the group of the last side sector */
+  if (rel_load_group(buf, (count - 1) / REL_SIDE_GROUP))
+    return 1;
+
+  prev = (count - 1) % REL_SIDE_GROUP;
+
+  if (entry != 0) {
+    /* There is room in the last side sector */
+    ts[0] = t;
+    ts[1] = s;
+    if (rel_sector_io(part, side[2 * prev], side[2 * prev + 1],
+                      REL_SIDE_OFS_BLOCKS + 2 * entry, ts, 2, 1))
+      return 1;
+
+    ts[0] = 0;
+    ts[1] = REL_SIDE_OFS_BLOCKS + 2 * entry + 1;
+    return rel_sector_io(part, side[2 * prev], side[2 * prev + 1], 0, ts, 2, 1);
+  }
+
+  /* A new side sector is required */
+  if ((buf->pvt.d64.rel.super[0] == 0 && count >= REL_SIDE_GROUP) ||
+      count / REL_SIDE_GROUP >= REL_SUPER_GROUPS) {
+    set_error(ERROR_FILE_TOO_LARGE);
+    return 1;
+  }
+
+  nt = t;
+  ns = s;
+  if (get_next_sector(part, &nt, &ns) || allocate_sector(part, nt, ns))
+    return 1;
+
+  /* Link the previous side sector to the new one */
+  ts[0] = nt;
+  ts[1] = ns;
+  if (rel_sector_io(part, side[2 * prev], side[2 * prev + 1], 0, ts, 2, 1))
+    return 1;
+
+  idx = count % REL_SIDE_GROUP;
+  if (idx == 0) {
+    /* Start a new group in the super side sector */
+    if (rel_sector_io(part, buf->pvt.d64.rel.super[0], buf->pvt.d64.rel.super[1],
+                      REL_SUPER_OFS_GROUPS + 2 * (count / REL_SIDE_GROUP), ts, 2, 1))
+      return 1;
+
+    memset(side, 0, sizeof(buf->pvt.d64.rel.side));
+    buf->pvt.d64.rel.group = count / REL_SIDE_GROUP;
+  }
+
+  side[2 * idx]     = nt;
+  side[2 * idx + 1] = ns;
+
+  /* Create the new side sector */
+  memset(tmp->data, 0, 256);
+  tmp->data[1] = REL_SIDE_OFS_BLOCKS + 1;
+  tmp->data[REL_SIDE_OFS_NUMBER]    = idx;
+  tmp->data[REL_SIDE_OFS_RECORDLEN] = buf->recordlen;
+  memcpy(tmp->data + REL_SIDE_OFS_GROUP, side, sizeof(buf->pvt.d64.rel.side));
+  tmp->data[REL_SIDE_OFS_BLOCKS]     = t;
+  tmp->data[REL_SIDE_OFS_BLOCKS + 1] = s;
+
+  if (cached_write(part, sector_offset(part, nt, ns), tmp->data, 256, 0))
+    return 1;
+
+  /* Update the side sector list of the other side sectors in the group */
+  for (i = 0; i < idx; i++)
+    if (rel_sector_io(part, side[2 * i], side[2 * i + 1], REL_SIDE_OFS_GROUP,
+                      side, sizeof(buf->pvt.d64.rel.side), 1))
+      return 1;
+
+  return 0;
+}
+
+/**
+ * rel_expand - add empty records to a REL file
+ * @buf: buffer of the REL file
+ * @end: minimum size of the file
+ *
+ * This function adds empty records to the file until it is at least
+ * @end bytes long. Like a 1541 it fills the last data block with
+ * records. Returns 0 if successful, 1 otherwise.
+ */
+static uint8_t rel_expand(buffer_t *buf, uint32_t end) {
+  uint8_t   part = buf->pvt.d64.part;
+  uint8_t   t, s, res = 1;
+  uint16_t  fill;
+  uint32_t  blockstart, newsize;
+  buffer_t *tmp;
+
+  newsize = (end + 253) / 254 * 254;
+  newsize -= newsize % buf->recordlen;
+
+  tmp = alloc_system_buffer();
+  if (!tmp)
+    return 1;
+
+  if (checked_read(part, buf->pvt.d64.track, buf->pvt.d64.sector,
+                   tmp->data, 256, ERROR_ILLEGAL_TS_LINK))
+    goto out;
+
+  blockstart = (buf->pvt.d64.blocks - 1) * 254L;
+
+  while (1) {
+    fill = newsize - blockstart > 254 ? 254 : newsize - blockstart;
+    rel_fill(tmp->data + 2 + buf->pvt.d64.rel.lastbytes,
+             blockstart + buf->pvt.d64.rel.lastbytes,
+             fill - buf->pvt.d64.rel.lastbytes, buf->recordlen);
+    buf->pvt.d64.rel.lastbytes = fill;
+
+    t = buf->pvt.d64.track;
+    s = buf->pvt.d64.sector;
+
+    /* Mark as last block in case something below fails */
+    tmp->data[0] = 0;
+    tmp->data[1] = fill + 1;
+
+    if (blockstart + 254 >= newsize ||
+        get_next_sector(part, &t, &s) || allocate_sector(part, t, s)) {
+      if (cached_write(part, sector_offset(part, buf->pvt.d64.track, buf->pvt.d64.sector),
+                       tmp->data, 256, 0) == 0 &&
+          blockstart + 254 >= newsize)
+        res = 0;
+      break;
+    }
+
+    tmp->data[0] = t;
+    tmp->data[1] = s;
+    if (cached_write(part, sector_offset(part, buf->pvt.d64.track, buf->pvt.d64.sector),
+                     tmp->data, 256, 0))
+      break;
+
+    if (rel_add_block(buf, tmp, t, s))
+      break;
+
+    buf->pvt.d64.blocks++;
+    buf->pvt.d64.track  = t;
+    buf->pvt.d64.sector = s;
+    buf->pvt.d64.rel.lastbytes = 0;
+    blockstart += 254;
+    memset(tmp->data, 0, 256);
+  }
+
+ out:
+  free_buffer(tmp);
+  return res;
+}
+
+/**
+ * rel_read_record - read the current record of a REL file
+ * @buf: buffer of the REL file
+ *
+ * This function reads the record at buf->fptr into the buffer.
+ * Reading the record just behind the end of the file returns an
+ * empty record, anything beyond sets ERROR_RECORD_MISSING.
+ * Returns 0 if successful, 1 otherwise.
+ */
+static uint8_t rel_read_record(buffer_t *buf) {
+  uint32_t size = rel_size(buf);
+
+  buf->position = 2;
+  buf->sendeoi  = 1;
+
+  if (buf->fptr >= size) {
+    buf->data[2]  = 255;
+    buf->lastused = 2;
+    if (buf->fptr > size)
+      set_error(ERROR_RECORD_MISSING);
+    return 0;
+  }
+
+  if (rel_transfer(buf, buf->fptr, buf->data + 2, buf->recordlen, 0))
+    return 1;
+
+  /* strip nulls from the end of the record */
+  buf->lastused = buf->recordlen + 1;
+  while (!buf->data[buf->lastused] && --(buf->lastused) > 1) ;
+
+  return 0;
+}
+
+/**
+ * rel_write_record - write the current record of a REL file
+ * @buf: buffer of the REL file
+ *
+ * This function writes the buffer contents to the record at buf->fptr,
+ * adding empty records to the file first if it doesn't exist yet.
+ * Returns 0 if successful, 1 otherwise.
+ */
+static uint8_t rel_write_record(buffer_t *buf) {
+  if (!buf->mustflush)
+    buf->lastused = buf->position - 1;
+
+  if (buf->recordlen > buf->lastused - 1)
+    memset(buf->data + buf->lastused + 1, 0, buf->recordlen - (buf->lastused - 1));
+
+  if (buf->fptr + buf->recordlen > rel_size(buf))
+    if (rel_expand(buf, buf->fptr + buf->recordlen))
+      return 1;
+
+  if (rel_transfer(buf, buf->fptr, buf->data + 2, buf->recordlen, 1))
+    return 1;
+
+  mark_buffer_clean(buf);
+  buf->mustflush = 0;
+  buf->position  = 2;
+  buf->lastused  = 2;
+
+  return 0;
+}
+
+/**
+ * d64_rel_seek - seek-callback for REL files
+ * @buf     : target buffer
+ * @position: offset to seek to
+ * @index   : offset within the record to seek to
+ *
+ * This function writes the current record if it was modified and
+ * reads the record at the given position. Returns 1 if an error
+ * occured, 0 otherwise.
+ */
+static uint8_t d64_rel_seek(buffer_t *buf, uint32_t position, uint8_t index) {
+  if (buf->dirty)
+    if (rel_write_record(buf)) {
+      free_buffer(buf);
+      return 1;
+    }
+
+  buf->fptr = position;
+  if (rel_read_record(buf)) {
+    free_buffer(buf);
+    return 1;
+  }
+
+  buf->position = index + 2;
+  if (index + 2 > buf->lastused)
+    buf->position = buf->lastused;
+
   return 0;
 }
 
-static uint8_t d64_getdirlabel(path_t *path, uint8_t *label) {
-  return read_string_from_dirheader(path, label, LABEL_OFFSET, 16);
+/**
+ * d64_rel_sync - refill-callback for REL files
+ * @buf: target buffer
+ *
+ * This function advances to the next record.
+ */
+static uint8_t d64_rel_sync(buffer_t *buf) {
+  return d64_rel_seek(buf, buf->fptr + buf->recordlen, 0);
 }
 
-static uint8_t d64_getdisklabel(uint8_t part, uint8_t *label) {
-  if (partition[part].imagetype == D64_TYPE_DNP) {
-    /* Read directly from root dir header */
-    if (image_read(part, 256 + DNP_LABEL_OFFSET, label, 16))
-      return 1;
-  } else {
-    /* Use getdirlabel instead */
-    path_t curpath;
+/**
+ * d64_rel_cleanup - cleanup-callback for REL files
+ * @buf: target buffer
+ *
+ * This function writes the current record if it was modified and
+ * updates the block count in the directory entry.
+ */
+static uint8_t d64_rel_cleanup(buffer_t *buf) {
+  uint8_t  part = buf->pvt.d64.part;
+  uint16_t size;
 
-    curpath.part = part;
-    curpath.dir = partition[part].current_dir;
-    if (d64_getdirlabel(&curpath, label))
+  if (buf->dirty && rel_write_record(buf))
+    return 1;
+
+  buf->cleanup = callback_dummy;
+
+  size = buf->pvt.d64.blocks +
+    (buf->pvt.d64.blocks + REL_SIDE_BLOCKS - 1) / REL_SIDE_BLOCKS +
+    (buf->pvt.d64.rel.super[0] != 0);
+
+  if (read_entry(part, &buf->pvt.d64.dh, ops_scratch))
+    return 1;
+
+  if (size != ops_scratch[DIR_OFS_SIZE_LOW] + 256 * ops_scratch[DIR_OFS_SIZE_HI]) {
+    ops_scratch[DIR_OFS_SIZE_LOW] = size & 0xff;
+    ops_scratch[DIR_OFS_SIZE_HI]  = size >> 8;
+    update_timestamp(ops_scratch);
+
+    if (write_entry(part, &buf->pvt.d64.dh, ops_scratch, 1))
       return 1;
   }
 
-  /* Zero-terminate label */
-  uint8_t *ptr = label+16;
-  *ptr-- = 0;
-  while (ptr != label && *ptr == ' ')
-    *ptr-- = 0;
+  if (d64_commit())
+    return 1;
 
-  return 0;
+  return image_sync(part);
 }
 
-static uint8_t d64_getid(path_t *path, uint8_t *id) {
-  return read_string_from_dirheader(path, id, ID_OFFSET, 5);
-}
+/**
+ * rel_create - create a new REL file
+ * @path  : path of the file
+ * @dent  : name of the file
+ * @buf   : buffer to be used
+ * @length: record length
+ *
+ * This function creates a REL file with a single data block of empty
+ * records and its side sector (and super side sector). Returns 0 if
+ * successful, 1 otherwise.
+ */
+static uint8_t rel_create(path_t *path, cbmdirent_t *dent, buffer_t *buf, uint8_t length) {
+  uint8_t part = path->part;
+  uint8_t dt, ds, st, ss, *ptr;
+  uint8_t *name = dent->name;
+  dh_t dh;
 
-static uint16_t d64_freeblocks(uint8_t part) {
-  uint16_t blocks = 0;
-  uint8_t i;
+  if (!(partition[part].imagehandle.flag & FA_WRITE)) {
+    set_error(ERROR_WRITE_PROTECT);
+    return 1;
+  }
 
-  for (i = 1; i != 0 && i <= get_param(part, LAST_BAM_TRACK); i++) {
-    /* Skip directory track */
-    switch (partition[part].imagetype & D64_TYPE_MASK) {
-    case D64_TYPE_D81:
-      if (i == D81_BAM_TRACK)
-        continue;
-      break;
+  /* Search for an empty directory entry */
+  if (find_empty_entry(path, &dh))
+    return 1;
 
-    case D64_TYPE_DNP:
-      /* DNP reserves a partial track, handled below */
-      break;
+  dent->pvt.dxx.dh = dh.dir.d64;
 
-    case D64_TYPE_D41:
-    case D64_TYPE_D71:
-    default:
-      if (i == D41_BAM_TRACK || i == D71_BAM2_TRACK)
-        continue; // continue the for loop
-      break;      // break out of the switch
+  /* Allocate the first data block, the side sector and the super side sector */
+  if (get_first_sector(part, &dt, &ds) || allocate_sector(part, dt, ds))
+    return 1;
 
-    }
+  st = dt;
+  ss = ds;
+  if (get_next_sector(part, &st, &ss) || allocate_sector(part, st, ss))
+    return 1;
 
-    if ((partition[part].imagetype & D64_TYPE_MASK)
-        == D64_TYPE_DNP && i == 1) {
-      /* DNP: ignore sectors 0-63 on track 1 */
-      for (uint16_t j = 64; j < 256; j++) {
-        if (is_free(part, 1, j) > 0)
-          blocks++;
-      }
+  buf->pvt.d64.rel.super[0] = 0;
+  buf->pvt.d64.rel.super[1] = 0;
+  if (rel_has_super(part)) {
+    uint8_t t = st, s = ss;
 
-    } else {
-      blocks += sectors_free(part,i);
-    }
-  }
+    if (get_next_sector(part, &t, &s) || allocate_sector(part, t, s))
+      return 1;
 
-  return blocks;
-}
+    buf->pvt.d64.rel.super[0] = t;
+    buf->pvt.d64.rel.super[1] = s;
 
-static void d64_open_read(path_t *path, cbmdirent_t *dent, buffer_t *buf, uint8_t modify) {
-  (void)modify;
+    memset(buf->data, 0, 256);
+    buf->data[0] = st;
+    buf->data[1] = ss;
+    buf->data[REL_SUPER_OFS_MARKER]   = REL_SUPER_MARKER;
+    buf->data[REL_SUPER_OFS_GROUPS]   = st;
+    buf->data[REL_SUPER_OFS_GROUPS+1] = ss;
+    if (cached_write(part, sector_offset(part, t, s), buf->data, 256, 0))
+      return 1;
+  }
 
-  /* Read the directory entry of the file */
-  if (read_entry(path->part, &dent->pvt.dxx.dh, ops_scratch))
-    return;
+  /* Write the side sector */
+  memset(buf->data, 0, 256);
+  buf->data[1] = REL_SIDE_OFS_BLOCKS + 1;
+  buf->data[REL_SIDE_OFS_RECORDLEN]  = length;
+  buf->data[REL_SIDE_OFS_GROUP]      = st;
+  buf->data[REL_SIDE_OFS_GROUP + 1]  = ss;
+  buf->data[REL_SIDE_OFS_BLOCKS]     = dt;
+  buf->data[REL_SIDE_OFS_BLOCKS + 1] = ds;
+  if (cached_write(part, sector_offset(part, st, ss), buf->data, 256, 0))
+    return 1;
 
-  buf->data[0] = ops_scratch[DIR_OFS_TRACK];
-  buf->data[1] = ops_scratch[DIR_OFS_SECTOR];
+  /* Write the data block */
+  buf->pvt.d64.rel.lastbytes = 254 - 254 % length;
+  memset(buf->data, 0, 256);
+  buf->data[1] = buf->pvt.d64.rel.lastbytes + 1;
+  rel_fill(buf->data + 2, 0, buf->pvt.d64.rel.lastbytes, length);
+  if (cached_write(part, sector_offset(part, dt, ds), buf->data, 256, 0))
+    return 1;
 
-  buf->pvt.d64.part = path->part;
+  /* Create the directory entry */
+  memset(ops_scratch + 2, 0, sizeof(ops_scratch) - 2);  /* Don't overwrite the link pointer! */
+  memset(ops_scratch + DIR_OFS_FILE_NAME, 0xa0, CBM_NAME_LENGTH);
+  ptr = ops_scratch + DIR_OFS_FILE_NAME;
+  while (*name) *ptr++ = *name++;
+  ops_scratch[DIR_OFS_FILE_TYPE]   = TYPE_REL | FLAG_SPLAT;
+  ops_scratch[DIR_OFS_TRACK]       = dt;
+  ops_scratch[DIR_OFS_SECTOR]      = ds;
+  if (buf->pvt.d64.rel.super[0]) {
+    ops_scratch[DIR_OFS_SIDE_TRACK]  = buf->pvt.d64.rel.super[0];
+    ops_scratch[DIR_OFS_SIDE_SECTOR] = buf->pvt.d64.rel.super[1];
+    ops_scratch[DIR_OFS_SIZE_LOW]    = 3;
+  } else {
+    ops_scratch[DIR_OFS_SIDE_TRACK]  = st;
+    ops_scratch[DIR_OFS_SIDE_SECTOR] = ss;
+    ops_scratch[DIR_OFS_SIZE_LOW]    = 2;
+  }
+  ops_scratch[DIR_OFS_RECORD_LEN]  = length;
+  update_timestamp(ops_scratch);
 
-  buf->read    = 1;
-  buf->refill  = d64_read;
-  buf->seek    = d64_seek;
-  stick_buffer(buf);
+  if (write_entry(part, &dh.dir.d64, ops_scratch, 1))
+    return 1;
 
-  buf->refill(buf);
+  buf->pvt.d64.dh     = dh.dir.d64;
+  buf->pvt.d64.track  = dt;
+  buf->pvt.d64.sector = ds;
+  buf->pvt.d64.blocks = 1;
+  buf->pvt.d64.rel.group = 0;
+  memset(buf->pvt.d64.rel.side, 0, sizeof(buf->pvt.d64.rel.side));
+  buf->pvt.d64.rel.side[0] = st;
+  buf->pvt.d64.rel.side[1] = ss;
+
+  return d64_commit();
 }
 
-static void d64_open_write(path_t *path, cbmdirent_t *dent, uint8_t type, buffer_t *buf, uint8_t append) {
-  dh_t dh;
-  uint8_t *ptr;
+/**
+ * rel_open - open an existing REL file
+ * @path: path of the file
+ * @dent: name of the file
+ * @buf : buffer to be used
+ *
+ * This function reads the side sector information of an existing REL
+ * file into the file handle. Returns the record length of the file if
+ * successful or 0 if not.
+ */
+static uint8_t rel_open(path_t *path, cbmdirent_t *dent, buffer_t *buf) {
+  uint8_t  part = path->part;
+  uint8_t  length, t, s;
+  uint8_t  ts[3];
+  uint16_t count;
 
-  /* Check for read-only image file */
-  if (!(partition[path->part].imagehandle.flag & FA_WRITE)) {
-    set_error(ERROR_WRITE_PROTECT);
-    return;
-  }
+  if (read_entry(part, &dent->pvt.dxx.dh, ops_scratch))
+    return 0;
 
-  if (append) {
-    /* Append case: Open the file and read the last sector */
-    d64_open_read(path, dent, buf, 0);
-    while (!current_error && buf->data[0])
-      buf->refill(buf);
+  length = ops_scratch[DIR_OFS_RECORD_LEN];
+  t = ops_scratch[DIR_OFS_SIDE_TRACK];
+  s = ops_scratch[DIR_OFS_SIDE_SECTOR];
 
-    if (current_error)
-      return;
+  if (length == 0) {
+    set_error(ERROR_SYNTAX_UNABLE);
+    return 0;
+  }
 
-    /* Modify the buffer for writing */
-    buf->pvt.d64.dh     = dent->pvt.dxx.dh;
-    buf->pvt.d64.blocks = ops_scratch[DIR_OFS_SIZE_LOW] + 256 * ops_scratch[DIR_OFS_SIZE_HI]-1;
-    buf->read       = 0;
-    buf->position   = buf->lastused+1;
-    if (buf->position == 0)
-      buf->mustflush = 1;
-    else
-      buf->mustflush = 0;
-    buf->refill     = d64_write;
-    buf->cleanup    = d64_write_cleanup;
-    buf->seek       = d64_seek;
-    mark_write_buffer(buf);
+  buf->pvt.d64.dh     = dent->pvt.dxx.dh;
+  buf->pvt.d64.rel.group    = 0;
+  buf->pvt.d64.rel.super[0] = 0;
+  buf->pvt.d64.rel.super[1] = 0;
 
-    update_timestamp(ops_scratch);
-    write_entry(buf->pvt.d64.part, &buf->pvt.d64.dh, ops_scratch, 1);
+  if (rel_has_super(part)) {
+    if (rel_sector_io(part, t, s, 0, ts, 3, 0))
+      return 0;
 
-    return;
+    if (ts[REL_SUPER_OFS_MARKER] == REL_SUPER_MARKER) {
+      buf->pvt.d64.rel.super[0] = t;
+      buf->pvt.d64.rel.super[1] = s;
+      t = ts[0];
+      s = ts[1];
+    }
   }
 
-  /* Non-append case */
-
-  /* Search for an empty directory entry */
-  if (find_empty_entry(path, &dh))
-    return;
+  /* Read the side sector list of the first group */
+  if (rel_sector_io(part, t, s, REL_SIDE_OFS_GROUP, buf->pvt.d64.rel.side,
+                    sizeof(buf->pvt.d64.rel.side), 0))
+    return 0;
 
-  /* update dh in dent to make load "*" work */
-  dent->pvt.dxx.dh = dh.dir.d64;
+  /* Follow the side sector chain to count the data blocks */
+  count = 0;
+  while (1) {
+    if (rel_sector_io(part, t, s, 0, ts, 2, 0))
+      return 0;
 
-  /* Create directory entry in ops_scratch */
-  uint8_t *name = dent->name;
-  memset(ops_scratch + 2, 0, sizeof(ops_scratch) - 2);  /* Don't overwrite the link pointer! */
-  memset(ops_scratch + DIR_OFS_FILE_NAME, 0xa0, CBM_NAME_LENGTH);
-  ptr = ops_scratch + DIR_OFS_FILE_NAME;
-  while (*name) *ptr++ = *name++;
-  ops_scratch[DIR_OFS_FILE_TYPE] = type;
+    if (ts[0] == 0)
+      break;
 
-  /* Find a free sector and allocate it */
-  uint8_t t,s;
+    if (++count >= REL_SUPER_GROUPS * REL_SIDE_GROUP) {
+      set_error_ts(ERROR_ILLEGAL_TS_LINK, t, s);
+      return 0;
+    }
 
-  if (get_first_sector(path->part,&t,&s))
-    return;
+    t = ts[0];
+    s = ts[1];
+  }
 
-  ops_scratch[DIR_OFS_TRACK]  = t;
-  ops_scratch[DIR_OFS_SECTOR] = s;
+  if (ts[1] <= REL_SIDE_OFS_BLOCKS) {
+    set_error_ts(ERROR_ILLEGAL_TS_LINK, t, s);
+    return 0;
+  }
 
-  if (allocate_sector(path->part,t,s))
-    return;
+  buf->pvt.d64.blocks = count * REL_SIDE_BLOCKS + (ts[1] - REL_SIDE_OFS_BLOCKS + 1) / 2;
 
-  /* Write the directory entry */
-  update_timestamp(ops_scratch);
-  if (write_entry(path->part, &dh.dir.d64, ops_scratch, 1))
-    return;
+  /* Find the used bytes in the last data block */
+  if (rel_block(buf, buf->pvt.d64.blocks - 1, &t, &s) ||
+      rel_sector_io(part, t, s, 0, ts, 2, 0))
+    return 0;
 
-  /* Prepare the data buffer */
-  mark_write_buffer(buf);
-  buf->position       = 2;
-  buf->lastused       = 2;
-  buf->cleanup        = d64_write_cleanup;
-  buf->refill         = d64_write;
-  buf->seek           = d64_seek;
-  buf->data[2]        = 13; /* Verified on VICE */
-  buf->pvt.d64.dh     = dh.dir.d64;
-  buf->pvt.d64.part   = path->part;
   buf->pvt.d64.track  = t;
   buf->pvt.d64.sector = s;
+  if (ts[0] != 0 || ts[1] < 2)
+    buf->pvt.d64.rel.lastbytes = 254;
+  else
+    buf->pvt.d64.rel.lastbytes = ts[1] - 1;
+
+  return length;
 }
 
+/**
+ * d64_open_rel - open a REL file
+ * @path  : path of the file
+ * @dent  : name of the file
+ * @buf   : buffer to be used
+ * @length: record length
+ * @mode  : select between new or existing file
+ *
+ * This function opens a REL file and prepares it for access.
+ * If the mode parameter is 0, create a new file. If it is != 0,
+ * open an existing file.
+ */
 static void d64_open_rel(path_t *path, cbmdirent_t *dent, buffer_t *buf, uint8_t length, uint8_t mode) {
-  (void)path;
-  (void)dent;
-  (void)buf;
-  (void)length;
-  (void)mode;
+  uint8_t reclen;
 
-  set_error(ERROR_SYNTAX_UNABLE);
+  buf->pvt.d64.part = path->part;
+
+  if (!mode) {
+    if (rel_create(path, dent, buf, length))
+      return;
+    reclen = length;
+  } else {
+    reclen = rel_open(path, dent, buf);
+    if (!reclen)
+      return;
+  }
+
+  buf->recordlen = reclen;
+  buf->fptr      = 0;
+  mark_write_buffer(buf);
+  buf->read      = 1;
+  buf->cleanup   = d64_rel_cleanup;
+  buf->refill    = d64_rel_sync;
+  buf->seek      = d64_rel_seek;
+
+  /* read the first record */
+  if (rel_read_record(buf)) {
+    free_buffer(buf);
+    return;
+  }
+
+  if (length && length != reclen)
+    set_error(ERROR_RECORD_MISSING);
 }
 
 static uint8_t d64_delete(path_t *path, cbmdirent_t *dent) {
@@ -1638,6 +3020,21 @@ static uint8_t d64_delete(path_t *path, cbmdirent_t *dent) {
       return 255;
   } while (linkbuf[0]);
 
+  /* Free the side sectors of a REL file */
+  if ((ops_scratch[DIR_OFS_FILE_TYPE] & TYPE_MASK) == TYPE_REL &&
+      ops_scratch[DIR_OFS_SIDE_TRACK] != 0) {
+    linkbuf[0] = ops_scratch[DIR_OFS_SIDE_TRACK];
+    linkbuf[1] = ops_scratch[DIR_OFS_SIDE_SECTOR];
+
+    /* The super side sector links to the first side sector */
+    do {
+      free_sector(path->part, linkbuf[0], linkbuf[1]);
+
+      if (checked_read(path->part, linkbuf[0], linkbuf[1], linkbuf, 2, ERROR_ILLEGAL_TS_LINK))
+        return 255;
+    } while (linkbuf[0]);
+  }
+
   /* Clear directory entry */
   ops_scratch[DIR_OFS_FILE_TYPE] = 0;
   if (write_entry(path->part, &dent->pvt.dxx.dh, ops_scratch, 1))
@@ -1654,8 +3051,11 @@ static void d64_write_sector(buffer_t *buf, uint8_t part, uint8_t track, uint8_t
   if (track < 1 || track > get_param(part, LAST_TRACK) ||
       sector >= d64_sectors_per_track(part, track)) {
     set_error_ts(ERROR_ILLEGAL_TS_COMMAND,track,sector);
-  } else
-    image_write(part, sector_offset(part,track,sector), buf->data, 256, 1);
+  } else {
+    /* The sector could be part of a directory */
+    dirindex_invalidate();
+    cached_write(part, sector_offset(part,track,sector), buf->data, 256, 1);
+  }
 }
 
 static void d64_rename(path_t *path, cbmdirent_t *dent, uint8_t *newname) {
@@ -1836,7 +3236,7 @@ static void d64_mkdir(path_t *path, uint8_t *dirname) {
   *ptr++ = 'H';
 
   /* Write directory header sector */
-  if (image_write(path->part,
+  if (cached_write(path->part,
                   sector_offset(path->part, h_track, h_sector),
                   buf->data, 256, 0))
     return;
@@ -1844,7 +3244,7 @@ static void d64_mkdir(path_t *path, uint8_t *dirname) {
   /* Create empty directory sector */
   memset(buf->data, 0, 256);
   buf->data[1] = 0xff;
-  if (image_write(path->part,
+  if (cached_write(path->part,
                   sector_offset(path->part, d_track, d_sector),
                   buf->data, 256, 0))
     return;
@@ -1863,7 +3263,8 @@ static void d64_mkdir(path_t *path, uint8_t *dirname) {
   ops_scratch[DIR_OFS_SIZE_LOW]  = 2;
   update_timestamp(ops_scratch);
 
-  image_write(path->part, sector_offset(path->part, dh.dir.d64.track, dh.dir.d64.sector)
+  dirindex_invalidate();
+  cached_write(path->part, sector_offset(path->part, dh.dir.d64.track, dh.dir.d64.sector)
                           + dh.dir.d64.entry * 32 + 2, ops_scratch + 2, 30, 1);
 }
 
@@ -1882,6 +3283,10 @@ uint8_t d64_commit(void) {
   if (bam_buffer2)
     res |= bam_buffer2->cleanup(bam_buffer2);
 
+#ifdef CONFIG_FULL_BAM
+  res |= fullbam_flush();
+#endif
+
   res |= errorcache_commit();
 
   return res;
@@ -1900,6 +3305,19 @@ void d64_invalidate(void) {
   bam_buffer2  = NULL;
   bam_refcount = 0;
 
+  imagecache_invalidate(255);
+
+#ifdef CONFIG_D64_ALLOC_RUN
+  allocrun.owner = NULL;
+  allocrun.count = 0;
+  allocrun.next  = 0;
+#endif
+
+#ifdef CONFIG_FULL_BAM
+  fullbam.part  = 255;
+  fullbam.dirty = 0;
+#endif
+
   errorcache.part = 255;
   errorcache.mustflush = 0;
 }
@@ -1912,6 +3330,12 @@ void d64_invalidate(void) {
  * refcounting for the BAM buffers.
  */
 void d64_unmount(uint8_t part) {
+#ifdef CONFIG_D64_ALLOC_RUN
+  /* return unused sectors to the BAM before it is written */
+  if (allocrun.owner != NULL && allocrun.part == part)
+    allocrun_release();
+#endif
+
   /* invalidate BAM buffers that point to the current partition */
   if (bam_buffer) {
     bam_buffer->cleanup(bam_buffer);
@@ -1925,6 +3349,16 @@ void d64_unmount(uint8_t part) {
       bam_buffer2->pvt.bam.part = 255;
   }
 
+#ifdef CONFIG_FULL_BAM
+  if (fullbam.part == part) {
+    fullbam_flush();
+    fullbam.part = 255;
+  }
+#endif
+
+  imagecache_invalidate(part);
+  dirindex_invalidate();
+
   /* decrease BAM buffer refcounter - it can never be zero while a Dxx is mounted*/
   if (--bam_refcount == 0) {
     free_buffer(bam_buffer);
@@ -2093,7 +3527,7 @@ static uint8_t d64_format_track(uint8_t part, buffer_t *buf, uint8_t track) {
   uint16_t sector;
 
   for (sector = 0; sector < d64_sectors_per_track(part, track); sector++) {
-    if (image_write(part, sector_offset(part, track, sector), buf->data, 256, 0))
+    if (cached_write(part, sector_offset(part, track, sector), buf->data, 256, 0))
       return 1;
     if (partition[part].imagetype & D64_HAS_ERRORINFO)
       d64_set_error(part, track, sector, 1); // no error
@@ -2104,7 +3538,7 @@ static uint8_t d64_format_track(uint8_t part, buffer_t *buf, uint8_t track) {
 
 /* create a 1581/DNP BAM signature */
 static void format_add_bam_signature(uint8_t doschar, uint8_t *idbuf) {
-  uint8_t *ptr = bam_buffer->data + 2;
+  uint8_t *ptr = bam_data() + 2;
 
   *ptr++ = doschar;
   *ptr++ = doschar ^ 0xff;
@@ -2133,8 +3567,8 @@ static void format_d41_image(uint8_t part, buffer_t *buf, uint8_t *name, uint8_t
   for (uint8_t s=0; s<2; s++)
     allocate_sector(part, D41_BAM_TRACK, s);
 
-  /* 18/0 is now available via bam_buffer */
-  uint8_t *ptr = bam_buffer->data;
+  /* 18/0 is now available via bam_data */
+  uint8_t *ptr = bam_data();
   *ptr++ = 18;
   *ptr++ = 1;
   *ptr++ = 0x41;
@@ -2142,10 +3576,10 @@ static void format_d41_image(uint8_t part, buffer_t *buf, uint8_t *name, uint8_t
   /* copy disk label and ID */
   idbuf[3] = '2';
   idbuf[4] = 'A';
-  format_copy_label(part, bam_buffer->data, name, idbuf);
+  format_copy_label(part, bam_data(), name, idbuf);
   /* two additional 0xa0 characters on 5.25" disks */
-  bam_buffer->data[0xa9] = 0xa0;
-  bam_buffer->data[0xaa] = 0xa0;
+  bam_data()[0xa9] = 0xa0;
+  bam_data()[0xaa] = 0xa0;
 
   clear_dir_sector(part, D41_BAM_TRACK, 1, buf->data);
 }
@@ -2154,8 +3588,8 @@ static void format_d71_image(uint8_t part, buffer_t *buf, uint8_t *name, uint8_t
   /* almost everything is the same as D41 */
   format_d41_image(part, buf, name, idbuf);
 
-  /* add double-sided marker in 18/0 (still in bam_buffer) */
-  bam_buffer->data[3] = 0x80;
+  /* add double-sided marker in 18/0 (still in bam_data) */
+  bam_data()[3] = 0x80;
 
   /* allocate all of track 53 */
   for (uint8_t s=0; s<19; s++)
@@ -2163,25 +3597,30 @@ static void format_d71_image(uint8_t part, buffer_t *buf, uint8_t *name, uint8_t
 }
 
 static void format_d81_image(uint8_t part, buffer_t *buf, uint8_t *name, uint8_t *idbuf) {
+  uint8_t *ptr;
+
   /* allocate 40/0 to 40/3 */
   for (uint8_t s=0; s<4; s++)
     allocate_sector(part, D81_BAM_TRACK, s);
 
-  /* bam_buffer buffer now holds 40/1 */
-  bam_buffer->data[0] = 40;
-  bam_buffer->data[1] = 2;
+  /* bam_data now holds 40/1 */
+  ptr = bam_data();
+  ptr[0] = 40;
+  ptr[1] = 2;
   format_add_bam_signature('D', idbuf);
-  // mustflush was already set by allocate_sector
+  // already marked as dirty by allocate_sector
 
-  /* switch bam_buffer to 40/2 */
-  (void)sectors_free(part, 41);
-  bam_buffer->data[0] = 0;
-  bam_buffer->data[1] = 0xff;
+  /* switch bam_data to 40/2 */
+  if (move_bam_window(part, 41, BAM_FREECOUNT, &ptr))
+    return;
+  ptr = bam_data();
+  ptr[0] = 0;
+  ptr[1] = 0xff;
   format_add_bam_signature('D', idbuf);
-  bam_buffer->mustflush = 1;
+  bam_dirty();
 
   /* build contents of 40/0 */
-  uint8_t *ptr = buf->data;
+  ptr = buf->data;
   *ptr++ = 40;
   *ptr++ = 3;
   *ptr++ = 'D';
@@ -2192,7 +3631,7 @@ static void format_d81_image(uint8_t part, buffer_t *buf, uint8_t *name, uint8_t
   format_copy_label(part, buf->data, name, idbuf);
 
   /* write 40/0 */
-  if (image_write(part, /*sector_offset(part, 40, 0)*/ (40-1)*40*256L,
+  if (cached_write(part, /*sector_offset(part, 40, 0)*/ (40-1)*40*256L,
                   buf->data, 256, 0))
     return;
 
@@ -2205,9 +3644,9 @@ static void format_dnp_image(uint8_t part, buffer_t *buf, uint8_t *name, uint8_t
   for (uint8_t s=0; s<35; s++)
     allocate_sector(part, DNP_BAM_TRACK, s);
 
-  /* add BAM signature - first BAM sector is in bam_buffer because of allocate_sector */
+  /* add BAM signature - first BAM sector is in bam_data because of allocate_sector */
   format_add_bam_signature('H', idbuf);
-  bam_buffer->data[DNP_BAM_LAST_TRACK_OFS] = get_param(part, LAST_TRACK);
+  bam_data()[DNP_BAM_LAST_TRACK_OFS] = get_param(part, LAST_TRACK);
 
   /* build root dirheader */
   uint8_t *ptr = buf->data;
@@ -2222,7 +3661,7 @@ static void format_dnp_image(uint8_t part, buffer_t *buf, uint8_t *name, uint8_t
   buf->data[DNP_DIRHEADER_ROOTHDR_SECTOR] = 1;
 
   /* write 1/1 */
-  if (image_write(part, /*sector_offset(part, 1, 1)*/ 256,
+  if (cached_write(part, /*sector_offset(part, 1, 1)*/ 256,
                   buf->data, 256, 0))
     return;
 
@@ -2259,6 +3698,9 @@ static void d64_format(path_t *path, uint8_t *name, uint8_t *id) {
   bam_buffer->pvt.bam.part = 0xff;
   if (bam_buffer2)
     bam_buffer2->pvt.bam.part = 0xff;
+#ifdef CONFIG_FULL_BAM
+  fullbam.part = 255;
+#endif
 
   if (id != NULL) {
     /* Clear the data area of the disk image */
@@ -58,6 +58,10 @@
 #define FLAG_RO     (1<<6)
 #define FLAG_SPLAT  (1<<7)
 
+/// Number of entries in the track tables of a partition: tracks 0 to 81
+/// cover any D41/D71/D81 image including the error info after the last track
+#define D64_TRACKTABLE_SIZE 82
+
 /* forward declaration to avoid an include loop */
 struct buffer_s;
 
@@ -198,9 +202,14 @@ typedef struct {
  * @track : current track
  * @sector: current sector
  * @blocks: number of sectors allocated before the current
+ * @rel   : additional data for REL files
  *
  * This structure holds the information required to write to a file
  * in a D64 image and update its directory entry upon close.
+ * For REL files, @track/@sector is the last data block and @blocks
+ * the number of data blocks. @rel holds the number of bytes used in
+ * the last data block, the super side sector (track 0 if the image
+ * type doesn't use one) and the side sectors of one group.
  */
 typedef struct d64fh {
   struct d64dh dh;
@@ -208,6 +217,12 @@ typedef struct d64fh {
   uint8_t track;
   uint8_t sector;
   uint16_t blocks;
+  struct {
+    uint8_t lastbytes;
+    uint8_t group;
+    uint8_t super[2];
+    uint8_t side[12];
+  } rel;
 } d64fh_t;
 
 /**
@@ -273,8 +288,13 @@ struct param_s {
  * @current_dir: current directory on FAT as seen by sd2iec
  * @fop        : pointer to the fileops structure for this partition
  * @imagehandle: file handle of a mounted image file on this partition
+ * @imagemap   : cluster link map of the mounted image file
+ * @imagestart : first sector of the mounted image file if it is contiguous
+ * @imagedirty : image file has writes that were not synced yet
  * @imagetype  : disk image type mounted on this partition
  * @d64data    : extended information about a mounted Dxx image
+ * @tracklba   : first LBA sector number of each track of a mounted Dxx image
+ * @trackspt   : number of sectors of each track of a mounted Dxx image
  *
  * This data structure holds per-partition data.
  */
@@ -283,8 +303,17 @@ typedef struct partition_s {
   dir_t                  current_dir;
   const struct fileops_s *fop;
   FIL                    imagehandle;
+#ifdef CONFIG_IMAGE_LINKMAP
+  DWORD                  imagemap[LINKMAP_SIZE(CONFIG_IMAGE_LINKMAP)];
+#endif
+  DWORD                  imagestart;
+  uint8_t                imagedirty;
   uint8_t                imagetype;
   struct param_s         d64data;
+#ifdef CONFIG_D64_TRACKTABLE
+  uint16_t               tracklba[D64_TRACKTABLE_SIZE];
+  uint8_t                trackspt[D64_TRACKTABLE_SIZE];
+#endif
 } partition_t;
 
 #endif
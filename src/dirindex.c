@@ -0,0 +1,264 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   dirindex.c: FAT and Dxx directory name index
+
+   The index holds a hash of the CBM name and the position of every
+   entry of the FAT or Dxx directory that was searched last. It is
+   built by a full scan on the first lookup of a name without wildcards
+   in a directory and allows later lookups to read only the entries
+   whose hash matches. Anything that could change the CBM names in a
+   directory must call dirindex_invalidate.
+
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "d64ops.h"
+#include "dirent.h"
+#include "fatops.h"
+#include "ff.h"
+#include "flags.h"
+#include "parser.h"
+#include "wrapops.h"
+#include "dirindex.h"
+
+/* number of hash chains, must be a power of 2 */
+#define BUCKETS  256
+#define NO_ENTRY 0xffff
+
+/* Entry positions: FAT uses the DIR index and cluster before the entry */
+/* was read, Dxx the entry number and track<<8|sector of the entry.      */
+typedef struct {
+  uint16_t hash;
+  uint16_t next;    /* next entry with the same bucket, in directory order */
+  uint16_t index;
+  uint32_t cluster;
+} dirindex_entry_t;
+
+static dirindex_entry_t entries[CONFIG_DIRINDEX];
+static uint16_t buckets[BUCKETS];
+static uint16_t entry_count;
+
+static uint8_t  index_part = -1;
+static uint32_t index_dir;
+static uint8_t  index_flags;
+
+/* set if the directory has more entries than the index can hold */
+static uint8_t  index_full;
+static uint16_t tail_index;
+static uint32_t tail_cluster;
+
+/* Dxx only: position of the end of the directory */
+static uint16_t end_index;
+static uint32_t end_cluster;
+
+void dirindex_invalidate(void) {
+  index_part = -1;
+}
+
+/* Returns true if matchstr contains a wildcard in its compared part */
+static uint8_t has_wildcards(uint8_t *matchstr) {
+  for (uint8_t i = 0; i < CBM_NAME_LENGTH && matchstr[i]; i++)
+    if (matchstr[i] == '*' || matchstr[i] == '?')
+      return 1;
+
+  return 0;
+}
+
+/* Returns the key of the directory opened in dh */
+static uint32_t dir_key(dh_t *dh) {
+  if (partition[dh->part].fop == &fatops)
+    return dh->dir.fat.sclust;
+  else
+    return (dh->dir.d64.track << 8) | dh->dir.d64.sector;
+}
+
+/* Returns the flags that change the entries returned for dh */
+static uint8_t dir_flags(dh_t *dh) {
+  if (partition[dh->part].fop == &fatops)
+    return globalflags & EXTENSION_HIDING;
+  else
+    return dh->dir.d64.hidden != 0;
+}
+
+/* Moves dh to a position recorded in the index */
+static void seek_position(dh_t *dh, uint16_t index, uint32_t cluster) {
+  if (partition[dh->part].fop == &fatops) {
+    l_seekdir(&dh->dir.fat, index, cluster);
+  } else {
+    dh->dir.d64.track  = cluster >> 8;
+    dh->dir.d64.sector = cluster & 0xff;
+    dh->dir.d64.entry  = index;
+  }
+}
+
+/**
+ * build_index - scan a directory and index its entries
+ * @dh  : directory handle at the start of the directory
+ * @dent: scratch directory entry
+ *
+ * This function reads all entries of the directory opened in dh
+ * (or as many as fit into the index) and records their hash and
+ * position. Returns 0 if successful or 1 if an error occured.
+ */
+static int8_t build_index(dh_t *dh, cbmdirent_t *dent) {
+  DIR *dj = &dh->dir.fat;
+  uint8_t  is_fat = (partition[dh->part].fop == &fatops);
+  uint32_t key = dir_key(dh);
+  uint8_t  flags = dir_flags(dh);
+  uint16_t index = 0;
+  uint32_t cluster = 0;
+  int8_t res;
+  int i;
+
+  entry_count = 0;
+  index_full  = 0;
+
+  while (1) {
+    if (is_fat) {
+      index   = dj->index;
+      cluster = dj->clust;
+    }
+
+    res = readdir(dh, dent);
+    if (res < 0)
+      break;
+
+    if (res > 0) {
+      dirindex_invalidate();
+      return 1;
+    }
+
+    if (!is_fat) {
+      index   = dent->pvt.dxx.dh.entry;
+      cluster = (dent->pvt.dxx.dh.track << 8) | dent->pvt.dxx.dh.sector;
+    }
+
+    if (entry_count == CONFIG_DIRINDEX) {
+      /* Remember where the unindexed part starts */
+      index_full   = 1;
+      tail_index   = index;
+      tail_cluster = cluster;
+      break;
+    }
+
+    entries[entry_count].hash    = hash_name(dent->name);
+    entries[entry_count].index   = index;
+    entries[entry_count].cluster = cluster;
+    entry_count++;
+  }
+
+  /* Link the entries of each bucket in directory order */
+  for (i = 0; i < BUCKETS; i++)
+    buckets[i] = NO_ENTRY;
+
+  for (i = entry_count - 1; i >= 0; i--) {
+    uint8_t b = entries[i].hash & (BUCKETS-1);
+
+    entries[i].next = buckets[b];
+    buckets[b] = i;
+  }
+
+  if (!is_fat && !index_full) {
+    /* dh is behind the last entry of the final directory sector */
+    end_index   = dh->dir.d64.entry;
+    end_cluster = (dh->dir.d64.track << 8) | dh->dir.d64.sector;
+  }
+
+  index_part  = dh->part;
+  index_dir   = key;
+  index_flags = flags;
+  return 0;
+}
+
+/**
+ * dirindex_match - look up a name in the directory index
+ * @dh      : directory handle
+ * @matchstr: name to be matched
+ * @type    : required file type (0 for any)
+ * @dent    : pointer to a directory entry for returning the match
+ *
+ * This function looks up the first entry matching matchstr and type
+ * in the FAT or Dxx directory opened in dh, building the index first
+ * if it doesn't cover this directory yet. dh is left behind the returned
+ * entry, so next_match can continue from there. Returns the same
+ * values as next_match or DIRINDEX_UNUSABLE if the index can't be
+ * used for this request. In the latter case dh is positioned where
+ * a linear search should continue.
+ */
+int8_t dirindex_match(dh_t *dh, uint8_t *matchstr, uint8_t type, cbmdirent_t *dent) {
+  DIR *dj = &dh->dir.fat;
+  DIR start;
+  uint16_t hash, i;
+  int8_t res;
+
+  if ((partition[dh->part].fop != &fatops &&
+       partition[dh->part].fop != &d64ops) ||
+      has_wildcards(matchstr))
+    return DIRINDEX_UNUSABLE;
+
+  /* Only searches from the start of the directory can use the index */
+  if (partition[dh->part].fop == &fatops) {
+    l_opendir(dj->fs, dj->sclust, &start);
+    if (dj->index != start.index || dj->sect != start.sect)
+      return DIRINDEX_UNUSABLE;
+  } else {
+    if (dh->dir.d64.entry != 0)
+      return DIRINDEX_UNUSABLE;
+  }
+
+  if (index_part  != dh->part    ||
+      index_dir   != dir_key(dh) ||
+      index_flags != dir_flags(dh)) {
+    res = build_index(dh, dent);
+    if (res)
+      return res;
+  }
+
+  hash = hash_name(matchstr);
+  for (i = buckets[hash & (BUCKETS-1)]; i != NO_ENTRY; i = entries[i].next) {
+    if (entries[i].hash != hash)
+      continue;
+
+    seek_position(dh, entries[i].index, entries[i].cluster);
+    res = readdir(dh, dent);
+    if (res > 0)
+      return res;
+
+    if (res == 0 && check_match(dent, matchstr, NULL, NULL, type))
+      return 0;
+  }
+
+  if (index_full) {
+    /* The entry may still be in the unindexed part */
+    seek_position(dh, tail_index, tail_cluster);
+    return DIRINDEX_UNUSABLE;
+  }
+
+  /* Not found, leave dh at the end of the directory */
+  if (partition[dh->part].fop == &fatops)
+    dj->sect = 0;
+  else
+    seek_position(dh, end_index, end_cluster);
+  return -1;
+}
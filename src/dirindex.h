@@ -0,0 +1,47 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   dirindex.h: Definitions for the directory name index
+
+*/
+
+#ifndef DIRINDEX_H
+#define DIRINDEX_H
+
+#include <stdint.h>
+#include "dirent.h"
+
+/* returned by dirindex_match if the index can't answer the request */
+#define DIRINDEX_UNUSABLE 2
+
+#ifdef CONFIG_DIRINDEX
+
+void   dirindex_invalidate(void);
+int8_t dirindex_match(dh_t *dh, uint8_t *matchstr, uint8_t type, cbmdirent_t *dent);
+
+#else
+
+#  define dirindex_invalidate()      do {} while (0)
+#  define dirindex_match(dh,m,t,d)   DIRINDEX_UNUSABLE
+
+#endif
+
+#endif
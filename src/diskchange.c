@@ -27,6 +27,7 @@
 #include <string.h>
 #include "config.h"
 #include "buffers.h"
+#include "dirindex.h"
 #include "display.h"
 #include "doscmd.h"
 #include "errormsg.h"
@@ -282,8 +283,10 @@ static uint8_t create_changelist(path_t *path, uint8_t *filename) {
     }
   }
 
-  if (found) /* if no image was found, the file was never opened */
+  if (found) { /* if no image was found, the file was never opened */
     f_close(&fh);
+    dirindex_invalidate();
+  }
 
   set_busy_led(0);
 
@@ -30,6 +30,7 @@
 #include "crc.h"
 #include "d64ops.h"
 #include "dirent.h"
+#include "dirindex.h"
 #include "diskchange.h"
 #include "diskio.h"
 #include "display.h"
@@ -629,6 +630,7 @@ static void save_capbuffer(void) {
     /* Skip the error checks here */
     f_write(&datafile, loader_buffer, loader_ptr - loader_buffer, &byteswritten);
     f_close(&datafile);
+    dirindex_invalidate();
   }
 
   /* Reset capture buffer */
@@ -2132,7 +2134,7 @@ static void parse_user(void) {
     break;
 
   case '0':
-    /* U0 - only device address changes and burst fastload are supported */
+    /* U0 - device address changes, burst fastload, read and write */
     if ((command_buffer[2] & 0x1f) == 0x1e &&
         command_buffer[3] >= 4 &&
         command_buffer[3] <= 30) {
@@ -2144,6 +2146,12 @@ static void parse_user(void) {
       datacrc = 0xffff; // reset datacrc to be consistent with standard load
       burst_fastload();
       break;
+    } else if ((command_buffer[2] & 0x0f) == 0x00) {
+      burst_sectors(0);
+      break;
+    } else if ((command_buffer[2] & 0x0f) == 0x02) {
+      burst_sectors(1);
+      break;
 #endif
     }
     /* Fall through */
@@ -2295,6 +2303,21 @@ static void parse_xcommand(void) {
     }
     break;
 
+  case 'F':
+    /* Defer the sync of image writes */
+    num = parse_bool();
+    if (num != 255) {
+      if (num)
+        globalflags |= DEFER_IMAGE_SYNC;
+      else {
+        globalflags &= (uint8_t)~DEFER_IMAGE_SYNC;
+        image_sync_all();
+      }
+
+      set_error_ts(ERROR_STATUS,device_address,0);
+    }
+    break;
+
 #ifdef CONFIG_STACK_TRACKING
   case '?':
     /* Output the largest stack size seen */
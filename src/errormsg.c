@@ -187,6 +187,11 @@ void set_error_ts(uint8_t errornum, uint8_t track, uint8_t sector) {
   uint8_t i = 0;
 
   current_error = errornum;
+
+  /* An error of a block read in advance is reported when it is needed */
+  if (buffer_prefetch_error(errornum, track, sector))
+    return;
+
   buffers[ERRORBUFFER_IDX].data     = error_buffer;
   buffers[ERRORBUFFER_IDX].lastused = 0;
   buffers[ERRORBUFFER_IDX].position = 0;
@@ -205,6 +210,10 @@ void set_error_ts(uint8_t errornum, uint8_t track, uint8_t sector) {
 
       msg = appendbool(msg, '*', globalflags & POSTMATCH);
 
+      /* only shown if enabled to keep the default status unchanged */
+      if (globalflags & DEFER_IMAGE_SYNC)
+        msg = appendbool(msg, 'F', 1);
+
       *msg++ = 'I';
       msg = appendnumber(msg, image_as_dir);
 
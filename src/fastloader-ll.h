@@ -32,6 +32,7 @@ void turbodisk_buffer(uint8_t *data, uint8_t length);
 
 uint8_t jiffy_receive(iec_bus_t *busstate);
 uint8_t jiffy_send(uint8_t value, uint8_t eoi, uint8_t loadflags);
+uint16_t jiffy_send_block(const uint8_t *data, uint16_t count, uint8_t flags);
 
 void clk_data_handshake(void);
 void fastloader_fc3_send_block(uint8_t *data);
@@ -99,11 +100,13 @@ void fs_reset(void);
 uint8_t fs_byte_ready(void);
 uint8_t fs_read_byte(void);
 void fs_send_byte(uint8_t);
+uint8_t fs_send_block(const uint8_t *data, uint8_t count, uint8_t clkstate);
 #else
 # define fs_reset()       do {} while (0)
 # define fs_byte_ready()  0
 # define fs_read_byte()   0
 # define fs_send_byte(x)  ((void)x)
+# define fs_send_block(d, c, s) ((void)(d), (void)(s), (c))
 #endif
 
 #endif
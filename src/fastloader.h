@@ -30,6 +30,12 @@
 #define FLCODE_DREAMLOAD     1
 #define FLCODE_DREAMLOAD_OLD 2
 
+/* flags for jiffy_send_block, also needed in the AVR assembler code */
+#define JIFFY_BLOCK_EOI_BIT  0
+#define JIFFY_BLOCK_LOAD_BIT 1
+#define JIFFY_BLOCK_EOI      (1 << JIFFY_BLOCK_EOI_BIT)
+#define JIFFY_BLOCK_LOAD     (1 << JIFFY_BLOCK_LOAD_BIT)
+
 #ifndef __ASSEMBLER__
 
 #include <stdbool.h>
@@ -154,6 +160,7 @@ void load_dolphin(void);
 void save_dolphin(void);
 
 void burst_fastload(void);
+void burst_sectors(uint8_t write);
 
 /* functions that are shared between multiple loaders */
 /* currently located in fastloader.c                  */
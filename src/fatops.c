@@ -31,6 +31,7 @@
 #include "config.h"
 #include "buffers.h"
 #include "d64ops.h"
+#include "dirindex.h"
 #include "diskchange.h"
 #include "diskio.h"
 #include "display.h"
@@ -44,6 +45,7 @@
 #include "p00cache.h"
 #include "parser.h"
 #include "progmem.h"
+#include "timer.h"
 #include "uart.h"
 #include "utils.h"
 #include "ustring.h"
@@ -63,6 +65,12 @@ typedef enum { EXT_UNKNOWN, EXT_IS_X00, EXT_IS_TYPE } exttype_t;
 
 uint8_t file_extension_mode;
 
+/* Deferred image writes are synced after this much idle time */
+#define IMAGE_SYNC_DELAY HZ
+
+/* Time of the last image write, for syncing in deferred mode */
+static tick_t image_write_ticks;
+
 /* ------------------------------------------------------------------------- */
 /*  Utility functions                                                        */
 /* ------------------------------------------------------------------------- */
@@ -397,6 +405,14 @@ static uint8_t* build_name(uint8_t *name, uint8_t type) {
 /*  Callbacks                                                                */
 /* ------------------------------------------------------------------------- */
 
+#if _CACHE_WAYS != 0
+/* Pending read-ahead requests, see readahead_run */
+static buffer_t *readahead_buf;
+static uint8_t   readahead_image;
+static uint8_t   readahead_part;
+static DWORD     readahead_offset;
+#endif
+
 /**
  * fat_file_read - read the next data block into the buffer
  * @buf: buffer to be worked on
@@ -408,6 +424,15 @@ static uint8_t fat_file_read(buffer_t *buf) {
   FRESULT res;
   UINT bytesread;
 
+  /* Use the block read in advance while the last one was sent */
+  switch (buffer_prefetched(buf)) {
+  case PREFETCH_OK:
+    return 0;
+
+  case PREFETCH_FAILED:
+    return 1;
+  }
+
   uart_putc('#');
 
   buf->fptr = buf->pvt.fat.fh.fptr - buf->pvt.fat.headersize;
@@ -438,6 +463,12 @@ static uint8_t fat_file_read(buffer_t *buf) {
   else
     buf->sendeoi = 0;
 
+#if _CACHE_WAYS != 0
+  /* More data follows, queue this file for readahead_run */
+  if (!buf->sendeoi)
+    readahead_buf = buf;
+#endif
+
   return 0;
 }
 
@@ -569,6 +600,9 @@ static uint8_t fat_file_write(buffer_t *buf) {
 uint8_t fat_file_seek(buffer_t *buf, uint32_t position, uint8_t index) {
   uint32_t pos = position + buf->pvt.fat.headersize;
 
+  /* The file position is changed here */
+  buffer_cancel_prefetch(buf);
+
   if (buf->dirty)
     if (fat_file_write(buf))
       return 1;
@@ -643,6 +677,9 @@ static uint8_t fat_file_close(buffer_t *buf) {
   }
 
   res = f_close(&buf->pvt.fat.fh);
+  if (buf->write)
+    /* the directory entry is complete only now */
+    dirindex_invalidate();
   parse_error(res,1);
   buf->cleanup = callback_dummy;
 
@@ -710,6 +747,7 @@ void fat_open_read(path_t *path, cbmdirent_t *dent, buffer_t *buf, uint8_t modif
   buf->read      = 1;
   buf->write     = (mode & FA_WRITE) != 0;
   buf->random    = modify != 0;
+  buf->prefetch  = modify == 0;
   buf->cleanup   = fat_file_close;
   buf->refill    = modify == 0 ? fat_file_read : fat_file_modify;
   buf->seek      = fat_file_seek;
@@ -772,6 +810,8 @@ FRESULT create_file(path_t *path, cbmdirent_t *dent, uint8_t type, buffer_t *buf
   if (res != FR_OK)
     return res;
 
+  dirindex_invalidate();
+
   if (x00ext != NULL || recordlen) {
     UINT byteswritten;
 
@@ -974,21 +1014,23 @@ int8_t fat_readdir(dh_t *dh, cbmdirent_t *dent) {
         memcpy(dent->name, name, CBM_NAME_LENGTH);
       } else {
         /* read name from file */
+        const BYTE *header;
         UINT bytesread;
 
         res = l_opencluster(&partition[dh->part].fatfs, &partition[dh->part].imagehandle, finfo.clust);
         if (res != FR_OK)
           goto notp00;
 
-        res = f_read(&partition[dh->part].imagehandle, ops_scratch, P00_HEADER_SIZE, &bytesread);
-        if (res != FR_OK)
+        /* Check the header in place, ops_scratch may still hold the LFN */
+        res = l_readptr(&partition[dh->part].imagehandle, &header, P00_HEADER_SIZE, &bytesread);
+        if (res != FR_OK || bytesread != P00_HEADER_SIZE)
           goto notp00;
 
-        if (memcmp_P(ops_scratch, p00marker, P00MARKER_LENGTH))
+        if (memcmp_P(header, p00marker, P00MARKER_LENGTH))
           goto notp00;
 
         /* Copy the internal name - dent->name is still zeroed */
-        ustrcpy(dent->name, ops_scratch + P00_CBMNAME_OFFSET);
+        ustrncpy(dent->name, header + P00_CBMNAME_OFFSET, CBM_NAME_LENGTH);
 
         /* Some programs pad the name with 0xa0 instead of 0 */
         ptr = dent->name;
@@ -1101,6 +1143,7 @@ uint8_t fat_delete(path_t *path, cbmdirent_t *dent) {
   }
   partition[path->part].fatfs.curr_dir = path->dir.fat;
   res = f_unlink(&partition[path->part].fatfs, name);
+  dirindex_invalidate();
 
   update_leds();
 
@@ -1199,6 +1242,7 @@ void fat_mkdir(path_t *path, uint8_t *dirname) {
   partition[path->part].fatfs.curr_dir = path->dir.fat;
   pet2asc(dirname);
   res = f_mkdir(&partition[path->part].fatfs, dirname);
+  dirindex_invalidate();
   parse_error(res,0);
 }
 
@@ -1447,6 +1491,7 @@ void fat_rename(path_t *path, cbmdirent_t *dent, uint8_t *newname) {
   UINT byteswritten;
 
   partition[path->part].fatfs.curr_dir = path->dir.fat;
+  dirindex_invalidate();
 
   if (dent->opstype == OPSTYPE_FAT_X00) {
     /* [PSUR]00 rename, just change the internal file name */
@@ -1520,6 +1565,8 @@ void fatops_init(uint8_t preserve_path) {
   part = 0;
   while (max_part < CONFIG_MAX_PARTITIONS && drive < MAX_DRIVES) {
     partition[max_part].fop = &fatops;
+    partition[max_part].imagestart = 0;
+    partition[max_part].imagedirty = 0;
 
     /* Map drive numbers in just one place */
     realdrive = map_drive(drive);
@@ -1553,6 +1600,7 @@ void fatops_init(uint8_t preserve_path) {
   /* Invalidate some caches */
   d64_invalidate();
   p00cache_invalidate();
+  dirindex_invalidate();
 
 #ifndef HAVE_HOTPLUG
   if (!max_part) {
@@ -1592,6 +1640,8 @@ uint8_t image_unmount(uint8_t part) {
   }
 
   partition[part].fop = &fatops;
+  partition[part].imagestart = 0;
+  partition[part].imagedirty = 0;
   res = f_close(&partition[part].imagehandle);
   if (res != FR_OK) {
     parse_error(res,0);
@@ -1633,6 +1683,71 @@ void image_mkdir(path_t *path, uint8_t *dirname) {
   return;
 }
 
+/**
+ * image_written - Handle the sync of an image write
+ * @part : partition number
+ * @flush: Flags if the write should be synced immediately
+ *
+ * Syncing the image after every sector rewrites its directory entry
+ * and FAT sectors each time. If DEFER_IMAGE_SYNC is set, writes with
+ * flush set are only marked as pending and synced later when a file
+ * is closed, the image is unmounted or the bus has been idle for a
+ * while.
+ */
+static void image_written(uint8_t part, uint8_t flush) {
+  partition[part].imagedirty = 1;
+  image_write_ticks = getticks();
+
+  if (flush && !(globalflags & DEFER_IMAGE_SYNC))
+    image_sync(part);
+}
+
+/**
+ * image_direct - read or write a contiguous image without seeking
+ * @part  : partition number
+ * @offset: offset in the image file
+ * @buffer: pointer to the data
+ * @bytes : number of bytes to transfer
+ * @write : 0 to read, 1 to write
+ *
+ * This function transfers data of a contiguous image file by computing
+ * the sector numbers directly from the start sector of the image, which
+ * skips the seek and cluster chain handling of FatFs. The caller must
+ * make sure that the range is within the image. Returns 0 on success or
+ * 2 on failure.
+ */
+static uint8_t image_direct(uint8_t part, DWORD offset, void *buffer, uint16_t bytes, uint8_t write) {
+  FIL *fp = &partition[part].imagehandle;
+  uint8_t *ptr = buffer;
+  FRESULT res;
+  DWORD sector;
+  UINT ofs, count;
+
+  while (bytes) {
+    sector = partition[part].imagestart + offset / 512;
+    ofs    = offset % 512;
+    count  = 512 - ofs;
+    if (count > bytes)
+      count = bytes;
+
+    if (write)
+      res = l_writesector(fp, sector, ofs, ptr, count);
+    else
+      res = l_readsector(fp, sector, ofs, ptr, count);
+
+    if (res != FR_OK) {
+      parse_error(res, !write);
+      return 2;
+    }
+
+    offset += count;
+    ptr    += count;
+    bytes  -= count;
+  }
+
+  return 0;
+}
+
 /**
  * image_read - Seek to a specified image offset and read data
  * @part  : partition number
@@ -1648,6 +1763,10 @@ uint8_t image_read(uint8_t part, DWORD offset, void *buffer, uint16_t bytes) {
   FRESULT res;
   UINT bytesread;
 
+  if (partition[part].imagestart && offset != (DWORD)-1 &&
+      offset + bytes <= partition[part].imagehandle.fsize)
+    return image_direct(part, offset, buffer, bytes, 0);
+
   if (offset != (DWORD)-1) {
     res = f_lseek(&partition[part].imagehandle, offset);
     if (res != FR_OK) {
@@ -1684,6 +1803,15 @@ uint8_t image_write(uint8_t part, DWORD offset, void *buffer, uint16_t bytes, ui
   FRESULT res;
   UINT byteswritten;
 
+  if (partition[part].imagestart && offset != (DWORD)-1 &&
+      offset + bytes <= partition[part].imagehandle.fsize) {
+    if (image_direct(part, offset, buffer, bytes, 1))
+      return 2;
+
+    image_written(part, flush);
+    return 0;
+  }
+
   if (offset != (DWORD)-1) {
     res = f_lseek(&partition[part].imagehandle, offset);
     if (res != FR_OK) {
@@ -1701,12 +1829,104 @@ uint8_t image_write(uint8_t part, DWORD offset, void *buffer, uint16_t bytes, ui
   if (byteswritten != bytes)
     return 1;
 
-  if (flush)
-    f_sync(&partition[part].imagehandle);
+  image_written(part, flush);
+  return 0;
+}
 
+/**
+ * image_sync - Sync pending writes of an image file
+ * @part: partition number
+ *
+ * This function writes all data that is still cached for the image
+ * file mounted on partition part to the card. Returns 0 if successful
+ * or if there was nothing to sync, 1 otherwise.
+ */
+uint8_t image_sync(uint8_t part) {
+  FRESULT res;
+
+  if (!partition[part].imagedirty)
+    return 0;
+
+  partition[part].imagedirty = 0;
+  res = f_sync(&partition[part].imagehandle);
+  if (res != FR_OK) {
+    parse_error(res,0);
+    return 1;
+  }
   return 0;
 }
 
+/**
+ * image_sync_all - Sync pending writes of all image files
+ *
+ * This function syncs the image files on all partitions.
+ */
+void image_sync_all(void) {
+  for (uint8_t i = 0; i < max_part; i++)
+    image_sync(i);
+}
+
+/**
+ * image_sync_idle - Sync image files that haven't been written recently
+ *
+ * This function is called regularly while the bus is idle. It syncs
+ * all image files once no image write has happened for
+ * IMAGE_SYNC_DELAY, so the data reaches the card even if the computer
+ * never closes the file.
+ */
+void image_sync_idle(void) {
+  if (time_after(getticks(), image_write_ticks + IMAGE_SYNC_DELAY))
+    image_sync_all();
+}
+
+#if _CACHE_WAYS != 0
+/**
+ * image_readahead - Request read-ahead of image data
+ * @part  : partition number
+ * @offset: offset in the image file
+ *
+ * This function notes that the image data at offset will probably be
+ * read soon, it is loaded into the sector cache by the next call of
+ * readahead_run. Only contiguous images are read ahead.
+ */
+void image_readahead(uint8_t part, DWORD offset) {
+  if (!partition[part].imagestart)
+    return;
+
+  readahead_image  = 1;
+  readahead_part   = part;
+  readahead_offset = offset;
+}
+
+/**
+ * readahead_run - Execute pending read-ahead requests
+ *
+ * This function loads the data requested by the refill callbacks of
+ * file and image buffers into the sector cache. The bus code calls it
+ * at a point where it may delay the transfer of the current byte, so
+ * the card access overlaps with the computer processing the previous
+ * one instead of stalling the next buffer refill.
+ */
+void readahead_run(void) {
+  buffer_t *buf = readahead_buf;
+  partition_t *p;
+
+  if (buf != NULL) {
+    readahead_buf = NULL;
+    /* The buffer may have been closed since the request */
+    if (buf->allocated && buf->read && buf->refill == fat_file_read)
+      l_prefetch(&buf->pvt.fat.fh);
+  }
+
+  if (readahead_image) {
+    readahead_image = 0;
+    p = &partition[readahead_part];
+    if (p->imagestart && readahead_offset < p->imagehandle.fsize)
+      l_prefetchsector(&p->imagehandle, p->imagestart + readahead_offset / 512);
+  }
+}
+#endif
+
 /**
  * check_free - Check if a specified number of bytes is free on the partition
  * @part: partition number
@@ -1805,6 +2025,7 @@ void fat_format_image(path_t *path, uint8_t *name, uint8_t *id) {
     res = f_open(&partition[path->part].fatfs,
                  &partition[path->part].imagehandle,
                  ops_scratch, FA_CREATE_NEW|FA_READ|FA_WRITE);
+    dirindex_invalidate();
 
     if (res == FR_OK)
       res = f_lseek(&partition[path->part].imagehandle, fsize);
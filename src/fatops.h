@@ -57,6 +57,16 @@ uint8_t image_chdir(path_t *path, cbmdirent_t *dent);
 void    image_mkdir(path_t *path, uint8_t *dirname);
 uint8_t image_read(uint8_t part, DWORD offset, void *buffer, uint16_t bytes);
 uint8_t image_write(uint8_t part, DWORD offset, void *buffer, uint16_t bytes, uint8_t flush);
+uint8_t image_sync(uint8_t part);
+void    image_sync_all(void);
+void    image_sync_idle(void);
+#if _CACHE_WAYS != 0
+void    image_readahead(uint8_t part, DWORD offset);
+void    readahead_run(void);
+#else
+#  define image_readahead(part, offset) do {} while (0)
+#  define readahead_run()               do {} while (0)
+#endif
 
 typedef enum {
    IMG_UNKNOWN = 0,
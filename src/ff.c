@@ -92,6 +92,231 @@ BUF static_buf;
 # define FPBUF (fp->buf)
 #endif
 
+#if _CACHE_WAYS != 0
+/*-----------------------------------------------------------------------*/
+/* Sector cache                                                          */
+/*-----------------------------------------------------------------------*/
+
+typedef struct _CACHE_LINE {
+  DWORD  sect;              /* Cached sector, 0: line is unused */
+  DWORD  stamp;             /* Time of the last access for LRU */
+  FATFS* fs;                /* Owner file system object */
+  BYTE   dirty;             /* dirty flag (1:must be written back) */
+  BYTE   ahead;             /* Loaded by read-ahead and not used yet */
+  BYTE   data[S_MAX_SIZ];
+} CACHE_LINE;
+
+static
+CACHE_LINE cache[_CACHE_SETS][_CACHE_WAYS];
+static
+DWORD cache_clock;
+
+DWORD ff_cache_hits, ff_cache_misses;
+DWORD ff_readahead_fills, ff_readahead_hits;
+
+
+static
+CACHE_LINE* cache_find (  /* Pointer to the line, NULL: not cached */
+  FATFS *fs,
+  DWORD sector
+)
+{
+  CACHE_LINE *line = cache[sector & (_CACHE_SETS - 1)];
+  BYTE n;
+
+  for (n = 0; n < _CACHE_WAYS; n++, line++) {
+    if (line->sect == sector && line->fs == fs) {
+      line->stamp = ++cache_clock;
+      return line;
+    }
+  }
+  return NULL;
+}
+
+
+#if !_FS_READONLY
+static
+BOOL cache_flush_line ( /* TRUE: successful, FALSE: failed */
+  CACHE_LINE *line
+)
+{
+  FATFS *fs = line->fs;
+  DWORD wsect = line->sect;
+  BYTE n;
+
+  if (line->dirty) {
+    if (disk_write(fs->drive, line->data, wsect, 1) != RES_OK)
+      return FALSE;
+    line->dirty = FALSE;
+    if (wsect < (fs->fatbase + fs->sects_fat)) {  /* In FAT area */
+      for (n = fs->n_fats; n >= 2; n--) {         /* Reflect the change to FAT copy */
+        wsect += fs->sects_fat;
+        disk_write(fs->drive, line->data, wsect, 1);
+      }
+    }
+  }
+  return TRUE;
+}
+#endif
+
+
+static
+CACHE_LINE* cache_alloc ( /* Pointer to the line, NULL: write back failed */
+  FATFS *fs,
+  DWORD sector
+)
+{
+  CACHE_LINE *line = cache[sector & (_CACHE_SETS - 1)];
+  CACHE_LINE *victim = line;
+  BYTE n;
+
+  /* Replace an unused or else the least recently used line of the set */
+  for (n = 0; n < _CACHE_WAYS && victim->sect; n++, line++) {
+    if (!line->sect || line->stamp < victim->stamp)
+      victim = line;
+  }
+#if !_FS_READONLY
+  if (!cache_flush_line(victim)) return NULL;
+#endif
+  victim->sect  = sector;
+  victim->fs    = fs;
+  victim->stamp = ++cache_clock;
+  victim->ahead = FALSE;
+  return victim;
+}
+
+
+static
+CACHE_LINE* cache_load (  /* Pointer to the line, NULL: failed */
+  FATFS *fs,
+  DWORD sector
+)
+{
+  CACHE_LINE *line = cache_find(fs, sector);
+
+  if (line) {
+    ff_cache_hits++;
+    if (line->ahead) {      /* First use of a sector loaded by read-ahead */
+      ff_readahead_hits++;
+      line->ahead = FALSE;
+    }
+    return line;
+  }
+  ff_cache_misses++;
+  if (!(line = cache_alloc(fs, sector)))
+    return NULL;
+  if (disk_read(fs->drive, line->data, sector, 1) != RES_OK) {
+    line->sect = 0;
+    return NULL;
+  }
+  return line;
+}
+
+
+static
+FRESULT cache_prefetch (
+  FATFS *fs,
+  DWORD sector
+)
+{
+  CACHE_LINE *line;
+
+  if ((FSBUF.sect == sector && FSBUF.fs == fs) || cache_find(fs, sector))
+    return FR_OK;                       /* Already in memory */
+  if (!(line = cache_alloc(fs, sector)))
+    return FR_RW_ERROR;
+  if (disk_read(fs->drive, line->data, sector, 1) != RES_OK) {
+    line->sect = 0;
+    return FR_RW_ERROR;
+  }
+  line->ahead = TRUE;
+  ff_readahead_fills++;
+  return FR_OK;
+}
+
+
+/* Write back the dirty lines of all file systems. The shared window */
+/* may have been written back into a line of another file system.    */
+#if !_FS_READONLY
+static
+BOOL cache_sync (void)  /* TRUE: successful, FALSE: failed */
+{
+  CACHE_LINE *line = cache[0];
+  UINT n;
+
+  for (n = 0; n < _CACHE_SETS * _CACHE_WAYS; n++, line++) {
+    if (line->sect && !cache_flush_line(line))
+      return FALSE;
+  }
+  return TRUE;
+}
+#endif
+
+
+static
+void cache_invalidate (
+  FATFS *fs,            /* File system object */
+  DWORD sector,         /* First sector */
+  DWORD count           /* Number of sectors, 0: all sectors of fs */
+)
+{
+  CACHE_LINE *line = cache[0];
+  UINT n;
+
+  for (n = 0; n < _CACHE_SETS * _CACHE_WAYS; n++, line++) {
+    if (line->fs == fs &&
+        (!count || (line->sect >= sector && line->sect - sector < count))) {
+      line->sect  = 0;
+      line->dirty = FALSE;
+    }
+  }
+}
+
+
+/* Read sectors directly into a buffer, dirty cached sectors override the disk */
+static
+DRESULT cache_read (
+  FATFS *fs,
+  BYTE *buff,
+  DWORD sector,
+  BYTE count
+)
+{
+  CACHE_LINE *line = cache[0];
+  DRESULT res;
+  UINT n;
+
+  res = disk_read(fs->drive, buff, sector, count);
+  if (res != RES_OK) return res;
+  for (n = 0; n < _CACHE_SETS * _CACHE_WAYS; n++, line++) {
+    if (line->dirty && line->fs == fs &&
+        line->sect >= sector && line->sect - sector < count)
+      memcpy(buff + (line->sect - sector) * SS(fs), line->data, SS(fs));
+  }
+  return RES_OK;
+}
+
+
+/* Write sectors directly from a buffer, cached copies are dropped */
+#if !_FS_READONLY
+static
+DRESULT cache_write (
+  FATFS *fs,
+  const BYTE *buff,
+  DWORD sector,
+  BYTE count
+)
+{
+  cache_invalidate(fs, sector, count);
+  return disk_write(fs->drive, buff, sector, count);
+}
+#endif
+
+#else
+# define cache_read(fs, buff, sector, count)  disk_read((fs)->drive, buff, sector, count)
+# define cache_write(fs, buff, sector, count) disk_write((fs)->drive, buff, sector, count)
+#endif /* _CACHE_WAYS != 0 */
+
 /*-----------------------------------------------------------------------*/
 /* Change window offset                                                  */
 /*-----------------------------------------------------------------------*/
@@ -117,9 +342,24 @@ BOOL move_window (      /* TRUE: successful, FALSE: failed */
 #else
   if (wsect != sector) {                /* Changed current window */
 #endif
+#if _CACHE_WAYS != 0
+    CACHE_LINE *line;
+#endif
 #if !_FS_READONLY
+#if _CACHE_WAYS == 0
     BYTE n;
+#endif
     if (buf->dirty) {                   /* Write back dirty window if needed */
+#if _CACHE_WAYS != 0
+      if (wsect) {                      /* ...into the cache */
+        line = cache_find(ofs, wsect);
+        if (!line && !(line = cache_alloc(ofs, wsect)))
+          return FALSE;
+        memcpy(line->data, buf->data, SS(ofs));
+        line->dirty = TRUE;
+      }
+      buf->dirty = FALSE;
+#else
       if (disk_write(ofs->drive, buf->data, wsect, 1) != RES_OK)
         return FALSE;
       buf->dirty = FALSE;
@@ -129,11 +369,18 @@ BOOL move_window (      /* TRUE: successful, FALSE: failed */
           disk_write(ofs->drive, buf->data, wsect, 1);
         }
       }
+#endif
     }
 #endif
     if (sector) {
+#if _CACHE_WAYS != 0
+      if (!(line = cache_load(fs, sector)))
+        return FALSE;
+      memcpy(buf->data, line->data, SS(fs));
+#else
       if (disk_read(fs->drive, buf->data, sector, 1) != RES_OK)
         return FALSE;
+#endif
       buf->sect = sector;
 #if _USE_1_BUF != 0
       buf->fs=fs;
@@ -170,6 +417,37 @@ BOOL move_fp_window(
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Get sector data for reading                                           */
+/*-----------------------------------------------------------------------*/
+
+/* With the sector cache, a sector that is not in the window is read   */
+/* from its cache line instead of being copied into the window first.  */
+/* This saves a sector-sized copy and keeps the FAT or directory sector */
+/* in the window.                                                      */
+static
+const BYTE* read_sector_ptr ( /* Pointer to the data, NULL: failed */
+  FATFS *fs,            /* File system object */
+  BUF *buf,             /* Window to check first */
+  DWORD sector          /* Sector number */
+)
+{
+#if _CACHE_WAYS != 0
+  CACHE_LINE *line;
+
+  if (buf->sect != sector || buf->fs != fs) {
+    if (!(line = cache_load(fs, sector)))
+      return NULL;
+    return line->data;
+  }
+#endif
+  if (!move_window(fs, buf, sector)) return NULL;
+  return buf->data;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Clean-up cached data                                                  */
 /*-----------------------------------------------------------------------*/
@@ -192,9 +470,12 @@ FRESULT sync (          /* FR_OK: successful, FR_RW_ERROR: failed */
     ST_DWORD(&FSBUF.data[FSI_StrucSig], 0x61417272);
     ST_DWORD(&FSBUF.data[FSI_Free_Count], fs->free_clust);
     ST_DWORD(&FSBUF.data[FSI_Nxt_Free], fs->last_clust);
-    disk_write(fs->drive, FSBUF.data, fs->fsi_sector, 1);
+    cache_write(fs, FSBUF.data, fs->fsi_sector, 1);
     fs->fsi_flag = 0;
   }
+#endif
+#if _CACHE_WAYS != 0
+  if (!cache_sync()) return FR_RW_ERROR;
 #endif
   /* Make sure that no pending write process in the physical drive */
   if (disk_ioctl(fs->drive, CTRL_SYNC, NULL) != RES_OK)
@@ -247,6 +528,39 @@ DWORD get_cluster (     /* 0,>=2: successful, 1: failed */
 
 
 
+#if _USE_FASTSEEK
+/*-----------------------------------------------------------------------*/
+/* Look up a cluster in the cluster link map                             */
+/*-----------------------------------------------------------------------*/
+
+/* The map consists of the number of runs followed by a (file cluster
+   index, cluster number) pair for the start of each run of consecutive
+   clusters and the number of mapped clusters as end marker. */
+static
+DWORD clmt_clust (      /* 0: not in the map, >=2: cluster number */
+  FIL *fp,              /* File object with a valid cluster link map */
+  DWORD ccnt            /* Cluster index from the start of the file */
+)
+{
+  DWORD *tbl = fp->cltbl;
+  UINT lo = 0, hi = tbl[0], mid;
+
+
+  if (ccnt >= tbl[2 * hi + 1]) return 0;  /* Beyond the mapped part of the chain */
+  while (hi - lo > 1) {                   /* Binary search for the run */
+    mid = (lo + hi) / 2;
+    if (tbl[2 * mid + 1] <= ccnt)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return tbl[2 * lo + 2] + ccnt - tbl[2 * lo + 1];
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Change a cluster status                                               */
 /*-----------------------------------------------------------------------*/
@@ -299,6 +613,95 @@ BOOL put_cluster (      /* TRUE: successful, FALSE: failed */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Count free clusters                                                   */
+/*-----------------------------------------------------------------------*/
+
+#if !_FS_READONLY
+static
+FRESULT count_free (
+  FATFS *fs,          /* File system object */
+  DWORD *nclust,      /* Pointer to the variable to return number of free clusters */
+  DWORD maxclust      /* Stop after maxclust free clusters were found (0 = no limit) */
+)
+{
+  DWORD n, clust, sect;
+  BYTE fat, f, *p;
+#if _FREEMAP_SIZE
+  DWORD span = fs->fmap_span;
+  UINT i;
+
+  /* Count the free clusters of every part scanned below */
+  memset(fs->fmap, 0, sizeof(fs->fmap));
+#endif
+
+  /* Get number of free clusters */
+  fat = fs->fs_type;
+  n = 0;
+  if (fat == FS_FAT12) {
+    clust = 2;
+    do {
+      if ((WORD)get_cluster(fs, clust) == 0) {
+        n++;
+#if _FREEMAP_SIZE
+        fs->fmap[clust / span]++;
+#endif
+      }
+    } while (++clust < fs->max_clust);
+  } else {
+    clust = fs->max_clust;
+    sect = fs->fatbase;
+    f = 0; p = 0;
+    do {
+      if (maxclust && n >= maxclust) {
+        n = maxclust;
+        break;
+      }
+      if (!f) {
+        if (!move_fs_window(fs, sect++)) return FR_RW_ERROR;
+        p = FSBUF.data;
+      }
+      if (fat == FS_FAT16) {
+        if (LD_WORD(p) == 0) {
+          n++;
+#if _FREEMAP_SIZE
+          fs->fmap[(fs->max_clust - clust) / span]++;
+#endif
+        }
+        p += 2; f += 1;
+      } else {
+        if (LD_DWORD(p) == 0) {
+          n++;
+#if _FREEMAP_SIZE
+          fs->fmap[(fs->max_clust - clust) / span]++;
+#endif
+        }
+        p += 4; f += 2;
+      }
+    } while (--clust);
+  }
+  if (!maxclust || n < maxclust) {
+    fs->free_clust = n;
+#if _USE_FSINFO
+    if (fat == FS_FAT32) fs->fsi_flag = 1;
+#endif
+  }
+#if _FREEMAP_SIZE
+  else {
+    /* Forget the parts that were not scanned completely */
+    for (i = (fs->max_clust - clust) / span; i < _FREEMAP_SIZE; i++)
+      fs->fmap[i] = FMAP_UNKNOWN;
+  }
+#endif
+
+  *nclust = n;
+  return FR_OK;
+}
+#endif /* !_FS_READONLY */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Remove a cluster chain                                                */
 /*-----------------------------------------------------------------------*/
@@ -323,6 +726,10 @@ BOOL remove_chain (     /* TRUE: successful, FALSE: failed */
       fs->fsi_flag = 1;
 #endif
     }
+#if _FREEMAP_SIZE
+    if (fs->fmap[clust / fs->fmap_span] != FMAP_UNKNOWN)
+      fs->fmap[clust / fs->fmap_span]++;
+#endif
     clust = nxt;
   }
   return TRUE;
@@ -344,6 +751,10 @@ DWORD create_chain (    /* 0: No free cluster, 1: Error, >=2: New cluster number
 )
 {
   DWORD cstat, ncl, scl, mcl = fs->max_clust;
+#if _FREEMAP_SIZE
+  DWORD *part = NULL;
+  BOOL wrapped, whole;
+#endif
 
 
   if (clust == 0) {                       /* Create new chain */
@@ -357,17 +768,39 @@ DWORD create_chain (    /* 0: No free cluster, 1: Error, >=2: New cluster number
     scl = clust;
   }
 
+#if _FREEMAP_SIZE
+  wrapped = FALSE;
+  whole = FALSE;
+#endif
+
   ncl = scl;                              /* Start cluster */
   for (;;) {
     ncl++;                                /* Next cluster */
     if (ncl >= mcl) {                     /* Wrap around */
       ncl = 2;
       if (ncl > scl) return 0;            /* No free custer */
+#if _FREEMAP_SIZE
+      if (wrapped) return 0;              /* Skipped over the start point twice */
+      wrapped = TRUE;
+#endif
     }
+#if _FREEMAP_SIZE
+    part = &fs->fmap[ncl / fs->fmap_span];
+    if (!*part) {                         /* Skip parts without free clusters */
+      ncl = (ncl / fs->fmap_span + 1) * fs->fmap_span - 1;
+      continue;
+    }
+    if (ncl == 2 || ncl % fs->fmap_span == 0)
+      whole = TRUE;                       /* Search covers the part from its start */
+#endif
     cstat = get_cluster(fs, ncl);         /* Get the cluster status */
     if (cstat == 0) break;                /* Found a free cluster */
     if (cstat == 1) return 1;             /* Any error occured */
     if (ncl == scl) return 0;             /* No free custer */
+#if _FREEMAP_SIZE
+    if (whole && (ncl + 1 == mcl || (ncl + 1) % fs->fmap_span == 0))
+      *part = 0;                          /* Searched the whole part in vain */
+#endif
   }
 
   if (!put_cluster(fs, ncl, 0x0FFFFFFF)) return 1;      /* Mark the new cluster "in use" */
@@ -380,6 +813,9 @@ DWORD create_chain (    /* 0: No free cluster, 1: Error, >=2: New cluster number
     fs->fsi_flag = 1;
 #endif
   }
+#if _FREEMAP_SIZE
+  if (*part != FMAP_UNKNOWN) (*part)--;
+#endif
 
   return ncl;   /* Return new cluster number */
 }
@@ -812,7 +1248,7 @@ FRESULT reserve_direntry (  /* FR_OK: successful, FR_DENIED: no free entry, FR_R
   FSBUF.sect = sector = clust2sect(fs, clust);
   memset(FSBUF.data, 0, SS(fs));
   for (n = fs->csize; n; n--) {
-    if (disk_write(fs->drive, FSBUF.data, sector, 1) != RES_OK)
+    if (cache_write(fs, FSBUF.data, sector, 1) != RES_OK)
       return FR_RW_ERROR;
     sector++;
   }
@@ -888,6 +1324,9 @@ FRESULT mount_drv(
   BYTE fmt, *tbl;
   DWORD bootsect, fatsize, totalsect, maxclust;
 
+#if _CACHE_WAYS != 0
+  cache_invalidate(fs, 0, 0);         /* Drop cached sectors of the old medium */
+#endif
   memset(fs, 0, sizeof(FATFS));       /* Clean-up the file system object */
   fs->drive = LD2PD(drv);             /* Bind the logical drive and a physical drive */
   stat = disk_initialize(fs->drive);  /* Initialize low level disk I/O layer */
@@ -1016,6 +1455,10 @@ FRESULT mount_drv(
 
 #if !_FS_READONLY
   fs->free_clust = 0xFFFFFFFF;
+# if _FREEMAP_SIZE
+  fs->fmap_span = (maxclust + _FREEMAP_SIZE - 1) / _FREEMAP_SIZE;
+  memset(fs->fmap, 0xff, sizeof(fs->fmap));  /* All parts unknown */
+# endif
 # if _USE_FSINFO
   /* Get fsinfo if needed */
   if (fmt == FS_FAT32) {
@@ -1512,6 +1955,9 @@ FRESULT f_open (
   fp->fptr = 0;                                     /* Initialize file pointer */
   fp->csect = 1;                                    /* Sector counter */
   fp->fs = fs; //fp->id = fs->id;       /* Owner file system object of the file */
+#if _USE_FASTSEEK
+  fp->cltbl = NULL;                                 /* No cluster link map */
+#endif
 
 #if !_FS_READONLY
   if (mode & (FA_CREATE_ALWAYS|FA_OPEN_ALWAYS|FA_CREATE_NEW))
@@ -1533,9 +1979,160 @@ FRESULT l_opencluster (
   fp->fptr = 0;
   fp->csect = 1;
   fp->fs = fs;
+#if _USE_FASTSEEK
+  fp->cltbl = NULL;
+#endif
+
+  return FR_OK;
+}
+
+
+#if _USE_FASTSEEK
+FRESULT l_createlinkmap (
+  FIL *fp,             /* Pointer to the file object */
+  DWORD *tbl,          /* Pointer to the map */
+  UINT size            /* Size of the map in DWORDs, see LINKMAP_SIZE */
+)
+{
+  FRESULT res;
+  DWORD clust, next, ccnt = 0;
+  UINT runs = 0;
+  FATFS *fs = fp->fs;
+
+
+  fp->cltbl = NULL;
+  res = validate(fs /*, fp->id*/);          /* Check validity of the object */
+  if (res != FR_OK) return res;
+  if (size < LINKMAP_SIZE(1)) return FR_DENIED;
+
+  /* Only the first runs are mapped if the file is too fragmented for the map */
+  clust = fp->org_clust;
+  while (clust >= 2 && clust < fs->max_clust && LINKMAP_SIZE(runs) < size) {
+    tbl[2 * runs + 1] = ccnt;               /* Start of a new run */
+    tbl[2 * runs + 2] = clust;
+    runs++;
+    do {                                    /* Skip consecutive clusters */
+      ccnt++;
+      next = get_cluster(fs, clust);
+      if (next == 1) return FR_RW_ERROR;
+    } while (next == ++clust);
+    clust = next;
+  }
+  tbl[0] = runs;
+  tbl[2 * runs + 1] = ccnt;                 /* End marker */
+  fp->cltbl = tbl;
 
   return FR_OK;
 }
+#endif
+
+
+
+DWORD l_contiguous (    /* First sector of the file, 0: not contiguous or failed */
+  FIL *fp               /* Pointer to the file object */
+)
+{
+  DWORD clust, next, ncl;
+  FATFS *fs = fp->fs;
+
+
+  if (validate(fs /*, fp->id*/) != FR_OK || fp->fsize == 0) return 0;
+
+  /* Check that the clusters covering the file size are consecutive */
+  clust = fp->org_clust;
+  ncl = (fp->fsize - 1) / ((DWORD)fs->csize * SS(fs));
+  while (ncl--) {
+    next = get_cluster(fs, clust);
+    if (next != clust + 1) return 0;
+    clust = next;
+  }
+  return clust2sect(fs, fp->org_clust);
+}
+
+
+FRESULT l_readsector (
+  FIL *fp,             /* Pointer to the file object */
+  DWORD sector,        /* Sector number on the drive */
+  UINT ofs,            /* Offset in the sector */
+  void *buff,          /* Pointer to data buffer */
+  UINT btr             /* Number of bytes to read, ofs+btr <= sector size */
+)
+{
+  FRESULT res;
+  const BYTE *data;
+  FATFS *fs = fp->fs;
+
+
+  res = validate(fs /*, fp->id*/);              /* Check validity of the object */
+  if (res != FR_OK) return res;
+  if (fp->flag & FA__ERROR) return FR_RW_ERROR; /* Check error flag */
+  if (!(fp->flag & FA_READ)) return FR_DENIED;  /* Check access mode */
+  data = read_sector_ptr(fs, &FSBUF, sector);
+  if (!data) return FR_RW_ERROR;
+  memcpy(buff, &data[ofs], btr);
+  return FR_OK;
+}
+
+
+#if !_FS_READONLY
+FRESULT l_writesector (
+  FIL *fp,             /* Pointer to the file object */
+  DWORD sector,        /* Sector number on the drive */
+  UINT ofs,            /* Offset in the sector */
+  const void *buff,    /* Pointer to the data to be written */
+  UINT btw             /* Number of bytes to write, ofs+btw <= sector size */
+)
+{
+  FRESULT res;
+  FATFS *fs = fp->fs;
+
+
+  res = validate(fs /*, fp->id*/);              /* Check validity of the object */
+  if (res != FR_OK) return res;
+  if (fp->flag & FA__ERROR) return FR_RW_ERROR; /* Check error flag */
+  if (!(fp->flag & FA_WRITE)) return FR_DENIED; /* Check access mode */
+  if (!move_fs_window(fs, sector)) return FR_RW_ERROR;
+  memcpy(&FSBUF.data[ofs], buff, btw);
+  FSBUF.dirty = TRUE;
+  fp->flag |= FA__WRITTEN;                      /* Set file changed flag */
+  return FR_OK;
+}
+#endif
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Move a file to its next sector for reading                            */
+/*-----------------------------------------------------------------------*/
+
+static
+BOOL next_file_sector ( /* TRUE: successful, FALSE: invalid cluster chain */
+  FIL *fp               /* Pointer to the file object, at a sector boundary */
+)
+{
+  DWORD clust;
+  FATFS *fs = fp->fs;
+
+
+  if (--fp->csect) {                        /* Decrement left sector counter */
+    fp->curr_sect++;                        /* Next sector in the cluster */
+  } else {                                  /* On the cluster boundary, get next cluster */
+#if _USE_FASTSEEK
+    clust = fp->cltbl ?
+      clmt_clust(fp, fp->fptr / ((DWORD)fs->csize * SS(fs))) : 0;
+    if (!clust)
+#endif
+    clust = (fp->fptr == 0) ?
+      fp->org_clust : get_cluster(fs, fp->curr_clust);
+    if (clust < 2 || clust >= fs->max_clust)
+      return FALSE;
+    fp->curr_clust = clust;                 /* Current cluster */
+    fp->curr_sect = clust2sect(fs, clust);  /* Get current sector */
+    fp->csect = fs->csize;                  /* Re-initialize the left sector counter */
+  }
+  return TRUE;
+}
+
 
 
 
@@ -1551,9 +2148,10 @@ FRESULT f_read (
 )
 {
   FRESULT res;
-  DWORD clust, sect, remain;
+  DWORD remain;
   UINT rcnt, cc;
   BYTE *rbuff = buff;
+  const BYTE *data;
   FATFS *fs = fp->fs;
 
 
@@ -1568,25 +2166,14 @@ FRESULT f_read (
   for ( ;  btr;                                 /* Repeat until all data transferred */
     rbuff += rcnt, fp->fptr += rcnt, *br += rcnt, btr -= rcnt) {
     if ((fp->fptr & (SS(fs) - 1)) == 0) {       /* On the sector boundary */
-      if (--fp->csect) {                        /* Decrement left sector counter */
-        sect = fp->curr_sect + 1;               /* Get current sector */
-      } else {                                  /* On the cluster boundary, get next cluster */
-        clust = (fp->fptr == 0) ?
-          fp->org_clust : get_cluster(fs, fp->curr_clust);
-        if (clust < 2 || clust >= fs->max_clust)
-          goto fr_error;
-        fp->curr_clust = clust;                 /* Current cluster */
-        sect = clust2sect(fs, clust);           /* Get current sector */
-        fp->csect = fs->csize;                  /* Re-initialize the left sector counter */
-      }
-#if !_FS_READONLY
-      if(!move_fp_window(fp,0)) goto fr_error;
-#endif
-      fp->curr_sect = sect;           /* Update current sector */
+      if (!next_file_sector(fp)) goto fr_error;
       cc = btr / SS(fs);              /* When left bytes >= SS(fs), */
       if (cc) {                       /* Read maximum contiguous sectors directly */
         if (cc > fp->csect) cc = fp->csect;
-        if (disk_read(fs->drive, rbuff, sect, (BYTE)cc) != RES_OK)
+#if !_FS_READONLY
+        if(!move_fp_window(fp,0)) goto fr_error;
+#endif
+        if (cache_read(fs, rbuff, fp->curr_sect, (BYTE)cc) != RES_OK)
           goto fr_error;
         fp->csect -= (BYTE)(cc - 1);
         fp->curr_sect += cc - 1;
@@ -1597,8 +2184,9 @@ FRESULT f_read (
     if(btr) {  /* if we actually have bytes to read in singles, copy them in */
       rcnt = SS(fs) - ((WORD)fp->fptr & (SS(fs) - 1));       /* Copy fractional bytes from file I/O buffer */
       if (rcnt > btr) rcnt = btr;
-      if(!move_fp_window(fp,fp->curr_sect)) goto fr_error;   /* are we there or not? */
-      memcpy(rbuff, &FPBUF.data[fp->fptr & (SS(fs) - 1)], rcnt);
+      data = read_sector_ptr(fs, &FPBUF, fp->curr_sect);
+      if (!data) goto fr_error;
+      memcpy(rbuff, &data[fp->fptr & (SS(fs) - 1)], rcnt);
     }
   }
 
@@ -1610,6 +2198,122 @@ fr_error: /* Abort this file due to an unrecoverable error */
 }
 
 
+/**
+ * l_readptr - read from a file without copying the data
+ * @fp : Pointer to the file object
+ * @ptr: Pointer to the variable for the data pointer
+ * @btr: Maximum number of bytes to read
+ * @br : Pointer to the variable for the number of bytes read
+ *
+ * This function works like f_read, but instead of copying the data it
+ * returns a pointer to it in the sector window or sector cache. At most
+ * the rest of the current sector is returned, so *br can be less than
+ * btr even before the end of the file. The data must not be modified
+ * and is only valid until the next call of any FatFs function.
+ */
+FRESULT l_readptr (
+  FIL *fp,             /* Pointer to the file object */
+  const BYTE **ptr,    /* Pointer to the data pointer */
+  UINT btr,            /* Maximum number of bytes to read */
+  UINT *br             /* Pointer to number of bytes read */
+)
+{
+  FRESULT res;
+  DWORD remain;
+  UINT ofs;
+  const BYTE *data;
+  FATFS *fs = fp->fs;
+
+
+  *br = 0;
+  res = validate(fs /*, fp->id*/);              /* Check validity of the object */
+  if (res != FR_OK) return res;
+  if (fp->flag & FA__ERROR) return FR_RW_ERROR; /* Check error flag */
+  if (!(fp->flag & FA_READ)) return FR_DENIED;  /* Check access mode */
+  remain = fp->fsize - fp->fptr;
+  if (btr > remain) btr = (UINT)remain;         /* Truncate read count by number of bytes left */
+  if (!btr) return FR_OK;
+
+  ofs = (UINT)fp->fptr & (SS(fs) - 1);
+  if (ofs == 0 && !next_file_sector(fp))       /* On the sector boundary */
+    goto fr_error;
+  if (btr > SS(fs) - ofs) btr = SS(fs) - ofs;   /* Stay within the sector */
+  data = read_sector_ptr(fs, &FPBUF, fp->curr_sect);
+  if (!data) goto fr_error;
+
+  *ptr = data + ofs;
+  fp->fptr += btr;
+  *br = btr;
+  return FR_OK;
+
+fr_error: /* Abort this file due to an unrecoverable error */
+  fp->flag |= FA__ERROR;
+  return FR_RW_ERROR;
+}
+
+
+
+
+#if _CACHE_WAYS != 0
+/*-----------------------------------------------------------------------*/
+/* Read-ahead into the sector cache                                      */
+/*-----------------------------------------------------------------------*/
+
+/**
+ * l_prefetch - load the next sector of a file into the sector cache
+ * @fp: Pointer to the file object
+ *
+ * This function reads the first sector after the file position that
+ * is not the current one into the sector cache, so a sequential read
+ * that reaches it later does not have to wait for the disk. The file
+ * object itself is not changed.
+ */
+FRESULT l_prefetch (
+  FIL *fp              /* Pointer to the file object */
+)
+{
+  FRESULT res;
+  FIL next;
+  FATFS *fs = fp->fs;
+
+
+  res = validate(fs /*, fp->id*/);              /* Check validity of the object */
+  if (res != FR_OK) return res;
+  if (fp->flag & FA__ERROR) return FR_RW_ERROR; /* Check error flag */
+  if (!(fp->flag & FA_READ)) return FR_DENIED;  /* Check access mode */
+
+  next = *fp;
+  next.fptr = (fp->fptr + SS(fs) - 1) & ~(DWORD)(SS(fs) - 1);
+  if (next.fptr >= fp->fsize) return FR_OK;     /* Nothing left to read */
+  if (!next_file_sector(&next)) return FR_RW_ERROR;
+  return cache_prefetch(fs, next.curr_sect);
+}
+
+
+/**
+ * l_prefetchsector - load a sector into the sector cache
+ * @fp    : Pointer to the file object
+ * @sector: Sector number on the drive
+ *
+ * This function reads the given sector of the drive of the file
+ * into the sector cache, see l_readsector.
+ */
+FRESULT l_prefetchsector (
+  FIL *fp,             /* Pointer to the file object */
+  DWORD sector         /* Sector number on the drive */
+)
+{
+  FRESULT res;
+
+
+  res = validate(fp->fs /*, fp->id*/);          /* Check validity of the object */
+  if (res != FR_OK) return res;
+  if (fp->flag & FA__ERROR) return FR_RW_ERROR; /* Check error flag */
+  return cache_prefetch(fp->fs, sector);
+}
+#endif
+
+
 
 
 #if !_FS_READONLY
@@ -1649,6 +2353,11 @@ FRESULT f_write (
           if (clust == 0)                         /* No cluster is created yet */
             fp->org_clust = clust = create_chain(fs, 0);    /* Create a new cluster chain */
         } else {                                  /* Middle or end of file */
+#if _USE_FASTSEEK
+          clust = fp->cltbl ?
+            clmt_clust(fp, fp->fptr / ((DWORD)fs->csize * SS(fs))) : 0;
+          if (!clust)
+#endif
           clust = create_chain(fs, fp->curr_clust);         /* Trace or streach cluster chain */
         }
         if (clust == 0) break;                    /* Disk full */
@@ -1662,7 +2371,7 @@ FRESULT f_write (
       cc = btw / SS(fs);                          /* When left bytes >= SS(fs), */
       if (cc) {                                   /* Write maximum contiguous sectors directly */
         if (cc > fp->csect) cc = fp->csect;
-        if (disk_write(fs->drive, wbuff, sect, (BYTE)cc) != RES_OK)
+        if (cache_write(fs, wbuff, sect, (BYTE)cc) != RES_OK)
           goto fw_error;
         fp->csect -= (BYTE)(cc - 1);
         fp->curr_sect += cc - 1;
@@ -1798,6 +2507,14 @@ FRESULT f_lseek (
     } else {
       fp->csect = 1;
 
+#if _USE_FASTSEEK
+      if (fp->cltbl && (clust = clmt_clust(fp, (ofs - 1) / csize)) != 0) {
+        /* Target cluster is in the link map */
+        fp->curr_clust = clust;
+        fp->fptr = ofs;
+        ofs -= ((ofs - 1) / csize) * csize;       /* Offset in the cluster, 1..csize */
+      } else {
+#endif
       if(fp->fptr && ofs > fp->fptr) {
         fp->fptr = (((DWORD)((fp->fptr-1)/csize))*csize);  /* Set file R/W pointer to start of cluster */
         ofs-=fp->fptr;            /* subtract off clusters traversed */
@@ -1833,6 +2550,9 @@ FRESULT f_lseek (
         }
         fp->fptr += ofs;                            /* Update file R/W pointer */
       }
+#if _USE_FASTSEEK
+      }
+#endif
     }
     csect = (CHAR)((ofs - 1) / SS(fs));         /* Sector offset in the cluster */
     fp->curr_sect = clust2sect(fs, fp->curr_clust) + csect;  /* Current sector */
@@ -1956,6 +2676,30 @@ FRESULT l_opendir(FATFS* fs, DWORD cluster, DIR *dj) {
 }
 
 
+/**
+ * l_seekdir - move a directory object to a known position
+ * @dj     : Pointer to the DIR structure, opened with l_opendir
+ * @index  : Index of the entry within the directory
+ * @cluster: Cluster containing the entry (0 for a FAT12/16 root directory)
+ *
+ * This function sets the position of a directory object to the one it
+ * had when dj->index was index and dj->clust was cluster, e.g. to re-read
+ * an entry seen during an earlier scan without following the cluster
+ * chain again. Always returns FR_OK.
+ */
+FRESULT l_seekdir(DIR *dj, WORD index, DWORD cluster) {
+  FATFS *fs = dj->fs;
+
+  dj->index = index;
+  dj->clust = cluster;
+  if (cluster == 0)
+    dj->sect = fs->dirbase + index / (SS(fs) / 32);
+  else
+    dj->sect = clust2sect(fs, cluster) + ((index / (SS(fs) / 32)) & (fs->csize - 1));
+  return FR_OK;
+}
+
+
 
 
 
@@ -2125,6 +2869,9 @@ FRESULT f_truncate (
   if (fp->fsize > fp->fptr) {
     fp->fsize = fp->fptr; /* Set file size to current R/W point */
     fp->flag |= FA__WRITTEN;
+#if _USE_FASTSEEK
+    fp->cltbl = NULL;     /* The map may contain removed clusters */
+#endif
     if (fp->fptr == 0) {  /* When set file size to zero, remove entire cluster chain */
       if (!remove_chain(fp->fs, fp->org_clust)) goto ft_error;
       fp->org_clust = 0;
@@ -2160,8 +2907,6 @@ FRESULT l_getfree (
 )
 {
   FRESULT res;
-  DWORD n, clust, sect;
-  BYTE fat, f, *p;
 
   /* Get drive number */
   res = auto_mount(&drv, &fs, 0);
@@ -2173,45 +2918,7 @@ FRESULT l_getfree (
     return FR_OK;
   }
 
-  /* Get number of free clusters */
-  fat = fs->fs_type;
-  n = 0;
-  if (fat == FS_FAT12) {
-    clust = 2;
-    do {
-      if ((WORD)get_cluster(fs, clust) == 0) n++;
-    } while (++clust < fs->max_clust);
-  } else {
-    clust = fs->max_clust;
-    sect = fs->fatbase;
-    f = 0; p = 0;
-    do {
-      if (maxclust && n >= maxclust) {
-        n = maxclust;
-        break;
-      }
-      if (!f) {
-        if (!move_fs_window(fs, sect++)) return FR_RW_ERROR;
-        p = FSBUF.data;
-      }
-      if (fat == FS_FAT16) {
-        if (LD_WORD(p) == 0) n++;
-        p += 2; f += 1;
-      } else {
-        if (LD_DWORD(p) == 0) n++;
-        p += 4; f += 2;
-      }
-    } while (--clust);
-  }
-  if (n < maxclust) {
-    fs->free_clust = n;
-#if _USE_FSINFO
-    if (fat == FS_FAT32) fs->fsi_flag = 1;
-#endif
-  }
-
-  *nclust = n;
-  return FR_OK;
+  return count_free(fs, nclust, maxclust);
 }
 
 /*-----------------------------------------------------------------------*/
@@ -2388,7 +3095,7 @@ FRESULT f_mkdir (
   fw = FSBUF.data;
   memset(fw, 0, SS(fs));                       /* Clear the new directory table */
   for (n = 1; n < fs->csize; n++) {
-    if (disk_write(fs->drive, fw, ++dsect, 1) != RES_OK)
+    if (cache_write(fs, fw, ++dsect, 1) != RES_OK)
       return FR_RW_ERROR;
   }
   memset(&fw[DIR_Name], ' ', 8+3);             /* Create "." entry */
@@ -96,6 +96,44 @@
 /  operate slower.  This option can only be set if _USE_FS_BUF is set.  */
 #define _USE_1_BUF 1
 
+/* Number of sectors kept in a write-back cache behind the static buffer,
+/  0 disables the cache. The cache is _CACHE_WAYS-way set associative with
+/  _CACHE_SETS sets (must be a power of 2) and LRU replacement, moving the
+/  buffer to a cached sector is just a copy instead of a disk access.
+/  This option can only be set if _USE_1_BUF is set.  */
+#ifdef CONFIG_SECTOR_CACHE_WAYS
+#  define _CACHE_WAYS CONFIG_SECTOR_CACHE_WAYS
+#else
+#  define _CACHE_WAYS 0
+#endif
+#ifdef CONFIG_SECTOR_CACHE_SETS
+#  define _CACHE_SETS CONFIG_SECTOR_CACHE_SETS
+#else
+#  define _CACHE_SETS 1
+#endif
+
+/* When _USE_FASTSEEK is set to 1, a file can be given a cluster link map
+/  with l_createlinkmap. f_lseek, f_read and f_write then look up clusters
+/  in the map instead of following the FAT chain.  */
+#ifdef CONFIG_IMAGE_LINKMAP
+#  define _USE_FASTSEEK 1
+#else
+#  define _USE_FASTSEEK 0
+#endif
+
+/* _FREEMAP_SIZE sets the number of entries in the free cluster map. Each
+/  entry counts the free clusters in one part of the FAT, so the allocator
+/  can skip parts without free clusters without reading them. The parts
+/  start out unknown after mounting; a part is counted by a free cluster
+/  scan and marked full when the allocator searched all of it without
+/  success. 0 disables the map.  */
+#ifdef CONFIG_FAT_FREEMAP
+#  define _FREEMAP_SIZE CONFIG_FAT_FREEMAP
+#  define FMAP_UNKNOWN  0xFFFFFFFF
+#else
+#  define _FREEMAP_SIZE 0
+#endif
+
 /* If set to 1, FatFs will manage the FATFS structures after mounting.  If
 /  set to 0, the caller must send the correct drive FATFS structure for each
 /  call.  Normally, this should be set to 1, but if the caller wants to use
@@ -135,6 +173,10 @@
 #define _USE_1_BUF 0
 #endif
 
+#if _CACHE_WAYS != 0 && _USE_1_BUF == 0
+#error The sector cache requires _USE_1_BUF
+#endif
+
 typedef struct _BUF {
   DWORD sect;
   BYTE  dirty;              /* dirty flag (1:must be written back) */
@@ -165,6 +207,10 @@ typedef struct _FATFS {
     BYTE    fsi_flag;       /* fsinfo dirty flag (1:must be written back) */
   //BYTE    pad2;
 #endif
+#if _FREEMAP_SIZE
+    DWORD   fmap_span;      /* Clusters per free map entry */
+    DWORD   fmap[_FREEMAP_SIZE]; /* Number of free clusters in each part of the FAT, FMAP_UNKNOWN: not counted */
+#endif
 #endif
     BYTE    fs_type;        /* FAT sub type */
     BYTE    csize;          /* Number of sectors per cluster */
@@ -204,6 +250,9 @@ typedef struct _FIL {
     DWORD   dir_sect;       /* Sector containing the directory entry */
     BYTE*   dir_ptr;        /* Ponter to the directory entry in the window */
 #endif
+#if _USE_FASTSEEK
+    DWORD*  cltbl;          /* Pointer to the cluster link map (NULL: not used) */
+#endif
 #if _USE_LESS_BUF == 0 && _USE_1_BUF == 0
     BUF   buf;              /* File R/W buffer */
 #endif
@@ -313,8 +362,24 @@ FRESULT f_chdir (const UCHAR*);                             /* Change current di
 
 /* Low Level functions */
 FRESULT l_opendir(FATFS* fs, DWORD cluster, DIR *dirobj);   /* Open an existing directory by its start cluster */
+FRESULT l_seekdir(DIR *dirobj, WORD index, DWORD cluster); /* Move a directory object to a known entry */
 FRESULT l_opencluster(FATFS *fs, FIL *fp, DWORD clust);     /* Open a cluster by number as a read-only file */
 FRESULT l_getfree (FATFS*, const UCHAR*, DWORD*, DWORD);    /* Get number of free clusters on the drive, limited */
+DWORD l_contiguous (FIL*);                                  /* Get the first sector of a contiguous file */
+FRESULT l_readsector (FIL*, DWORD, UINT, void*, UINT);      /* Read from a sector of a file directly */
+FRESULT l_readptr (FIL*, const BYTE**, UINT, UINT*);        /* Read from a file without copying the data */
+FRESULT l_writesector (FIL*, DWORD, UINT, const void*, UINT); /* Write to a sector of a file directly */
+#if _USE_FASTSEEK
+FRESULT l_createlinkmap (FIL*, DWORD*, UINT);               /* Create a cluster link map for an open file */
+#define LINKMAP_SIZE(runs) (2 * (runs) + 2)                 /* Number of DWORDs in a map for runs fragments */
+#endif
+
+#if _CACHE_WAYS != 0
+FRESULT l_prefetch (FIL*);                                  /* Load the next sector of a file into the cache */
+FRESULT l_prefetchsector (FIL*, DWORD);                     /* Load a sector into the cache */
+extern DWORD ff_cache_hits, ff_cache_misses;                /* Sector cache statistics */
+extern DWORD ff_readahead_fills, ff_readahead_hits;         /* Read-ahead statistics */
+#endif
 
 #if _USE_STRFUNC
 #define feof(fp) ((fp)->fptr == (fp)->fsize)
@@ -25,16 +25,18 @@
    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 
-   fl-burst.c: Handling of burst fastload command
+   fl-burst.c: Handling of burst fastload, read and write commands
 
 */
 
 #include "config.h"
 #include "buffers.h"
+#include "d64ops.h"
 #include "display.h"
 #include "doscmd.h"
 #include "errormsg.h"
 #include "iec-bus.h"
+#include "iec.h"
 #include "parser.h"
 #include "wrapops.h"
 #include "fastloader-ll.h"
@@ -45,17 +47,37 @@
 #define BURST_STATUS_DRIVE_NOT_READY  0b01111
 #define BURST_STATUS_EOI              0b11111 // fastload only
 
+/* command byte bits of burst read/write */
+#define BURST_FLAG_IGNORE_ERRORS      0b01000000
+#define BURST_FLAG_SIDE               0b00010000
+
 static uint8_t clk_state;
+static uint8_t rx_clock;
+
+/* send fast serial bytes with handshake, returns 1 if aborted by ATN */
+static uint8_t burst_send_block(const uint8_t *data, uint8_t count) {
+  uint8_t sent = fs_send_block(data, count, clk_state);
+
+  clk_state ^= sent & 1;
+  return sent != count;
+}
 
 /* send fast serial byte with handshake */
 static void burst_send_byte(uint8_t b) {
-  while ((!IEC_CLOCK) == clk_state) {
+  burst_send_block(&b, 1);
+}
+
+/* receive fast serial byte, requested by toggling Clock, -1 on ATN */
+static int16_t burst_get_byte(void) {
+  rx_clock = !rx_clock;
+  set_clock(rx_clock);
+
+  while (!fs_byte_ready()) {
     if (!IEC_ATN)
-      return;
+      return -1;
   }
 
-  fs_send_byte(b);
-  clk_state = !clk_state;
+  return fs_read_byte();
 }
 
 /* map dos error code to back to job error for use in burst status */
@@ -75,7 +97,7 @@ void burst_fastload(void) {
   uint8_t *fname;
   path_t path;
   buffer_t *buf;
-  uint8_t i, first;
+  uint8_t first;
 
   command_buffer[command_length] = '\0';
   clk_state = 0;
@@ -126,12 +148,11 @@ void burst_fastload(void) {
       burst_send_byte(buf->lastused - (first ? 3 : 1));
     }
 
-    i = 2;
-    do {
-      burst_send_byte(buf->data[i]);
-      if (!IEC_ATN)
-        goto abort;
-    } while (i++ < buf->lastused);
+    /* The whole block is streamed by the low-level code, */
+    /* each byte only waits for the Clock toggle.         */
+    if (burst_send_block(buf->data + 2,
+                         buf->lastused > 2 ? buf->lastused - 1 : 1))
+      goto abort;
 
     if (buf->sendeoi)
       break;
@@ -143,3 +164,123 @@ void burst_fastload(void) {
 abort:
   cleanup_and_free_buffer(buf);
 }
+
+/**
+ * burst_sectors - handle the burst read and write commands
+ * @write: flags a write command
+ *
+ * This function handles "U0" with the burst read (TEBS0000) and
+ * write (TEBS0010) command bytes, followed by track, sector, number
+ * of sectors and an optional track to continue on after the end of
+ * the current one. For every sector a status byte is sent, which is
+ * followed by the sector contents when reading. When writing, the
+ * status is sent after the sector contents have been received; the
+ * device requests each of these bytes by toggling Clock and releases
+ * it before the computer pulls it low to request the status.
+ * Sectors are read through the normal sector access of the partition,
+ * which only reads a whole track of a disk image at once if the image
+ * cache is enabled. The command is rejected like on a 1571 if the
+ * computer does not use fast serial.
+ */
+void burst_sectors(uint8_t write) {
+  uint8_t  part = current_part;
+  uint8_t  flags = command_buffer[2];
+  uint8_t  track, count, nexttrack, status;
+  uint16_t sector, spt = 256;  /* DNP tracks have 256 sectors */
+  int16_t  byte;
+  buffer_t *buf;
+
+  /* Like on a 1571, the command does not exist without fast serial */
+  if (!(iec_data.iecflags & FAST_SERIAL)) {
+    set_error(ERROR_SYNTAX_UNABLE);
+    return;
+  }
+
+  if (command_length < 6) {
+    set_error(ERROR_SYNTAX_UNKNOWN);
+    return;
+  }
+
+  track     = command_buffer[3];
+  sector    = command_buffer[4];
+  count     = command_buffer[5];
+  nexttrack = command_length > 6 ? command_buffer[6] : 0;
+
+  /* The side select bit addresses the second side of a D71 */
+  if ((flags & BURST_FLAG_SIDE) &&
+      (partition[part].imagetype & D64_TYPE_MASK) == D64_TYPE_D71) {
+    track += 35;
+    if (nexttrack)
+      nexttrack += 35;
+  }
+
+  buf = alloc_system_buffer();
+  if (!buf)
+    return;
+
+  clk_state = 0;
+  rx_clock  = 1;
+
+  while (count--) {
+    set_error(ERROR_OK);
+
+    if (write) {
+      uint16_t i;
+
+      fs_reset();
+      for (i = 0; i < 256; i++) {
+        byte = burst_get_byte();
+        if (byte < 0)
+          goto abort;
+        buf->data[i] = byte;
+      }
+
+      /* release Clock for the status handshake */
+      rx_clock = 1;
+      set_clock(1);
+
+      write_sector(buf, part, track, sector);
+    } else {
+      read_sector(buf, part, track, sector);
+    }
+
+    if (current_error == ERROR_OK)
+      status = BURST_STATUS_OK;
+    else
+      status = translate_error(current_error);
+
+    /* after a write, the status is requested by pulling Clock low */
+    if (write)
+      clk_state = 0;
+
+    if (burst_send_block(&status, 1))
+      goto abort;
+
+    if (status != BURST_STATUS_OK && !(flags & BURST_FLAG_IGNORE_ERRORS))
+      break;
+
+    if (!write) {
+      if (burst_send_block(buf->data, 128) ||
+          burst_send_block(buf->data + 128, 128))
+        goto abort;
+    }
+
+    /* Continue with the next sector, wrap to the next track */
+    if (partition[part].fop == &d64ops)
+      spt = d64_sectors_per_track(part, track);
+
+    if (++sector >= spt) {
+      sector = 0;
+      if (nexttrack) {
+        track     = nexttrack;
+        nexttrack = 0;
+      } else {
+        track++;
+      }
+    }
+  }
+
+ abort:
+  set_clock(1);
+  free_buffer(buf);
+}
@@ -0,0 +1,215 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+   arch-config.h: The main architecture-specific config header
+
+   The "hostsim" architecture runs the firmware as a Linux process.
+   All hardware is simulated in software, see the other files in
+   this directory.
+
+*/
+
+#ifndef ARCH_CONFIG_H
+#define ARCH_CONFIG_H
+
+#include <stdint.h>
+#include "bitband.h"
+
+/* AVR compatibility macro */
+#define BV(x) (1<<(x))
+
+/* Return value of buttons_read() */
+typedef unsigned int rawbutton_t;
+
+/* System tick, called from the timer signal handler in arch-timer.c */
+#define SYSTEM_TICK_HANDLER void hostsim_tick_handler(void)
+
+/* IEC in/out are always seperate */
+#define IEC_SEPARATE_OUT
+
+/* Standard serial bytes are sent by lpc17xx/iec-tx.c, see iec-bus.c */
+#define HAVE_IEC_TX
+
+/* Interrupt handler names for ATN/CLOCK changes and the transmitter */
+#define IEC_ATN_HANDLER    void iec_atn_handler(void)
+#define IEC_CLOCK_HANDLER  void iec_clock_handler(void)
+#define IEC_TX_HANDLER     void iec_tx_handler(void)
+
+static inline void device_hw_address_init(void) {
+  // Nothing, the address comes from the environment
+}
+
+static inline void iec_interrupts_init(void) {
+  // Nothing
+}
+
+#define P00CACHE_ATTRIB
+#define FULLBAM_ATTRIB
+#define IMAGECACHE_ATTRIB
+
+
+#if CONFIG_HARDWARE_VARIANT == 1
+/* ---------- Hardware configuration: Linux process ---------- */
+#  define HAVE_SD
+
+/* card-image.c */
+static inline void sdcard_interface_init(void) {
+  // Nothing, sd_init opens the image file
+}
+
+uint8_t sdcard_detect(void);
+uint8_t sdcard_wp(void);
+
+/* system.c */
+extern uint8_t hostsim_device_address;
+
+static inline uint8_t device_hw_address(void) {
+  return hostsim_device_address;
+}
+
+#define HAVE_SD_LED
+
+/* LED state, bit 0 busy, 1 dirty, 2 test, 3 SD */
+extern volatile uint8_t hostsim_leds;
+
+static inline void leds_init(void) {
+  hostsim_leds = 0;
+}
+
+static inline void set_busy_led(uint8_t state) {
+  if (state)
+    hostsim_leds |= BV(0);
+  else
+    hostsim_leds &= (uint8_t)~BV(0);
+}
+
+static inline void set_dirty_led(uint8_t state) {
+  if (state)
+    hostsim_leds |= BV(1);
+  else
+    hostsim_leds &= (uint8_t)~BV(1);
+}
+
+static inline void set_test_led(uint8_t state) {
+  if (state)
+    hostsim_leds |= BV(2);
+  else
+    hostsim_leds &= (uint8_t)~BV(2);
+}
+
+static inline void set_sd_led(uint8_t state) {
+  if (state)
+    hostsim_leds |= BV(3);
+  else
+    hostsim_leds &= (uint8_t)~BV(3);
+}
+
+static inline void toggle_dirty_led(void) {
+  hostsim_leds ^= BV(1);
+}
+
+/* Buttons are never pressed, keys are injected by hostbus.c instead */
+#  define BUTTON_NEXT           BV(0)
+#  define BUTTON_PREV           BV(1)
+
+static inline rawbutton_t buttons_read(void) {
+  return BUTTON_NEXT | BUTTON_PREV;
+}
+
+static inline void buttons_init(void) {
+  // None
+}
+
+#else
+#  error "CONFIG_HARDWARE_VARIANT is unset or set to an unknown value."
+#endif
+
+
+/* ---------------- End of user-configurable options ---------------- */
+
+/* IEC lines, see iec-bus.c. A set bit means the line is high. */
+#define IEC_BIT_ATN      BV(0)
+#define IEC_BIT_DATA     BV(1)
+#define IEC_BIT_CLOCK    BV(2)
+#define IEC_BIT_SRQ      BV(3)
+
+/* Return type of iec_bus_read() */
+typedef uint32_t iec_bus_t;
+
+iec_bus_t hostsim_iec_input(void);
+void hostsim_iec_output(iec_bus_t line, unsigned int state);
+void hostsim_set_atn_irq(uint8_t state);
+
+#define IEC_INPUT hostsim_iec_input()
+
+static inline void set_atn(unsigned int state) {
+  hostsim_iec_output(IEC_BIT_ATN, state);
+}
+
+static inline void set_clock(unsigned int state) {
+  hostsim_iec_output(IEC_BIT_CLOCK, state);
+}
+
+static inline void set_data(unsigned int state) {
+  hostsim_iec_output(IEC_BIT_DATA, state);
+}
+
+static inline void set_srq(unsigned int state) {
+  hostsim_iec_output(IEC_BIT_SRQ, state);
+}
+
+/* Match unit of the LPC17xx timer for CLOCK and DATA, see iec-bus.c */
+typedef struct {
+  volatile uint32_t IR;       /* not evaluated */
+  volatile uint32_t TC;       /* 100ns steps of the virtual time */
+  volatile uint32_t MCR[32];  /* only accessed with BITBAND */
+  volatile uint32_t MR0;
+  volatile uint32_t MR1;
+  volatile uint32_t EMR;
+} hostsim_timer_t;
+
+extern hostsim_timer_t hostsim_iec_timer;
+
+#define IEC_MTIMER_CLOCK (&hostsim_iec_timer)
+#define IEC_MTIMER_DATA  (&hostsim_iec_timer)
+#define IEC_OPIN_CLOCK   0
+#define IEC_OPIN_DATA    1
+#define IEC_MATCH_CLOCK  MR0
+#define IEC_MATCH_DATA   MR1
+
+/* ATN interrupt, simulated by iec-bus.c */
+#define set_atn_irq(x)   hostsim_set_atn_irq(x)
+
+/* Nothing uses the CLOCK interrupt on this architecture */
+#define set_clock_irq(x) do {} while (0)
+#define HAVE_CLOCK_IRQ
+
+/* SRQ edges are evaluated by iec-bus.c for the fast serial protocol */
+#define IEC_SRQ_INT
+
+/* Display interrupt request line */
+static inline void display_intrq_init(void) {
+}
+
+static inline unsigned int display_intrq_active(void) {
+  return 0;
+}
+
+#endif
@@ -0,0 +1,96 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+   arch-eeprom.c: EEPROM access functions
+
+   The EEPROM is simulated in RAM and starts out erased. Variables
+   declared with EEMEM are placed in their own section, pointers into
+   it are translated to EEPROM offsets relative to the section start.
+   Other pointer values are used as offsets directly, which is what
+   the checksum loop in eeprom-conf.c expects.
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+#include "arch-eeprom.h"
+
+#define EEPROM_SIZE 4096
+
+/* provided by the linker */
+extern uint8_t __start_hostsim_eeprom[], __stop_hostsim_eeprom[];
+
+static uint8_t eeprom[EEPROM_SIZE];
+static uint8_t initialized;
+
+/* converts from a pointer to an address in the EEPROM */
+static unsigned int convert_address(void *a) {
+  uint8_t *ptr = a;
+
+  if (!initialized) {
+    memset(eeprom, 0xff, sizeof(eeprom));
+    initialized = 1;
+  }
+
+  if (ptr >= __start_hostsim_eeprom && ptr < __stop_hostsim_eeprom)
+    return (ptr - __start_hostsim_eeprom) & (EEPROM_SIZE - 1);
+  else
+    return (uintptr_t)ptr & (EEPROM_SIZE - 1);
+}
+
+uint8_t eeprom_read_byte(void *addr) {
+  return eeprom[convert_address(addr)];
+}
+
+uint16_t eeprom_read_word(void *addr) {
+  uint16_t val;
+
+  eeprom_read_block(&val, addr, 2);
+  return val;
+}
+
+void eeprom_read_block(void *destptr, void *addr, unsigned int length) {
+  unsigned int address = convert_address(addr);
+  uint8_t *dest = destptr;
+
+  while (length--) {
+    *dest++ = eeprom[address];
+    address = (address + 1) & (EEPROM_SIZE - 1);
+  }
+}
+
+void eeprom_write_byte(void *addr, uint8_t value) {
+  eeprom[convert_address(addr)] = value;
+}
+
+void eeprom_write_word(void *addr, uint16_t value) {
+  eeprom_write_block(&value, addr, 2);
+}
+
+void eeprom_write_block(void *srcptr, void *addr, unsigned int length) {
+  unsigned int address = convert_address(addr);
+  uint8_t *src = srcptr;
+
+  while (length--) {
+    eeprom[address] = *src++;
+    address = (address + 1) & (EEPROM_SIZE - 1);
+  }
+}
@@ -0,0 +1,130 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+   arch-timer.c: Architecture-specific timer functions
+
+   The system tick is generated by a SIGALRM interval timer,
+   all other times are read from CLOCK_MONOTONIC. In bus mode
+   everything runs on the virtual time of virtual-time.c instead.
+
+*/
+
+#include <signal.h>
+#include <sys/time.h>
+#include <time.h>
+#include "config.h"
+#include "hostsim.h"
+#include "timer.h"
+
+static uint64_t timeout_end = UINT64_MAX;
+
+uint64_t hostsim_time_ns(void) {
+  struct timespec ts;
+
+  if (hostsim_busmode)
+    return hostsim_vtime_ns();
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void timer_signal(int sig) {
+  (void)sig;
+  hostsim_timer_irq();
+}
+
+void timer_init(void) {
+  struct sigaction sa;
+  struct itimerval itv;
+
+  /* virtual-time.c generates the ticks */
+  if (hostsim_busmode)
+    return;
+
+  sa.sa_handler = timer_signal;
+  sa.sa_flags   = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGALRM, &sa, NULL);
+
+  itv.it_interval.tv_sec  = 0;
+  itv.it_interval.tv_usec = 1000000 / HZ;
+  itv.it_value = itv.it_interval;
+  setitimer(ITIMER_REAL, &itv, NULL);
+}
+
+/* busy-wait like the hardware does, sleeping is far too inaccurate */
+void delay_us(unsigned int time) {
+  uint64_t end = hostsim_time_ns() + time * 1000ULL;
+
+  if (hostsim_busmode) {
+    hostsim_advance(time * 1000ULL);
+    return;
+  }
+
+  while (hostsim_time_ns() < end) ;
+}
+
+void delay_ms(unsigned int time) {
+  struct timespec ts;
+  uint64_t end = hostsim_time_ns() + time * 1000000ULL;
+
+  if (hostsim_busmode) {
+    hostsim_advance(time * 1000000ULL);
+    return;
+  }
+
+  ts.tv_sec  = end / 1000000000ULL;
+  ts.tv_nsec = end % 1000000000ULL;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) ;
+}
+
+/**
+ * start_timeout - start a timeout
+ * @usecs: number of microseconds before timeout
+ *
+ * This function sets up a timer so it times out after the specified
+ * number of microseconds.
+ */
+void start_timeout(unsigned int usecs) {
+  timeout_end = hostsim_time_ns() + usecs * 1000ULL;
+}
+
+/**
+ * cancel_timeout - cancel a timeout
+ *
+ * This function stops the timer and resets the timeout flag, just in case.
+ */
+void cancel_timeout(void) {
+  timeout_end = UINT64_MAX;
+}
+
+/**
+ * has_timed_out - returns true if timeout was reached
+ *
+ * This function returns true if the timer started by start_timeout
+ * has reached its timeout value.
+ */
+unsigned int has_timed_out(void) {
+  /* timeouts are usually polled in a loop */
+  if (hostsim_busmode)
+    hostsim_advance(HOSTSIM_POLL_NS);
+
+  return hostsim_time_ns() >= timeout_end;
+}
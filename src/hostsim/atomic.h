@@ -0,0 +1,81 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+   atomic.h: ATOMIC_BLOCK emulation for the hostsim architecture
+
+   Same interface as avr-libc's <util/atomic.h>, but the "interrupt
+   flag" is a variable in system.c that defers the timer signal.
+
+*/
+
+#ifndef _UTIL_ATOMIC_H_
+#define _UTIL_ATOMIC_H_ 1
+
+#include "system.h"
+
+/* Returns true if interrupts are currently disabled (system.c) */
+unsigned int interrupts_disabled(void);
+
+static inline unsigned int __iSeiRetVal(void) {
+  enable_interrupts();
+  return 1;
+}
+
+static inline unsigned int __iCliRetVal(void) {
+  disable_interrupts();
+  return 1;
+}
+
+static inline void __iSeiParam(const unsigned int *__s) {
+  enable_interrupts();
+  (void)__s;
+}
+
+static inline void __iCliParam(const unsigned int *__s) {
+  disable_interrupts();
+  (void)__s;
+}
+
+static inline void __iRestore(const unsigned int *__s) {
+  if (*__s)
+    disable_interrupts();
+  else
+    enable_interrupts();
+}
+
+#define ATOMIC_BLOCK(type) for ( type, __ToDo = __iCliRetVal(); \
+                               __ToDo ; __ToDo = 0 )
+
+#define NONATOMIC_BLOCK(type) for ( type, __ToDo = __iSeiRetVal(); \
+                                  __ToDo ;  __ToDo = 0 )
+
+#define ATOMIC_RESTORESTATE unsigned int sreg_save \
+  __attribute__((__cleanup__(__iRestore))) = interrupts_disabled()
+
+#define ATOMIC_FORCEON unsigned int sreg_save \
+  __attribute__((__cleanup__(__iSeiParam))) = 0
+
+#define NONATOMIC_RESTORESTATE unsigned int sreg_save \
+  __attribute__((__cleanup__(__iRestore))) = interrupts_disabled()
+
+#define NONATOMIC_FORCEOFF unsigned int sreg_save \
+  __attribute__((__cleanup__(__iCliParam))) = 0
+
+#endif
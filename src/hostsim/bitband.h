@@ -0,0 +1,9 @@
+/* Bit-band access for the simulated timer registers in arch-config.h */
+/* Included by arch-config.h, so its guard also hides lpc17xx/bitband.h */
+#ifndef BITBAND_H
+#define BITBAND_H
+
+/* Registers that are only accessed with BITBAND are arrays of bits */
+#define BITBAND(addr,bit) ((addr)[bit])
+
+#endif
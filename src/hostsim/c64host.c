@@ -0,0 +1,874 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+   c64host.c: Simulated computer on the IEC bus
+
+   This plays the computer side of the serial bus using the virtual
+   time of virtual-time.c. The standard protocol follows the C64
+   kernal routines (LIST1, ISOUR, ACPTR, ...) with roughly matching
+   delays, JiffyDOS and fast serial mimic the JiffyDOS kernal and the
+   C128 respectively. Line timing on the computer side is only
+   approximated, 1 microsecond stands in for one 6510 cycle.
+
+   All functions return the kernal status byte (ST).
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "hostsim.h"
+
+#define US 1000ULL
+#define MS 1000000ULL
+
+/* timeout for handshakes that the kernal would wait for indefinitely */
+#define HANG_TIMEOUT (100 * MS)
+
+/* kernal status bits */
+#define ST_WRITE_TIMEOUT 0x01
+#define ST_READ_TIMEOUT  0x02
+#define ST_EOI           0x40
+#define ST_NOT_PRESENT   0x80
+#define ST_ERROR (ST_WRITE_TIMEOUT | ST_READ_TIMEOUT | ST_NOT_PRESENT)
+
+c64_stats_t c64_stats;
+
+static c64_protocol_t protocol;
+static uint8_t  status;
+static uint8_t  jiffy_device;   /* device answered the JiffyDOS detection */
+static uint8_t  fast_device;    /* device answered in fast serial mode    */
+
+/* ---------- line access ---------- */
+
+static void atn_out(unsigned int state) {
+  host_set_line(IEC_BIT_ATN, state);
+}
+
+static void clock_out(unsigned int state) {
+  host_set_line(IEC_BIT_CLOCK, state);
+}
+
+static void data_out(unsigned int state) {
+  host_set_line(IEC_BIT_DATA, state);
+}
+
+static void srq_out(unsigned int state) {
+  host_set_line(IEC_BIT_SRQ, state);
+}
+
+static unsigned int line(iec_bus_t bit) {
+  return !!(host_bus_read() & bit);
+}
+
+static void wait_us(unsigned int us) {
+  host_delay_ns(us * US);
+}
+
+/* wait until ns nanoseconds after start */
+static void wait_until(uint64_t start, uint64_t ns) {
+  uint64_t now = hostsim_vtime_ns();
+
+  if (start + ns > now)
+    host_delay_ns(start + ns - now);
+}
+
+/* wait until a line has the given state, returns 0 on timeout */
+static unsigned int wait_line(iec_bus_t bit, unsigned int state, uint64_t timeout) {
+  return host_wait_bus(bit, state ? bit : 0, timeout);
+}
+
+/* ---------- statistics ---------- */
+
+/* account the time the computer had to wait for the device for one byte */
+static void count_handshake(uint64_t time) {
+  c64_stats.handshakes++;
+  c64_stats.handshake_ns += time;
+  if (time > c64_stats.handshake_max_ns)
+    c64_stats.handshake_max_ns = time;
+}
+
+/* ---------- standard protocol ---------- */
+
+/* release the bus after an error or at the end of a command (DLABYE) */
+static void release_bus(void) {
+  atn_out(1);
+  wait_us(50);
+  clock_out(1);
+  data_out(1);
+}
+
+static void bus_error(uint8_t st) {
+  status |= st;
+  release_bus();
+}
+
+/* send a byte with the C128 fast serial shift register */
+static void fast_send(uint8_t byte) {
+  uint8_t i;
+
+  for (i = 0; i < 8; i++) {
+    data_out(byte & 0x80);
+    srq_out(0);
+    wait_us(2);
+    srq_out(1);
+    wait_us(2);
+    byte <<= 1;
+  }
+  data_out(1);
+}
+
+/**
+ * serial_send - send a byte with the standard protocol (ISOUR)
+ * @byte: data byte
+ * @eoi : flags if the byte should be sent with EOI
+ * @atn : flags if the byte is sent under ATN
+ */
+static void serial_send(uint8_t byte, uint8_t eoi, uint8_t atn) {
+  uint8_t  i, cmd = byte;
+  uint64_t start;
+
+  data_out(1);
+  wait_us(12);
+  if (line(IEC_BIT_DATA)) {
+    bus_error(ST_NOT_PRESENT);
+    return;
+  }
+
+  /* ready to send */
+  clock_out(1);
+  start = hostsim_vtime_ns();
+
+  if (eoi) {
+    /* the listener acknowledges EOI with a low pulse on DATA */
+    if (!wait_line(IEC_BIT_DATA, 1, HANG_TIMEOUT) ||
+        !wait_line(IEC_BIT_DATA, 0, HANG_TIMEOUT)) {
+      bus_error(ST_WRITE_TIMEOUT);
+      return;
+    }
+  }
+
+  /* wait until the listener is ready for data */
+  if (!wait_line(IEC_BIT_DATA, 1, HANG_TIMEOUT)) {
+    bus_error(ST_WRITE_TIMEOUT);
+    return;
+  }
+
+  if (!atn)
+    count_handshake(hostsim_vtime_ns() - start);
+
+  /* a fast serial device announces itself when it becomes listener */
+  if (protocol == PROTO_FAST && host_fs_byte_ready()) {
+    host_fs_read_byte();
+    fast_device = 1;
+  }
+
+  /* loop exit and JSR CLKLO */
+  wait_us(5);
+  clock_out(0);
+
+  if (fast_device && !atn) {
+    wait_us(10);
+    fast_send(byte);
+  } else {
+    for (i = 0; i < 8; i++) {
+      wait_us(10);
+      if (!line(IEC_BIT_DATA)) {
+        /* frame error */
+        bus_error(ST_WRITE_TIMEOUT);
+        return;
+      }
+
+      /* JiffyDOS delays the last bit of LISTEN/TALK, */
+      /* a JiffyDOS device answers with a DATA pulse  */
+      if (atn && i == 7 && protocol == PROTO_JIFFY &&
+          cmd < 0x60 && (cmd & 0x1f) != 0x1f) {
+        if (wait_line(IEC_BIT_DATA, 0, 400 * US)) {
+          jiffy_device = 1;
+          wait_line(IEC_BIT_DATA, 1, 400 * US);
+        }
+      }
+
+      data_out(byte & 1);
+      wait_us(20);
+      clock_out(1);
+      wait_us(20);
+      clock_out(0);
+      data_out(1);
+      byte >>= 1;
+    }
+  }
+
+  /* the listener acknowledges the byte within 1ms */
+  if (!wait_line(IEC_BIT_DATA, 0, 1 * MS))
+    bus_error(ST_WRITE_TIMEOUT);
+}
+
+/* receive a byte with the standard protocol (ACPTR), returns -1 on error */
+static int serial_receive(void) {
+  uint8_t  i, byte = 0;
+  uint8_t  eoi = 0;
+  uint64_t start, waited;
+
+  /* wait until the talker is ready to send */
+  start = hostsim_vtime_ns();
+  if (!wait_line(IEC_BIT_CLOCK, 1, HANG_TIMEOUT)) {
+    bus_error(ST_READ_TIMEOUT);
+    return -1;
+  }
+  waited = hostsim_vtime_ns() - start;
+
+  while (1) {
+    /* ready for data, the talker signals EOI by waiting 256us */
+    data_out(1);
+    start = hostsim_vtime_ns();
+    if (wait_line(IEC_BIT_CLOCK, 0, 256 * US))
+      break;
+
+    if (eoi) {
+      bus_error(ST_READ_TIMEOUT);
+      return -1;
+    }
+
+    /* acknowledge EOI */
+    eoi = 1;
+    status |= ST_EOI;
+    data_out(0);
+    wait_us(60);
+  }
+  count_handshake(waited + hostsim_vtime_ns() - start);
+
+  if (fast_device) {
+    for (i = 0; i < 250 && !host_fs_byte_ready(); i++)
+      wait_us(4);
+
+    if (!host_fs_byte_ready()) {
+      bus_error(ST_READ_TIMEOUT);
+      return -1;
+    }
+    byte = host_fs_read_byte();
+  } else {
+    for (i = 0; i < 8; i++) {
+      if (!wait_line(IEC_BIT_CLOCK, 1, HANG_TIMEOUT)) {
+        bus_error(ST_READ_TIMEOUT);
+        return -1;
+      }
+
+      byte = (byte >> 1) | (line(IEC_BIT_DATA) << 7);
+
+      if (!wait_line(IEC_BIT_CLOCK, 0, HANG_TIMEOUT)) {
+        bus_error(ST_READ_TIMEOUT);
+        return -1;
+      }
+    }
+  }
+
+  /* frame handshake */
+  data_out(0);
+
+  if (eoi) {
+    wait_us(50);
+    clock_out(1);
+    data_out(1);
+  }
+
+  return byte;
+}
+
+/* ---------- JiffyDOS ---------- */
+
+/* send a byte with the JiffyDOS protocol, bits are inverted on the bus */
+static void jiffy_send(uint8_t byte, uint8_t eoi) {
+  uint64_t start;
+
+  /* wait until the device is ready */
+  start = hostsim_vtime_ns();
+  if (!wait_line(IEC_BIT_DATA, 1, HANG_TIMEOUT)) {
+    bus_error(ST_WRITE_TIMEOUT);
+    return;
+  }
+  count_handshake(hostsim_vtime_ns() - start);
+  wait_us(6);
+
+  start = hostsim_vtime_ns();
+  clock_out(1);
+
+  wait_until(start, 11 * US);
+  clock_out(!(byte & 0x10));
+  data_out (!(byte & 0x20));
+  wait_until(start, 24 * US);
+  clock_out(!(byte & 0x40));
+  data_out (!(byte & 0x80));
+  wait_until(start, 35 * US);
+  clock_out(!(byte & 0x08));
+  data_out (!(byte & 0x02));
+  wait_until(start, 48 * US);
+  clock_out(!(byte & 0x04));
+  data_out (!(byte & 0x01));
+
+  /* EOI flag */
+  wait_until(start, 61 * US);
+  clock_out(eoi);
+  data_out(1);
+
+  /* the device signals busy by pulling DATA */
+  if (!wait_line(IEC_BIT_DATA, 0, 1 * MS)) {
+    bus_error(ST_WRITE_TIMEOUT);
+    return;
+  }
+  clock_out(0);
+}
+
+/* read one bit pair at ns after start */
+static uint8_t jiffy_pair(uint64_t start, uint64_t ns) {
+  iec_bus_t bus;
+
+  wait_until(start, ns);
+  bus = host_bus_read();
+
+  return (!!(bus & IEC_BIT_CLOCK)) | (!!(bus & IEC_BIT_DATA) << 1);
+}
+
+/* receive a byte with the JiffyDOS protocol, returns -1 on error */
+static int jiffy_receive(void) {
+  uint64_t start;
+  uint8_t  byte;
+
+  /* wait until the device is ready to send */
+  start = hostsim_vtime_ns();
+  if (!wait_line(IEC_BIT_CLOCK, 1, HANG_TIMEOUT)) {
+    bus_error(ST_READ_TIMEOUT);
+    return -1;
+  }
+  count_handshake(hostsim_vtime_ns() - start);
+  wait_us(5);
+
+  start = hostsim_vtime_ns();
+  data_out(1);
+
+  byte  = jiffy_pair(start, 15000);
+  byte |= jiffy_pair(start, 25500) << 2;
+  byte |= jiffy_pair(start, 36000) << 4;
+  byte |= jiffy_pair(start, 46500) << 6;
+
+  /* clock high after the byte marks EOI */
+  wait_until(start, 57 * US);
+  if (line(IEC_BIT_CLOCK))
+    status |= ST_EOI;
+
+  data_out(0);
+  return byte;
+}
+
+/**
+ * jiffy_load - receive the rest of a file with the JiffyDOS LOAD protocol
+ * @store: function to store the received bytes
+ *
+ * The device announces every block with DATA low/CLOCK high, the
+ * computer then requests each byte with a short low pulse on DATA.
+ * CLOCK low at that point marks the end of a block, CLOCK high
+ * without DATA low the end of the file.
+ */
+static void jiffy_load(void (*store)(uint8_t)) {
+  uint64_t start;
+  uint8_t  byte;
+
+  /* the device waits for DATA high before the first block */
+  data_out(1);
+
+  while (1) {
+    start = hostsim_vtime_ns();
+    if (!wait_line(IEC_BIT_CLOCK, 1, 1000 * MS)) {
+      bus_error(ST_READ_TIMEOUT);
+      return;
+    }
+    count_handshake(hostsim_vtime_ns() - start);
+
+    if (line(IEC_BIT_DATA)) {
+      status |= ST_EOI;
+      return;
+    }
+
+    if (!wait_line(IEC_BIT_DATA, 1, 1 * MS)) {
+      bus_error(ST_READ_TIMEOUT);
+      return;
+    }
+
+    while (1) {
+      wait_us(8);
+      start = hostsim_vtime_ns();
+      data_out(0);
+
+      wait_until(start, 4 * US);
+      data_out(1);
+      if (!line(IEC_BIT_CLOCK))
+        /* end of block */
+        break;
+
+      byte  = jiffy_pair(start, 15000);
+      byte |= jiffy_pair(start, 25500) << 2;
+      byte |= jiffy_pair(start, 36000) << 4;
+      byte |= jiffy_pair(start, 46500) << 6;
+
+      wait_until(start, 50 * US);
+      store(byte);
+      c64_stats.bytes++;
+    }
+  }
+}
+
+/* ---------- burst fastload ---------- */
+
+static unsigned int burst_clock;
+
+/* request the next burst byte by toggling CLOCK, returns -1 on timeout */
+static int burst_receive(void) {
+  uint64_t start = hostsim_vtime_ns();
+
+  burst_clock = !burst_clock;
+  clock_out(burst_clock);
+
+  while (!host_fs_byte_ready()) {
+    if (hostsim_vtime_ns() - start > HANG_TIMEOUT) {
+      bus_error(ST_READ_TIMEOUT);
+      return -1;
+    }
+    wait_us(2);
+  }
+
+  count_handshake(hostsim_vtime_ns() - start);
+  return host_fs_read_byte();
+}
+
+/* ---------- byte transfer ---------- */
+
+static void send_byte(uint8_t byte, uint8_t eoi) {
+  if (jiffy_device)
+    jiffy_send(byte, eoi);
+  else
+    serial_send(byte, eoi, 0);
+
+  if (!(status & ST_ERROR))
+    c64_stats.bytes++;
+}
+
+static int receive_byte(void) {
+  int byte;
+
+  if (jiffy_device)
+    byte = jiffy_receive();
+  else
+    byte = serial_receive();
+
+  if (byte >= 0)
+    c64_stats.bytes++;
+
+  return byte;
+}
+
+/* ---------- bus commands ---------- */
+
+/* send a command byte under ATN (LIST1) */
+static void atn_command(uint8_t cmd) {
+  /* The kernal never asserts ATN right after releasing it, give the */
+  /* device time to finish the previous sequence.                    */
+  wait_us(100);
+
+  data_out(1);
+  if (cmd == 0x3f)
+    clock_out(1);
+
+  /* a fast serial byte before ATN requests the fast protocol */
+  if (protocol == PROTO_FAST && line(IEC_BIT_ATN)) {
+    /* it shares DATA with a listener that is still busy */
+    if (cmd == 0x3f)
+      wait_line(IEC_BIT_DATA, 1, 1 * MS);
+
+    host_fs_reset();
+    fast_send(0xff);
+  }
+
+  atn_out(0);
+  wait_us(12);
+  clock_out(0);
+  data_out(1);
+  wait_us(1000);
+
+  serial_send(cmd, 0, 1);
+}
+
+static void listen(uint8_t sa) {
+  jiffy_device = 0;
+  fast_device  = 0;
+
+  atn_command(0x20 | hostsim_device_address);
+  if (status & ST_ERROR)
+    return;
+
+  /* SECOND */
+  serial_send(sa, 0, 1);
+  atn_out(1);
+}
+
+static void unlisten(void) {
+  atn_command(0x3f);
+  release_bus();
+}
+
+static void talk(uint8_t sa) {
+  jiffy_device = 0;
+  fast_device  = (protocol == PROTO_FAST);
+
+  atn_command(0x40 | hostsim_device_address);
+  if (status & ST_ERROR)
+    return;
+
+  /* TKSA, turn around to listener */
+  serial_send(sa, 0, 1);
+  if (status & ST_ERROR)
+    return;
+
+  data_out(0);
+  atn_out(1);
+  clock_out(1);
+  if (!wait_line(IEC_BIT_CLOCK, 0, HANG_TIMEOUT))
+    bus_error(ST_READ_TIMEOUT);
+}
+
+static void untalk(void) {
+  clock_out(0);
+  atn_out(0);
+  atn_command(0x5f);
+  release_bus();
+}
+
+/* send data to a secondary address, the last byte is sent with EOI */
+static void send_data(uint8_t sa, const uint8_t *data, size_t len) {
+  listen(sa);
+
+  while (len > 0 && !(status & ST_ERROR)) {
+    send_byte(*data++, len == 1);
+    len--;
+  }
+
+  if (!(status & ST_NOT_PRESENT))
+    unlisten();
+}
+
+/* ---------- interface for hostbus.c ---------- */
+
+uint8_t c64_set_protocol(c64_protocol_t proto) {
+#ifndef CONFIG_FAST_SERIAL
+  if (proto == PROTO_FAST)
+    return 1;
+#endif
+  protocol = proto;
+  return 0;
+}
+
+uint8_t c64_open(uint8_t sa, const uint8_t *name, unsigned int len) {
+  status = 0;
+  if (len > 0)
+    send_data(0xf0 | sa, name, len);
+
+  return status;
+}
+
+uint8_t c64_write(uint8_t sa, const uint8_t *data, size_t len) {
+  status = 0;
+  send_data(0x60 | sa, data, len);
+
+  return status;
+}
+
+uint8_t c64_close(uint8_t sa) {
+  status = 0;
+  listen(0xe0 | sa);
+  if (!(status & ST_NOT_PRESENT))
+    unlisten();
+
+  return status;
+}
+
+/* read from a secondary address until EOI, at most limit bytes */
+static void receive_data(uint8_t sa, void (*store)(uint8_t), size_t limit) {
+  int byte;
+
+  talk(0x60 | sa);
+
+  while (limit > 0 && !(status & (ST_ERROR | ST_EOI))) {
+    byte = receive_byte();
+    if (byte < 0)
+      break;
+
+    store(byte);
+    limit--;
+  }
+
+  if (!(status & ST_NOT_PRESENT))
+    untalk();
+}
+
+uint8_t c64_read(uint8_t sa, void (*store)(uint8_t)) {
+  status = 0;
+  receive_data(sa, store, SIZE_MAX);
+
+  return status;
+}
+
+/**
+ * c64_load - load a file like the kernal LOAD routine
+ * @name : file name
+ * @len  : length of the file name
+ * @store: function to store the received bytes
+ *
+ * With JiffyDOS the load address is read normally, the rest of the
+ * file with the LOAD protocol that is selected by secondary address 1
+ * with bit 0 of the TALK command byte set ($61). Directories are
+ * always loaded normally.
+ */
+uint8_t c64_load(const uint8_t *name, unsigned int len, void (*store)(uint8_t)) {
+  uint8_t result;
+
+  status = 0;
+  send_data(0xf0, name, len);
+  if (status & ST_ERROR)
+    return status;
+
+  if (protocol == PROTO_JIFFY && !(len > 0 && name[0] == '$')) {
+    receive_data(0, store, 2);
+
+    if (!(status & (ST_ERROR | ST_EOI))) {
+      if (jiffy_device) {
+        talk(0x61);
+        if (!(status & ST_ERROR))
+          jiffy_load(store);
+        if (!(status & ST_NOT_PRESENT))
+          untalk();
+      } else {
+        receive_data(0, store, SIZE_MAX);
+      }
+    }
+  } else {
+    receive_data(0, store, SIZE_MAX);
+  }
+
+  result = status;
+  c64_close(0);
+  return result | status;
+}
+
+/**
+ * c64_burst_load - load a file with the burst fastload command of the C128
+ * @name : file name
+ * @len  : length of the file name
+ * @store: function to store the received bytes
+ *
+ * Sends "U0" with the fastload command byte and the file name over the
+ * command channel, then reads the blocks of the file. Every block starts
+ * with a status byte, the final one (status $1f) with the number of data
+ * bytes after it. Every byte is requested by toggling CLOCK. The first
+ * block includes the load address which is not counted in its length.
+ */
+uint8_t c64_burst_load(const uint8_t *name, unsigned int len, void (*store)(uint8_t)) {
+  uint8_t  cmd[3 + 256];
+  unsigned int count, final, first = 1;
+  int byte;
+
+  if (protocol != PROTO_FAST || len > 256)
+    return ST_NOT_PRESENT;
+
+  cmd[0] = 'U';
+  cmd[1] = '0';
+  cmd[2] = 0x1f;
+  memcpy(cmd + 3, name, len);
+
+  status = 0;
+  send_data(0xff, cmd, len + 3);
+  if (status & ST_ERROR)
+    return status;
+
+  burst_clock = 1;
+
+  do {
+    byte = burst_receive();
+    if (byte < 0)
+      break;
+
+    final = (byte == 0x1f);
+    if (final) {
+      byte = burst_receive();
+      if (byte < 0)
+        break;
+      count = byte + (first ? 2 : 0);
+    } else if (byte == 0) {
+      count = 254;
+    } else {
+      /* job error code */
+      status |= ST_READ_TIMEOUT;
+      break;
+    }
+
+    while (count > 0 && !(status & ST_ERROR)) {
+      byte = burst_receive();
+      if (byte >= 0) {
+        store(byte);
+        c64_stats.bytes++;
+      }
+      count--;
+    }
+
+    first = 0;
+  } while (!final && !(status & ST_ERROR));
+
+  release_bus();
+  return status;
+}
+
+/* send a burst read/write command over the command channel */
+static void burst_command(uint8_t cmdbyte, uint8_t track, uint8_t sector, uint8_t count) {
+  uint8_t cmd[6];
+
+  cmd[0] = 'U';
+  cmd[1] = '0';
+  cmd[2] = cmdbyte;
+  cmd[3] = track;
+  cmd[4] = sector;
+  cmd[5] = count;
+
+  status = 0;
+  send_data(0xff, cmd, sizeof(cmd));
+}
+
+/**
+ * c64_burst_read - read sectors with the burst read command of the C128
+ * @track : first track
+ * @sector: first sector
+ * @count : number of sectors
+ * @store : function to store the received bytes
+ *
+ * Every sector starts with a status byte which is followed by the
+ * 256 bytes of the sector if it is zero. All bytes are requested by
+ * toggling CLOCK.
+ */
+uint8_t c64_burst_read(uint8_t track, uint8_t sector, uint8_t count,
+                       void (*store)(uint8_t)) {
+  unsigned int i;
+  int byte;
+
+  if (protocol != PROTO_FAST)
+    return ST_NOT_PRESENT;
+
+  burst_command(0x00, track, sector, count);
+  if (status & ST_ERROR)
+    return status;
+
+  burst_clock = 1;
+
+  while (count-- > 0 && !(status & ST_ERROR)) {
+    byte = burst_receive();
+    if (byte < 0)
+      break;
+
+    if (byte != 0) {
+      /* job error code */
+      status |= ST_READ_TIMEOUT;
+      break;
+    }
+
+    for (i = 0; i < 256 && !(status & ST_ERROR); i++) {
+      byte = burst_receive();
+      if (byte >= 0) {
+        store(byte);
+        c64_stats.bytes++;
+      }
+    }
+  }
+
+  release_bus();
+  return status;
+}
+
+/**
+ * c64_burst_write - write sectors with the burst write command of the C128
+ * @track : first track
+ * @sector: first sector
+ * @data  : sector contents
+ * @count : number of sectors
+ *
+ * The device requests every data byte by toggling CLOCK. After a
+ * sector, the computer pulls CLOCK low to request its status byte and
+ * releases it again.
+ */
+uint8_t c64_burst_write(uint8_t track, uint8_t sector, const uint8_t *data,
+                        uint8_t count) {
+  unsigned int i, level;
+  uint64_t start;
+  int byte;
+
+  if (protocol != PROTO_FAST)
+    return ST_NOT_PRESENT;
+
+  burst_command(0x02, track, sector, count);
+  if (status & ST_ERROR)
+    return status;
+
+  clock_out(1);
+
+  while (count-- > 0 && !(status & ST_ERROR)) {
+    level = 0;
+    for (i = 0; i < 256; i++) {
+      start = hostsim_vtime_ns();
+      if (!wait_line(IEC_BIT_CLOCK, level, HANG_TIMEOUT)) {
+        bus_error(ST_WRITE_TIMEOUT);
+        break;
+      }
+      count_handshake(hostsim_vtime_ns() - start);
+
+      fast_send(*data++);
+      c64_stats.bytes++;
+      level = !level;
+    }
+
+    if (status & ST_ERROR)
+      break;
+
+    /* wait until the device has released CLOCK after the last byte */
+    if (!wait_line(IEC_BIT_CLOCK, 1, HANG_TIMEOUT)) {
+      bus_error(ST_WRITE_TIMEOUT);
+      break;
+    }
+
+    burst_clock = 1;
+    byte = burst_receive();
+    clock_out(1);
+    if (byte < 0)
+      break;
+
+    if (byte != 0) {
+      /* job error code */
+      status |= ST_WRITE_TIMEOUT;
+      break;
+    }
+  }
+
+  release_bus();
+  return status;
+}
@@ -0,0 +1,187 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+   card-image.c: SD card emulation using a raw image file
+
+   The exported functions in this file are weak-aliased to their corresponding
+   versions defined in diskio.h, just like the ones in sdcard.c. Sectors
+   are transferred with pread/pwrite on the image, which can be a copy of
+   a complete card (with partition table) or of a single partition.
+
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "config.h"
+#include "diskio.h"
+#include "hostsim.h"
+#include "sdcard.h"
+
+static int     image_fd = -1;
+static uint8_t image_readonly;
+
+/* "card detect" and "write protect" switches */
+uint8_t sdcard_detect(void) {
+  return image_fd >= 0;
+}
+
+uint8_t sdcard_wp(void) {
+  return image_readonly;
+}
+
+/**
+ * sd_init - open the card image
+ *
+ * This function opens the image file named in HOSTSIM_IMAGE. If it
+ * cannot be opened for writing, the card is treated as write protected.
+ */
+void sd_init(void) {
+  image_fd = open(hostsim_image_name, O_RDWR);
+  if (image_fd < 0 && (errno == EACCES || errno == EROFS)) {
+    image_fd = open(hostsim_image_name, O_RDONLY);
+    image_readonly = 1;
+  }
+
+  if (image_fd < 0)
+    perror(hostsim_image_name);
+}
+void disk_init(void) __attribute__ ((weak, alias("sd_init")));
+
+
+DSTATUS sd_status(BYTE drv) {
+  if (drv != 0 || !sdcard_detect())
+    return STA_NOINIT | STA_NODISK;
+
+  if (sdcard_wp())
+    return STA_PROTECT;
+
+  return RES_OK;
+}
+DSTATUS disk_status(BYTE drv) __attribute__ ((weak, alias("sd_status")));
+
+
+DSTATUS sd_initialize(BYTE drv) {
+  if (drv == 0 && sdcard_detect())
+    disk_state = DISK_OK;
+
+  return sd_status(drv);
+}
+DSTATUS disk_initialize(BYTE drv) __attribute__ ((weak, alias("sd_initialize")));
+
+
+/**
+ * sd_read - reads sectors from the image to buffer
+ * @drv   : drive
+ * @buffer: pointer to the buffer
+ * @sector: first sector to be read
+ * @count : number of sectors to be read
+ *
+ * This function reads count sectors from the image starting at
+ * sector to buffer. Returns RES_ERROR if an error occured or
+ * RES_OK if successful. Reading beyond the end of the image
+ * is treated as an error, just like on a real card.
+ */
+DRESULT sd_read(BYTE drv, BYTE *buffer, DWORD sector, BYTE count) {
+  ssize_t len = (ssize_t)count * 512;
+
+  if (drv != 0)
+    return RES_PARERR;
+
+  set_sd_led(1);
+  if (pread(image_fd, buffer, len, (off_t)sector * 512) != len) {
+    set_sd_led(0);
+    disk_state = DISK_ERROR;
+    return RES_ERROR;
+  }
+  set_sd_led(0);
+
+  return RES_OK;
+}
+DRESULT disk_read(BYTE drv, BYTE *buffer, DWORD sector, BYTE count) __attribute__ ((weak, alias("sd_read")));
+
+
+/**
+ * sd_write - writes sectors from buffer to the image
+ * @drv   : drive
+ * @buffer: pointer to the buffer
+ * @sector: first sector to be written
+ * @count : number of sectors to be written
+ *
+ * This function writes count sectors from buffer to the image
+ * starting at sector. Returns RES_ERROR if an error occured,
+ * RES_WPRT if the image is read-only or RES_OK if successful.
+ */
+DRESULT sd_write(BYTE drv, const BYTE *buffer, DWORD sector, BYTE count) {
+  ssize_t len = (ssize_t)count * 512;
+
+  if (drv != 0)
+    return RES_PARERR;
+
+  if (sdcard_wp())
+    return RES_WRPRT;
+
+  set_sd_led(1);
+  if (pwrite(image_fd, buffer, len, (off_t)sector * 512) != len) {
+    set_sd_led(0);
+    disk_state = DISK_ERROR;
+    return RES_ERROR;
+  }
+  set_sd_led(0);
+
+  return RES_OK;
+}
+DRESULT disk_write(BYTE drv, const BYTE *buffer, DWORD sector, BYTE count) __attribute__ ((weak, alias("sd_write")));
+
+
+/**
+ * sd_getinfo - read card information
+ * @drv   : drive
+ * @page  : information page
+ * @buffer: target buffer
+ *
+ * This function returns the requested information page @page
+ * for card @drv in the buffer @buffer. Currently only page
+ * 0 is supported which is the diskinfo0_t structure defined
+ * in diskio.h. Returns a DRESULT to indicate success/failure.
+ */
+DRESULT sd_getinfo(BYTE drv, BYTE page, void *buffer) {
+  struct stat st;
+
+  if (drv != 0 || !sdcard_detect())
+    return RES_NOTRDY;
+
+  if (page != 0)
+    return RES_ERROR;
+
+  if (fstat(image_fd, &st) != 0)
+    return RES_ERROR;
+
+  diskinfo0_t *di = buffer;
+  di->validbytes  = sizeof(diskinfo0_t);
+  di->disktype    = DISK_TYPE_SD;
+  di->sectorsize  = 2;
+  di->sectorcount = st.st_size / 512;
+
+  return RES_OK;
+}
+DRESULT disk_getinfo(BYTE drv, BYTE page, void *buffer) __attribute__ ((weak, alias("sd_getinfo")));
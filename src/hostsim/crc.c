@@ -0,0 +1,73 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+   crc.c: CRC calculation routines (hostsim version)
+
+   Plain C versions of the assembler routines used on the hardware.
+
+*/
+
+#include "config.h"
+#include "crc.h"
+
+uint8_t crc7update(uint8_t crc, uint8_t data) {
+  uint8_t i;
+
+  for (i = 0; i < 8; i++) {
+    crc <<= 1;
+    if ((data & 0x80) ^ (crc & 0x80))
+      crc ^= 0x09;
+    data <<= 1;
+  }
+  return crc & 0x7f;
+}
+
+uint16_t crc_xmodem_update(uint16_t crc, uint8_t data) {
+  uint8_t i;
+
+  crc ^= (uint16_t)data << 8;
+  for (i = 0; i < 8; i++) {
+    if (crc & 0x8000)
+      crc = (crc << 1) ^ 0x1021;
+    else
+      crc <<= 1;
+  }
+  return crc;
+}
+
+uint16_t crc_xmodem_block(uint16_t crc, const uint8_t *data, uint32_t length) {
+  while (length--)
+    crc = crc_xmodem_update(crc, *data++);
+
+  return crc;
+}
+
+uint16_t crc16_update(uint16_t crc, uint8_t data) {
+  uint8_t i;
+
+  crc ^= data;
+  for (i = 0; i < 8; i++) {
+    if (crc & 1)
+      crc = (crc >> 1) ^ 0xa001;
+    else
+      crc >>= 1;
+  }
+  return crc;
+}
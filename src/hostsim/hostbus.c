@@ -0,0 +1,763 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+   hostbus.c: Scripted bus main loop for hostsim
+
+   This reads commands from HOSTSIM_SCRIPT (or stdin) and executes
+   them in one of two ways:
+
+   - By default it replaces iec_mainloop and performs the same
+     buffer-level operations the IEC handlers do for a LISTEN/TALK/
+     UNLISTEN/UNTALK sequence of the computer. The bus handshake is
+     skipped, so the reported times cover only the DOS and filesystem
+     code.
+   - In bus mode (HOSTSIM_BUS=iec) the script runs on the simulated
+     computer of c64host.c which talks to the unmodified iec_mainloop
+     over the simulated bus. The reported times are in virtual time
+     and include the per-byte handshake latency, i.e. the time the
+     computer had to wait for the device before each byte.
+
+   Commands, one per line, empty lines and lines starting with # are
+   ignored. Names and commands accept \xNN escapes.
+     open <sa> <name>       - send a file name to a secondary address
+     cmd <command>          - send a command to the command channel
+     read <sa> [file]       - read from a channel until EOI
+     write <sa> <file>      - send the contents of a file to a channel
+     close <sa>             - close a channel
+     status                 - read and print the error channel
+     load <name> [file]     - open/read/close on secondary address 0
+     burst <name> [file]    - bus mode only: C128 burst fastload (U0)
+     bread <t> <s> <n> [file] - bus mode only: burst read of n sectors
+     bwrite <t> <s> <file>  - bus mode only: burst write of whole sectors
+     save <name> <file>     - open/write/close on secondary address 1
+     dir [pattern]          - load and print a directory listing
+     protocol <name>        - bus mode only: serial, jiffy or fast
+     quit                   - exit
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "buffers.h"
+#include "d64ops.h"
+#include "doscmd.h"
+#include "errormsg.h"
+#include "fatops.h"
+#include "ff.h"
+#include "fileops.h"
+#include "hostsim.h"
+#include "iec.h"
+#include "led.h"
+#include "bus.h"
+
+#define LINE_LENGTH 512
+
+/* sink for data read from the device, grown as needed */
+static uint8_t *readbuf;
+static size_t   readbuf_size;
+static size_t   readbuf_len;
+
+static uint64_t transfer_start;
+
+static void start_transfer(void) {
+  memset(&c64_stats, 0, sizeof(c64_stats));
+#if _CACHE_WAYS != 0
+  ff_cache_hits   = 0;
+  ff_cache_misses = 0;
+  ff_readahead_fills = 0;
+  ff_readahead_hits  = 0;
+#endif
+  transfer_start = hostsim_time_ns();
+}
+
+static void report_transfer(const char *what, size_t bytes) {
+  uint64_t ns = hostsim_time_ns() - transfer_start;
+
+  if (ns == 0)
+    ns = 1;
+
+  printf("%s: %zu bytes in %llu us (%llu bytes/s)", what, bytes,
+         (unsigned long long)(ns / 1000),
+         (unsigned long long)(bytes * 1000000000ULL / ns));
+
+  if (hostsim_busmode && c64_stats.handshakes > 0)
+    printf(", handshake avg %.1f us max %.1f us",
+           c64_stats.handshake_ns / 1000.0 / c64_stats.handshakes,
+           c64_stats.handshake_max_ns / 1000.0);
+
+#if _CACHE_WAYS != 0
+  if (ff_cache_hits + ff_cache_misses > 0)
+    printf(", sector cache %lu hits %lu misses",
+           (unsigned long)ff_cache_hits, (unsigned long)ff_cache_misses);
+  if (ff_readahead_fills > 0)
+    printf(", read-ahead %lu/%lu used",
+           (unsigned long)ff_readahead_hits, (unsigned long)ff_readahead_fills);
+#endif
+
+  putchar('\n');
+}
+
+/* report errors of the simulated computer */
+static void check_status(const char *what, uint8_t st) {
+  if (st & 0xbf)
+    printf("%s: ST=$%02X\n", what, st);
+}
+
+static void store_byte(uint8_t c) {
+  if (readbuf_len == readbuf_size) {
+    readbuf_size = readbuf_size ? 2 * readbuf_size : 65536;
+    readbuf = realloc(readbuf, readbuf_size);
+    if (readbuf == NULL) {
+      perror("realloc");
+      exit(2);
+    }
+  }
+  readbuf[readbuf_len++] = c;
+}
+
+/* parse a secondary address, returns -1 on error */
+static int parse_sa(char **str) {
+  char *end;
+  long sa = strtol(*str, &end, 0);
+
+  if (end == *str || sa < 0 || sa > 15)
+    return -1;
+
+  while (*end == ' ' || *end == '\t')
+    end++;
+  *str = end;
+
+  return sa;
+}
+
+/* parse a number from 0 to 255 and skip the whitespace after it */
+static int parse_byte(char **str) {
+  char *end;
+  long val = strtol(*str, &end, 0);
+
+  if (end == *str || val < 0 || val > 255)
+    return -1;
+
+  while (*end == ' ' || *end == '\t')
+    end++;
+  *str = end;
+
+  return val;
+}
+
+/* copy a name/command into dest, expanding escapes; returns its length */
+static unsigned int parse_string(uint8_t *dest, const char *src, unsigned int maxlen) {
+  unsigned int len = 0;
+
+  while (*src && len < maxlen) {
+    if (src[0] == '\\' && src[1] == 'x' && src[2] && src[3]) {
+      char hex[3] = { src[2], src[3], 0 };
+
+      dest[len++] = strtoul(hex, NULL, 16);
+      src += 4;
+    } else {
+      dest[len++] = *src++;
+    }
+  }
+
+  return len;
+}
+
+/* split off the next whitespace-separated word */
+static char *next_word(char **str) {
+  char *word = *str;
+  char *end;
+
+  if (*word == 0)
+    return NULL;
+
+  end = word;
+  while (*end && *end != ' ' && *end != '\t')
+    end++;
+  if (*end) {
+    *end++ = 0;
+    while (*end == ' ' || *end == '\t')
+      end++;
+  }
+  *str = end;
+
+  return word;
+}
+
+/* ------------------------------------------------------------------------- */
+/*  Bus transactions                                                         */
+/* ------------------------------------------------------------------------- */
+
+/* end of a transaction, see BUS_CLEANUP in iec.c */
+static void bus_cleanup(void) {
+  set_busy_led(1);
+
+  if (iec_data.iecflags & COMMAND_RECVD) {
+    if (iec_data.secondary_address == 0x0f) {
+      parse_doscommand();
+    } else {
+      datacrc = 0xffff;
+      file_open(iec_data.secondary_address);
+    }
+    command_length = 0;
+    iec_data.iecflags &= (uint8_t)~COMMAND_RECVD;
+  }
+
+  free_multiple_buffers(FMB_UNSTICKY);
+  d64_commit();
+
+  update_leds();
+}
+
+/* send a file name or command to the device */
+static void send_command(uint8_t sa, const uint8_t *data, unsigned int len) {
+  if (hostsim_busmode) {
+    check_status("open", c64_open(sa, data, len));
+    return;
+  }
+
+  iec_data.secondary_address = sa;
+
+  command_length = 0;
+  while (len--) {
+    if (command_length < CONFIG_COMMAND_BUFFER_SIZE)
+      command_buffer[command_length++] = *data++;
+  }
+  iec_data.iecflags |= COMMAND_RECVD;
+
+  bus_cleanup();
+}
+
+/**
+ * talk - read from a secondary address until EOI, see iec_talk_handler
+ * @sa: secondary address
+ *
+ * Returns the number of bytes received, which are stored in readbuf.
+ */
+static size_t talk(uint8_t sa) {
+  buffer_t *buf;
+  uint8_t eoi = 0;
+
+  readbuf_len = 0;
+
+  if (hostsim_busmode) {
+    check_status("read", c64_read(sa, store_byte));
+    return readbuf_len;
+  }
+
+  iec_data.secondary_address = sa;
+
+  buf = find_buffer(sa);
+  if (buf == NULL)
+    goto done;
+
+  if (buf->random && buf->position > buf->lastused)
+    goto done;
+
+  while (buf->read) {
+    /* the computer sends UNTALK after the EOI byte */
+    if (eoi)
+      goto done;
+
+    do {
+      store_byte(buf->data[buf->position]);
+      if (buf->position == buf->lastused && buf->sendeoi)
+        eoi = 1;
+    } while (buf->position++ < buf->lastused);
+
+    if (buf->sendeoi &&
+        sa != 0x0f &&
+        !buf->recordlen &&
+        !buf->random &&
+        buf->refill != directbuffer_refill) {
+      buf->read = 0;
+      break;
+    }
+
+    if (buf->refill(buf))
+      break;
+
+    buf = find_buffer(sa);
+  }
+
+ done:
+  bus_cleanup();
+  return readbuf_len;
+}
+
+/**
+ * listen - send data to a secondary address, see iec_listen_handler
+ * @sa  : secondary address
+ * @data: data to send
+ * @len : number of bytes
+ *
+ * Returns the number of bytes accepted by the device.
+ */
+static size_t listen(uint8_t sa, const uint8_t *data, size_t len) {
+  buffer_t *buf;
+  size_t i;
+
+  if (hostsim_busmode) {
+    check_status("write", c64_write(sa, data, len));
+    /* the statistics were reset by the caller */
+    return c64_stats.bytes;
+  }
+
+  iec_data.secondary_address = sa;
+
+  if (sa == 0x0f) {
+    send_command(sa, data, len);
+    return len;
+  }
+
+  buf = find_buffer(sa);
+  if (buf == NULL || !buf->write) {
+    bus_cleanup();
+    return 0;
+  }
+
+  for (i = 0; i < len; i++) {
+    if (buf->mustflush) {
+      if (buf->refill(buf))
+        break;
+      buf = find_buffer(sa);
+    }
+
+    buf->data[buf->position] = data[i];
+    mark_buffer_dirty(buf);
+
+    if (buf->lastused < buf->position)
+      buf->lastused = buf->position;
+    buf->position++;
+
+    if (buf->position == 0)
+      buf->mustflush = 1;
+
+    /* REL files must be syncronized on EOI */
+    if (buf->recordlen && i == len - 1)
+      if (buf->refill(buf))
+        break;
+  }
+
+  bus_cleanup();
+  return i;
+}
+
+/* close a secondary address, see BUS_ATNACTIVE in iec.c */
+static void close_channel(uint8_t sa) {
+  buffer_t *buf;
+
+  if (hostsim_busmode) {
+    check_status("close", c64_close(sa));
+    return;
+  }
+
+  iec_data.secondary_address = sa;
+
+  if (sa == 0x0f) {
+    free_multiple_buffers(FMB_USER_CLEAN);
+  } else {
+    buf = find_buffer(sa);
+    if (buf != NULL) {
+      buf->cleanup(buf);
+      free_buffer(buf);
+    }
+  }
+
+  bus_cleanup();
+}
+
+/* ------------------------------------------------------------------------- */
+/*  Script commands                                                          */
+/* ------------------------------------------------------------------------- */
+
+static void print_status(void) {
+  size_t i, len;
+
+  len = talk(0x0f);
+  for (i = 0; i < len; i++) {
+    if (readbuf[i] == 0x0d)
+      putchar('\n');
+    else
+      putchar(readbuf[i]);
+  }
+}
+
+static int write_file(const char *name, const uint8_t *data, size_t len) {
+  FILE *f;
+
+  if (name == NULL)
+    return 0;
+
+  f = fopen(name, "wb");
+  if (f == NULL) {
+    perror(name);
+    return 1;
+  }
+  if (len > 0 && fwrite(data, len, 1, f) != 1) {
+    perror(name);
+    fclose(f);
+    return 1;
+  }
+  fclose(f);
+  return 0;
+}
+
+static uint8_t *read_file(const char *name, size_t *len) {
+  FILE *f;
+  uint8_t *data;
+  long size;
+
+  f = fopen(name, "rb");
+  if (f == NULL) {
+    perror(name);
+    return NULL;
+  }
+
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  data = malloc(size + 1);
+  if (data == NULL || (size > 0 && fread(data, size, 1, f) != 1)) {
+    perror(name);
+    free(data);
+    fclose(f);
+    return NULL;
+  }
+  fclose(f);
+
+  *len = size;
+  return data;
+}
+
+static void do_open(uint8_t sa, const char *name) {
+  uint8_t str[CONFIG_COMMAND_BUFFER_SIZE];
+  unsigned int len;
+
+  len = parse_string(str, name, sizeof(str));
+  send_command(sa, str, len);
+}
+
+static void do_read(uint8_t sa, const char *outname) {
+  size_t len;
+
+  start_transfer();
+  len = talk(sa);
+  report_transfer("read", len);
+  write_file(outname, readbuf, len);
+}
+
+static void do_write(uint8_t sa, const char *inname) {
+  uint8_t *data;
+  size_t len, written;
+
+  if (inname == NULL) {
+    fprintf(stderr, "write: missing file name\n");
+    return;
+  }
+
+  data = read_file(inname, &len);
+  if (data == NULL)
+    return;
+
+  start_transfer();
+  written = listen(sa, data, len);
+  report_transfer("write", written);
+  free(data);
+}
+
+static void do_load(const char *name, const char *outname) {
+  uint8_t str[CONFIG_COMMAND_BUFFER_SIZE];
+  unsigned int len;
+
+  len = parse_string(str, name, sizeof(str));
+
+  start_transfer();
+  if (hostsim_busmode) {
+    readbuf_len = 0;
+    check_status("load", c64_load(str, len, store_byte));
+  } else {
+    send_command(0, str, len);
+    talk(0);
+    close_channel(0);
+  }
+  report_transfer("load", readbuf_len);
+  write_file(outname, readbuf, readbuf_len);
+}
+
+static void do_burst(const char *name, const char *outname) {
+  uint8_t str[CONFIG_COMMAND_BUFFER_SIZE];
+  unsigned int len;
+
+  if (!hostsim_busmode) {
+    fprintf(stderr, "burst: only available in bus mode\n");
+    return;
+  }
+
+  len = parse_string(str, name, sizeof(str));
+
+  start_transfer();
+  readbuf_len = 0;
+  check_status("burst", c64_burst_load(str, len, store_byte));
+  report_transfer("burst", readbuf_len);
+  write_file(outname, readbuf, readbuf_len);
+}
+
+static void do_burst_read(char *line) {
+  int track, sector, count;
+
+  if (!hostsim_busmode) {
+    fprintf(stderr, "bread: only available in bus mode\n");
+    return;
+  }
+
+  if ((track  = parse_byte(&line)) < 0 ||
+      (sector = parse_byte(&line)) < 0 ||
+      (count  = parse_byte(&line)) < 0) {
+    fprintf(stderr, "bread: invalid track, sector or count\n");
+    return;
+  }
+
+  start_transfer();
+  readbuf_len = 0;
+  check_status("bread", c64_burst_read(track, sector, count, store_byte));
+  report_transfer("bread", readbuf_len);
+  write_file(next_word(&line), readbuf, readbuf_len);
+}
+
+static void do_burst_write(char *line) {
+  int track, sector;
+  uint8_t *data;
+  size_t len;
+  char *inname;
+
+  if (!hostsim_busmode) {
+    fprintf(stderr, "bwrite: only available in bus mode\n");
+    return;
+  }
+
+  if ((track  = parse_byte(&line)) < 0 ||
+      (sector = parse_byte(&line)) < 0) {
+    fprintf(stderr, "bwrite: invalid track or sector\n");
+    return;
+  }
+
+  inname = next_word(&line);
+  if (inname == NULL) {
+    fprintf(stderr, "bwrite: missing file name\n");
+    return;
+  }
+
+  data = read_file(inname, &len);
+  if (data == NULL)
+    return;
+
+  if (len == 0 || len % 256 || len / 256 > 255) {
+    fprintf(stderr, "bwrite: file size must be a multiple of 256 bytes\n");
+    free(data);
+    return;
+  }
+
+  start_transfer();
+  check_status("bwrite", c64_burst_write(track, sector, data, len / 256));
+  report_transfer("bwrite", len);
+  free(data);
+}
+
+static void set_protocol(const char *name) {
+  c64_protocol_t proto;
+
+  if (!hostsim_busmode) {
+    fprintf(stderr, "protocol: only available in bus mode\n");
+    return;
+  }
+
+  if (name == NULL)
+    name = "";
+
+  if (!strcmp(name, "serial")) {
+    proto = PROTO_SERIAL;
+  } else if (!strcmp(name, "jiffy")) {
+    proto = PROTO_JIFFY;
+  } else if (!strcmp(name, "fast")) {
+    proto = PROTO_FAST;
+  } else {
+    fprintf(stderr, "protocol: unknown protocol %s\n", name);
+    return;
+  }
+
+  if (c64_set_protocol(proto))
+    fprintf(stderr, "protocol: %s is not supported by this build\n", name);
+}
+
+/* print a BASIC-style directory listing from readbuf */
+static void print_directory(size_t len) {
+  size_t pos = 2;
+
+  while (pos + 4 <= len) {
+    if (readbuf[pos] == 0 && readbuf[pos+1] == 0)
+      break;
+
+    printf("%u ", readbuf[pos+2] | (readbuf[pos+3] << 8));
+    pos += 4;
+
+    while (pos < len && readbuf[pos] != 0) {
+      uint8_t c = readbuf[pos++];
+
+      putchar((c >= 0x20 && c < 0x7f) ? c : '.');
+    }
+    putchar('\n');
+    pos++;
+  }
+}
+
+static void run_line(char *line) {
+  char *cmd, *arg;
+  int sa;
+
+  cmd = next_word(&line);
+  if (cmd == NULL || cmd[0] == '#')
+    return;
+
+  if (!strcmp(cmd, "open")) {
+    if ((sa = parse_sa(&line)) < 0)
+      goto badsa;
+    do_open(sa, line);
+
+  } else if (!strcmp(cmd, "cmd")) {
+    do_open(0x0f, line);
+
+  } else if (!strcmp(cmd, "read")) {
+    if ((sa = parse_sa(&line)) < 0)
+      goto badsa;
+    do_read(sa, next_word(&line));
+
+  } else if (!strcmp(cmd, "write")) {
+    if ((sa = parse_sa(&line)) < 0)
+      goto badsa;
+    do_write(sa, next_word(&line));
+
+  } else if (!strcmp(cmd, "close")) {
+    if ((sa = parse_sa(&line)) < 0)
+      goto badsa;
+    close_channel(sa);
+
+  } else if (!strcmp(cmd, "status")) {
+    print_status();
+
+  } else if (!strcmp(cmd, "load")) {
+    arg = next_word(&line);
+    if (arg == NULL) {
+      fprintf(stderr, "load: missing file name\n");
+      return;
+    }
+    do_load(arg, next_word(&line));
+
+  } else if (!strcmp(cmd, "burst")) {
+    arg = next_word(&line);
+    if (arg == NULL) {
+      fprintf(stderr, "burst: missing file name\n");
+      return;
+    }
+    do_burst(arg, next_word(&line));
+
+  } else if (!strcmp(cmd, "bread")) {
+    do_burst_read(line);
+
+  } else if (!strcmp(cmd, "bwrite")) {
+    do_burst_write(line);
+
+  } else if (!strcmp(cmd, "save")) {
+    arg = next_word(&line);
+    if (arg == NULL) {
+      fprintf(stderr, "save: missing file name\n");
+      return;
+    }
+    do_open(1, arg);
+    do_write(1, next_word(&line));
+    close_channel(1);
+
+  } else if (!strcmp(cmd, "dir")) {
+    size_t len;
+
+    do_open(0, *line ? line : "$");
+    len = talk(0);
+    close_channel(0);
+    print_directory(len);
+
+  } else if (!strcmp(cmd, "protocol")) {
+    set_protocol(next_word(&line));
+
+  } else if (!strcmp(cmd, "quit")) {
+    fflush(stdout);
+    exit(0);
+
+  } else {
+    fprintf(stderr, "unknown command: %s\n", cmd);
+  }
+  return;
+
+ badsa:
+  fprintf(stderr, "%s: invalid secondary address\n", cmd);
+}
+
+static void run_script(void) {
+  char line[LINE_LENGTH];
+  FILE *script = stdin;
+
+  if (hostsim_script_name != NULL) {
+    script = fopen(hostsim_script_name, "r");
+    if (script == NULL) {
+      perror(hostsim_script_name);
+      exit(2);
+    }
+  }
+
+  while (fgets(line, sizeof(line), script) != NULL) {
+    line[strcspn(line, "\r\n")] = 0;
+    run_line(line);
+    fflush(stdout);
+  }
+}
+
+/* write deferred image data to the card image before exiting */
+static void sync_on_exit(void) {
+  image_sync_all();
+}
+
+void hostbus_mainloop(void) {
+  atexit(sync_on_exit);
+
+  if (hostsim_busmode) {
+    /* the script runs on the simulated computer */
+    hostsim_start_host(run_script);
+    iec_mainloop();
+  }
+
+  set_error(ERROR_DOSVERSION);
+  iec_data.bus_state = BUS_IDLE;
+
+  run_script();
+  exit(0);
+}
+void bus_mainloop(void) __attribute__ ((alias("hostbus_mainloop")));
@@ -0,0 +1,95 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+   hostsim.h: Internal interfaces between the hostsim modules
+
+*/
+
+#ifndef HOSTSIM_H
+#define HOSTSIM_H
+
+#include <stddef.h>
+
+/* Virtual time needed by the firmware for a single bus read */
+#define HOSTSIM_POLL_NS 100
+
+/* Current time in nanoseconds, virtual time in bus mode (arch-timer.c) */
+uint64_t hostsim_time_ns(void);
+
+/* Timer signal entry point, runs or defers the tick handler (system.c) */
+void hostsim_timer_irq(void);
+
+/* Name of the card image and script files, NULL if unset (system.c) */
+extern const char *hostsim_image_name;
+extern const char *hostsim_script_name;
+
+/* Set if the script drives the simulated IEC bus instead of the buffers */
+extern uint8_t hostsim_busmode;
+
+/* ----- virtual time, only used in bus mode (virtual-time.c) ----- */
+
+uint64_t hostsim_vtime_ns(void);
+void hostsim_advance(uint64_t ns);
+void hostsim_sleep(void);
+void hostsim_start_host(void (*host_main)(void));
+unsigned int hostsim_in_host(void);
+void hostsim_bus_changed(iec_bus_t lines);
+
+/* host side: wait or wait for a bus state, returns 0 on timeout */
+void host_delay_ns(uint64_t ns);
+unsigned int host_wait_bus(iec_bus_t mask, iec_bus_t value, uint64_t timeout_ns);
+
+/* ----- bus lines, host side (iec-bus.c) ----- */
+
+iec_bus_t host_bus_read(void);
+void host_set_line(iec_bus_t line, unsigned int state);
+void hostsim_iec_irqs(void);
+uint64_t hostsim_match_next(unsigned int *matches);
+void hostsim_match_fire(unsigned int matches);
+void host_fs_reset(void);
+uint8_t host_fs_byte_ready(void);
+uint8_t host_fs_read_byte(void);
+
+/* ----- computer side of the bus (c64host.c) ----- */
+
+typedef enum { PROTO_SERIAL, PROTO_JIFFY, PROTO_FAST } c64_protocol_t;
+
+typedef struct {
+  uint32_t bytes;
+  uint32_t handshakes;
+  uint64_t handshake_ns;
+  uint64_t handshake_max_ns;
+} c64_stats_t;
+
+extern c64_stats_t c64_stats;
+
+uint8_t c64_set_protocol(c64_protocol_t proto);
+uint8_t c64_open(uint8_t sa, const uint8_t *name, unsigned int len);
+uint8_t c64_read(uint8_t sa, void (*store)(uint8_t));
+uint8_t c64_load(const uint8_t *name, unsigned int len, void (*store)(uint8_t));
+uint8_t c64_burst_load(const uint8_t *name, unsigned int len, void (*store)(uint8_t));
+uint8_t c64_burst_read(uint8_t track, uint8_t sector, uint8_t count,
+                       void (*store)(uint8_t));
+uint8_t c64_burst_write(uint8_t track, uint8_t sector, const uint8_t *data,
+                        uint8_t count);
+uint8_t c64_write(uint8_t sa, const uint8_t *data, size_t len);
+uint8_t c64_close(uint8_t sa);
+
+#endif
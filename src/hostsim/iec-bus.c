@@ -0,0 +1,311 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+   iec-bus.c: Simulated IEC bus lines
+
+   The bus is modelled as a wired-AND of the lines pulled low by the
+   firmware and by the simulated computer. Line changes are checked
+   for the events that need an interrupt on real hardware: falling
+   edges on ATN and rising edges on SRQ, which clock the fast serial
+   shift registers on both sides.
+
+   CLOCK and DATA can also be changed by a model of the match unit of
+   the LPC17xx timer, which lpc17xx/iec-tx.c uses to send standard
+   serial bytes. Its counter runs in 100ns steps of the virtual time.
+   Only the set and clear actions are supported and IR is not
+   evaluated: a match with its interrupt enabled in MCR runs the
+   transmit handler directly.
+
+*/
+
+#include "config.h"
+#include "atomic.h"
+#include "fastloader-ll.h"
+#include "hostsim.h"
+#include "system.h"
+#include "timer.h"
+#include "iec-bus.h"
+
+#define ALL_LINES (IEC_BIT_ATN | IEC_BIT_CLOCK | IEC_BIT_DATA | IEC_BIT_SRQ)
+
+/* lines pulled low by the device and by the computer */
+static iec_bus_t device_low, host_low;
+
+static uint8_t atn_irq_enabled, atn_irq_pending;
+static uint8_t match_irq_pending, match_irq_active;
+
+hostsim_timer_t hostsim_iec_timer;
+
+/* bus line of each match output */
+static const iec_bus_t match_line[2] = { IEC_BIT_CLOCK, IEC_BIT_DATA };
+
+IEC_ATN_HANDLER;
+IEC_TX_HANDLER;
+
+/* fast serial shift registers, the lowest bit marks the end of a byte */
+typedef struct {
+  uint8_t shadow;
+  uint8_t data;
+  uint8_t ready;
+} shiftreg_t;
+
+static shiftreg_t device_sr = { 1, 0, 0 };
+static shiftreg_t host_sr   = { 1, 0, 0 };
+
+static iec_bus_t bus_state(void) {
+  return ~(device_low | host_low) & ALL_LINES;
+}
+
+static void shift_bit(shiftreg_t *sr, iec_bus_t lines) {
+  uint8_t carry = sr->shadow & 0x80;
+
+  sr->shadow = (sr->shadow << 1) | !!(lines & IEC_BIT_DATA);
+  if (carry) {
+    sr->data   = sr->shadow;
+    sr->ready  = 1;
+    sr->shadow = 1;
+  }
+}
+
+/* evaluate a line change caused by one side of the bus */
+static void bus_update(iec_bus_t old, unsigned int by_host) {
+  iec_bus_t lines = bus_state();
+
+  if ((old & IEC_BIT_ATN) && !(lines & IEC_BIT_ATN) && atn_irq_enabled)
+    atn_irq_pending = 1;
+
+  /* the shift register of the sending side ignores its own clock */
+  if (!(old & IEC_BIT_SRQ) && (lines & IEC_BIT_SRQ)) {
+    if (by_host)
+      shift_bit(&device_sr, lines);
+    else
+      shift_bit(&host_sr, lines);
+  }
+
+  if (hostsim_busmode)
+    hostsim_bus_changed(lines);
+}
+
+/* ----- device side ----- */
+
+iec_bus_t hostsim_iec_input(void) {
+  if (hostsim_busmode && !hostsim_in_host())
+    hostsim_advance(HOSTSIM_POLL_NS);
+
+  return bus_state();
+}
+
+void hostsim_iec_output(iec_bus_t line, unsigned int state) {
+  iec_bus_t old = bus_state();
+
+  if (state)
+    device_low &= ~line;
+  else
+    device_low |= line;
+
+  bus_update(old, 0);
+}
+
+void hostsim_set_atn_irq(uint8_t state) {
+  atn_irq_enabled = state;
+}
+
+/* Runs pending bus interrupts unless interrupts are disabled */
+void hostsim_iec_irqs(void) {
+  if (atn_irq_pending && atn_irq_enabled && !interrupts_disabled()) {
+    atn_irq_pending = 0;
+    iec_atn_handler();
+  }
+
+  /* the handler reads the bus, which may fire the next match */
+  while (match_irq_pending && !match_irq_active && !interrupts_disabled()) {
+    match_irq_pending = 0;
+    match_irq_active  = 1;
+    iec_tx_handler();
+    match_irq_active  = 0;
+  }
+}
+
+/* ----- timer match unit ----- */
+
+static uint32_t match_value(unsigned int n) {
+  return n ? hostsim_iec_timer.MR1 : hostsim_iec_timer.MR0;
+}
+
+/* time of the next match of register n, UINT64_MAX if it has no effect */
+static uint64_t match_time(unsigned int n) {
+  uint64_t tc;
+  uint32_t ticks;
+
+  if (!((hostsim_iec_timer.EMR >> (4 + 2 * n)) & 3) &&
+      !hostsim_iec_timer.MCR[3 * n])
+    return UINT64_MAX;
+
+  tc    = hostsim_vtime_ns() / 100;
+  ticks = match_value(n) - (uint32_t)tc;
+
+  /* TC has already reached the value */
+  if (ticks == 0)
+    return UINT64_MAX;
+
+  return (tc + ticks) * 100;
+}
+
+/**
+ * hostsim_match_next - find the next match
+ * @matches: bit mask of the registers that match at this time
+ *
+ * Returns the virtual time of the next match or UINT64_MAX if no match
+ * register has an effect.
+ */
+uint64_t hostsim_match_next(unsigned int *matches) {
+  uint64_t time, next = UINT64_MAX;
+  unsigned int n;
+
+  *matches = 0;
+  for (n = 0; n < 2; n++) {
+    time = match_time(n);
+    if (time < next) {
+      next     = time;
+      *matches = BV(n);
+    } else if (time == next && time != UINT64_MAX) {
+      *matches |= BV(n);
+    }
+  }
+
+  return next;
+}
+
+/* executes the matches found by hostsim_match_next, time must be set */
+void hostsim_match_fire(unsigned int matches) {
+  unsigned int n;
+
+  for (n = 0; n < 2; n++) {
+    if (!(matches & BV(n)))
+      continue;
+
+    switch ((hostsim_iec_timer.EMR >> (4 + 2 * n)) & 3) {
+    case 1:
+      hostsim_iec_timer.EMR &= ~BV(n);
+      hostsim_iec_output(match_line[n], 0);
+      break;
+
+    case 2:
+      hostsim_iec_timer.EMR |= BV(n);
+      hostsim_iec_output(match_line[n], 1);
+      break;
+
+    default:
+      break;
+    }
+
+    hostsim_iec_timer.IR |= BV(n);
+    if (hostsim_iec_timer.MCR[3 * n])
+      match_irq_pending = 1;
+  }
+}
+
+void iec_interface_init(void) {
+  set_atn(1);
+  set_data(1);
+  set_clock(1);
+  set_srq(1);
+}
+void bus_interface_init(void) __attribute__ ((weak, alias("iec_interface_init")));
+
+#ifdef CONFIG_FAST_SERIAL
+void fs_reset(void) {
+  device_sr.shadow = 1;
+  device_sr.ready  = 0;
+}
+
+uint8_t fs_byte_ready(void) {
+  return device_sr.ready;
+}
+
+uint8_t fs_read_byte(void) {
+  device_sr.ready = 0;
+  return device_sr.data;
+}
+
+void fs_send_byte(uint8_t byte) {
+  uint8_t i;
+
+  for (i = 0; i < 8; i++) {
+    set_data(byte & 0x80);
+    set_srq(0);
+    delay_us(2);
+    set_srq(1);
+    delay_us(3);
+    byte <<= 1;
+  }
+
+  /* exit with DATA high */
+  set_data(1);
+}
+
+uint8_t fs_send_block(const uint8_t *data, uint8_t count, uint8_t clkstate) {
+  uint8_t sent = 0;
+
+  while (sent < count) {
+    /* wait until Clock has the expected level */
+    while ((!IEC_CLOCK) == clkstate) {
+      if (!IEC_ATN)
+        return sent;
+    }
+
+    fs_send_byte(data[sent++]);
+    clkstate = !clkstate;
+  }
+
+  return sent;
+}
+#endif
+
+/* ----- computer side ----- */
+
+iec_bus_t host_bus_read(void) {
+  return bus_state();
+}
+
+void host_set_line(iec_bus_t line, unsigned int state) {
+  iec_bus_t old = bus_state();
+
+  if (state)
+    host_low &= ~line;
+  else
+    host_low |= line;
+
+  bus_update(old, 1);
+}
+
+void host_fs_reset(void) {
+  host_sr.shadow = 1;
+  host_sr.ready  = 0;
+}
+
+uint8_t host_fs_byte_ready(void) {
+  return host_sr.ready;
+}
+
+uint8_t host_fs_read_byte(void) {
+  host_sr.ready = 0;
+  return host_sr.data;
+}
@@ -0,0 +1,232 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+   llfl-common.c: Common subroutines for low-level fastloader code
+
+   This implements the interface of lpc17xx/llfl-common.c on top of
+   the virtual time, so the LPC17xx low-level fastloader code can be
+   used unchanged. Times are given in 100ns units relative to
+   llfl_reference_time, just like the timer ticks on the LPC.
+
+*/
+
+#include "config.h"
+#include "hostsim.h"
+#include "iec-bus.h"
+#include "led.h"
+#include "lpc17xx/llfl-common.h"
+
+#define MAX_SCHEDULED 4
+
+uint32_t llfl_reference_time;
+static uint64_t base_time;
+
+/* line changes requested with NO_WAIT that are still in the future */
+static struct {
+  uint32_t  time;
+  iec_bus_t line;
+  uint8_t   state;
+} scheduled[MAX_SCHEDULED];
+static unsigned int scheduled_count;
+
+/* ---------- utility functions ---------- */
+
+uint32_t llfl_now(void) {
+  return (hostsim_vtime_ns() - base_time) / 100;
+}
+
+static void set_line(iec_bus_t line, unsigned int state) {
+  hostsim_iec_output(line, state);
+}
+
+/* advance to the specified time, executing scheduled changes on the way */
+static void wait_until(uint32_t time) {
+  unsigned int i, first;
+
+  while (1) {
+    first = scheduled_count;
+    for (i = 0; i < scheduled_count; i++)
+      if (scheduled[i].time <= time &&
+          (first == scheduled_count || scheduled[i].time < scheduled[first].time))
+        first = i;
+
+    if (first == scheduled_count)
+      break;
+
+    if (scheduled[first].time > llfl_now())
+      hostsim_advance((uint64_t)(scheduled[first].time - llfl_now()) * 100);
+    set_line(scheduled[first].line, scheduled[first].state);
+
+    scheduled[first] = scheduled[--scheduled_count];
+  }
+
+  if (time > llfl_now())
+    hostsim_advance((uint64_t)(time - llfl_now()) * 100);
+}
+
+void llfl_setup(void) {
+  base_time = hostsim_vtime_ns();
+  scheduled_count = 0;
+}
+
+void llfl_teardown(void) {
+  /* the LPC code cancels all outstanding matches here */
+  scheduled_count = 0;
+}
+
+/* wait until a line has the specified state and capture the time */
+/* (unlike the capture unit on the LPC this checks the level, not an edge) */
+static void wait_line(iec_bus_t line, unsigned int state, llfl_atnabort_t atnabort) {
+  while (1) {
+    iec_bus_t bus = IEC_INPUT;
+
+    if (!!(bus & line) == state)
+      break;
+
+    if (atnabort && !(bus & IEC_BIT_ATN))
+      break;
+  }
+
+  llfl_reference_time = llfl_now();
+}
+
+/**
+ * llfl_wait_atn - wait until ATN has the specified level and capture time
+ * @state: line level to wait for (0 low, 1 high)
+ *
+ * This function waits until the ATN line has the specified level and captures
+ * the time when its level changed.
+ */
+void llfl_wait_atn(unsigned int state) {
+  wait_line(IEC_BIT_ATN, state, NO_ATNABORT);
+}
+
+/* llfl_wait_clock - see llfl_wait_atn, aborts on ATN low if atnabort is true */
+void llfl_wait_clock(unsigned int state, llfl_atnabort_t atnabort) {
+  wait_line(IEC_BIT_CLOCK, state, atnabort);
+}
+
+/* llfl_wait_data - see llfl_wait_atn */
+void llfl_wait_data(unsigned int state, llfl_atnabort_t atnabort) {
+  wait_line(IEC_BIT_DATA, state, atnabort);
+}
+
+/* common part of the llfl_set_*_at functions */
+static void set_line_at(iec_bus_t line, uint32_t time, unsigned int state, llfl_wait_t wait) {
+  time += llfl_reference_time;
+
+  /* check if requested time is possible */
+  if (llfl_now() > time)
+    set_test_led(1);
+
+  if (wait) {
+    wait_until(time);
+    set_line(line, state);
+  } else if (llfl_now() >= time || scheduled_count == MAX_SCHEDULED) {
+    set_line(line, state);
+  } else {
+    scheduled[scheduled_count].time  = time;
+    scheduled[scheduled_count].line  = line;
+    scheduled[scheduled_count].state = state;
+    scheduled_count++;
+  }
+}
+
+/**
+ * llfl_set_clock_at - sets clock line at a specified time offset
+ * @time : change time in 100ns after llfl_reference_time
+ * @state: new line state (0 low, 1 high)
+ * @wait : wait until change happened if 1
+ *
+ * This function sets the clock line to a specified state at a defined time
+ * after the llfl_reference_time set by a previous wait_* function.
+ */
+void llfl_set_clock_at(uint32_t time, unsigned int state, llfl_wait_t wait) {
+  set_line_at(IEC_BIT_CLOCK, time, state, wait);
+}
+
+/* llfl_set_data_at - see llfl_set_clock_at */
+void llfl_set_data_at(uint32_t time, unsigned int state, llfl_wait_t wait) {
+  set_line_at(IEC_BIT_DATA, time, state, wait);
+}
+
+/* llfl_set_srq_at - see llfl_set_clock_at */
+void llfl_set_srq_at(uint32_t time, unsigned int state, llfl_wait_t wait) {
+  set_line_at(IEC_BIT_SRQ, time, state, wait);
+}
+
+/**
+ * llfl_read_bus_at - reads the IEC bus at a certain time
+ * @time: read time in 100ns after llfl_reference_time
+ *
+ * This function returns the current IEC bus state at a certain time
+ * after the llfl_reference_time set by a previous wait_* function.
+ */
+uint32_t llfl_read_bus_at(uint32_t time) {
+  time += llfl_reference_time;
+
+  /* check if requested time is possible */
+  if (llfl_now() >= time)
+    set_test_led(1);
+
+  wait_until(time);
+
+  return host_bus_read() & (IEC_BIT_ATN | IEC_BIT_DATA | IEC_BIT_CLOCK);
+}
+
+/**
+ * llfl_generic_load_2bit - generic 2-bit fastloader transmit
+ * @def : pointer to fastloader definition struct
+ * @byte: data byte
+ *
+ * This function implements generic 2-bit fastloader
+ * transmission based on a generic_2bit_t struct.
+ */
+void llfl_generic_load_2bit(const generic_2bit_t *def, uint8_t byte) {
+  unsigned int i;
+
+  byte ^= def->eorvalue;
+
+  for (i=0;i<4;i++) {
+    llfl_set_clock_at(def->pairtimes[i], byte & (1 << def->clockbits[i]), NO_WAIT);
+    llfl_set_data_at (def->pairtimes[i], byte & (1 << def->databits[i]),  WAIT);
+  }
+}
+
+/**
+ * llfl_generic_save_2bit - generic 2-bit fastsaver receive
+ * @def: pointer to fastloader definition struct
+ *
+ * This function implements genereic 2-bit fastsaver reception
+ * based on a generic_2bit_t struct.
+ */
+uint8_t llfl_generic_save_2bit(const generic_2bit_t *def) {
+  unsigned int i;
+  uint8_t result = 0;
+
+  for (i=0;i<4;i++) {
+    uint32_t bus = llfl_read_bus_at(def->pairtimes[i]);
+
+    result |= (!!(bus & IEC_BIT_CLOCK)) << def->clockbits[i];
+    result |= (!!(bus & IEC_BIT_DATA))  << def->databits[i];
+  }
+
+  return result ^ def->eorvalue;
+}
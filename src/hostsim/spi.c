@@ -0,0 +1,59 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+   spi.c: Low-level SPI routines, hostsim version
+
+   Nothing is connected to the simulated SPI bus, so this
+   behaves like a bus without any devices.
+
+*/
+
+#include <string.h>
+#include "config.h"
+#include "spi.h"
+
+void spi_init(spi_speed_t speed) {
+  (void)speed;
+}
+
+void spi_set_speed(spi_speed_t speed) {
+  (void)speed;
+}
+
+void spi_select_device(spi_device_t dev) {
+  (void)dev;
+}
+
+void spi_tx_byte(uint8_t data) {
+  (void)data;
+}
+
+void spi_tx_block(const void *data, unsigned int length) {
+  (void)data;
+  (void)length;
+}
+
+uint8_t spi_rx_byte(void) {
+  return 0xff;
+}
+
+void spi_rx_block(void *data, unsigned int length) {
+  memset(data, 0xff, length);
+}
@@ -0,0 +1,144 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+   system.c: System-specific initialisation (hostsim version)
+
+   The simulator is configured using environment variables:
+     HOSTSIM_IMAGE   - raw card image (required)
+     HOSTSIM_SCRIPT  - command script for hostbus.c (default: stdin)
+     HOSTSIM_ADDRESS - device address (default: 8)
+     HOSTSIM_BUS     - "iec" runs the script on a simulated computer
+                       connected via the IEC bus, see hostbus.c
+
+*/
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "config.h"
+#include "hostsim.h"
+#include "system.h"
+
+uint8_t hostsim_device_address = 8;
+uint8_t hostsim_busmode;
+volatile uint8_t hostsim_leds;
+
+const char *hostsim_image_name;
+const char *hostsim_script_name;
+
+/* simulated interrupt flag, ticks are deferred while it is set */
+static volatile sig_atomic_t irqs_disabled;
+static volatile sig_atomic_t ticks_pending;
+static volatile sig_atomic_t tick_active;
+
+SYSTEM_TICK_HANDLER;
+
+/* Early system initialisation */
+void system_init_early(void) {
+  const char *addr, *bus;
+
+  irqs_disabled = 1;
+
+  hostsim_image_name  = getenv("HOSTSIM_IMAGE");
+  hostsim_script_name = getenv("HOSTSIM_SCRIPT");
+
+  addr = getenv("HOSTSIM_ADDRESS");
+  if (addr != NULL)
+    hostsim_device_address = strtoul(addr, NULL, 0);
+
+  bus = getenv("HOSTSIM_BUS");
+  if (bus != NULL && *bus) {
+    if (strcmp(bus, "iec")) {
+      fprintf(stderr, "HOSTSIM_BUS: unknown bus %s\n", bus);
+      exit(2);
+    }
+    hostsim_busmode = 1;
+  }
+
+  if (hostsim_image_name == NULL) {
+    fprintf(stderr, "HOSTSIM_IMAGE must point to a raw card image\n");
+    exit(2);
+  }
+}
+
+/* Late initialisation */
+void system_init_late(void) {
+  return;
+}
+
+/* Wait for the next timer signal or bus event */
+void system_sleep(void) {
+  if (hostsim_busmode)
+    hostsim_sleep();
+  else
+    pause();
+}
+
+/* Reset MCU - there is nothing to return to, so just stop */
+void system_reset(void) {
+  fflush(stdout);
+  fprintf(stderr, "system_reset called, exiting\n");
+  exit(0);
+}
+
+/* run all pending ticks, must not be interrupted by the timer signal */
+static void run_ticks(void) {
+  tick_active = 1;
+  while (ticks_pending > 0 && !irqs_disabled) {
+    ticks_pending--;
+    hostsim_tick_handler();
+  }
+  tick_active = 0;
+}
+
+/* Timer signal entry point */
+void hostsim_timer_irq(void) {
+  ticks_pending++;
+  if (!irqs_disabled && !tick_active)
+    run_ticks();
+}
+
+/* Disable interrupts */
+void disable_interrupts(void) {
+  irqs_disabled = 1;
+}
+
+/* Enable interrupts */
+void enable_interrupts(void) {
+  irqs_disabled = 0;
+
+  if (ticks_pending > 0 && !tick_active) {
+    sigset_t set, oldset;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    sigprocmask(SIG_BLOCK, &set, &oldset);
+    run_ticks();
+    sigprocmask(SIG_SETMASK, &oldset, NULL);
+  }
+
+  hostsim_iec_irqs();
+}
+
+unsigned int interrupts_disabled(void) {
+  return irqs_disabled;
+}
@@ -0,0 +1,80 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+   uart.c: UART access routines for hostsim, output goes to stderr
+
+*/
+
+#include <stdio.h>
+#include "config.h"
+#include "uart.h"
+
+void uart_init(void) {
+  setvbuf(stderr, NULL, _IOLBF, 0);
+}
+
+unsigned char uart_getc(void) {
+  return 0;
+}
+
+void uart_putc(char c) {
+  fputc(c, stderr);
+}
+
+void uart_puthex(uint8_t num) {
+  fprintf(stderr, "%02X", num);
+}
+
+void uart_trace(void *ptr, uint16_t start, uint16_t len) {
+  uint16_t i;
+  uint8_t j;
+  uint8_t ch;
+  uint8_t *data = ptr;
+
+  data += start;
+  for (i = 0; i < len; i += 16) {
+    fprintf(stderr, "%04X|", start + i);
+    for (j = 0; j < 16; j++) {
+      if (i + j < len)
+        fprintf(stderr, " %02X", data[j]);
+      else
+        fputs("   ", stderr);
+    }
+    fputs(" |", stderr);
+    for (j = 0; j < 16 && i + j < len; j++) {
+      ch = data[j];
+      fputc((ch >= 0x20 && ch < 0x7f) ? ch : '.', stderr);
+    }
+    fputs("|\r\n", stderr);
+    data += 16;
+  }
+}
+
+void uart_flush(void) {
+  fflush(stderr);
+}
+
+void uart_puts_P(const char *text) {
+  fputs(text, stderr);
+}
+
+void uart_putcrlf(void) {
+  fputs("\r\n", stderr);
+}
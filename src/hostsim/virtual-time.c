@@ -0,0 +1,222 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+   virtual-time.c: Virtual time and the simulated computer
+
+   In bus mode the firmware and the simulated computer on the other
+   end of the bus run as two coroutines on a common virtual clock.
+   The firmware advances the clock in delays, timeouts and bus polls,
+   all other code runs in zero time. Whenever the clock passes the
+   point where the computer wants to continue - either because its
+   delay has expired or because the bus reached the state it was
+   waiting for - the computer runs until it blocks again. The system
+   tick is generated from the same clock, so the results do not
+   depend on the speed or load of the machine running the simulation.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+#include "config.h"
+#include "hostsim.h"
+#include "system.h"
+#include "timer.h"
+
+#define HOST_STACK_SIZE (256 * 1024)
+#define TICK_NS         (1000000000ULL / HZ)
+#define NEVER           UINT64_MAX
+
+static uint64_t now;
+static uint64_t next_tick = TICK_NS;
+
+static ucontext_t firmware_context, host_context;
+static uint8_t    running_host;
+
+/* host wakeup conditions */
+static uint64_t  host_wakeup = NEVER;
+static iec_bus_t wait_mask, wait_value;
+static uint8_t   wait_active, wait_done;
+static uint64_t  wait_done_time;
+
+static void set_time(uint64_t time) {
+  now = time;
+  hostsim_iec_timer.TC = time / 100;
+}
+
+uint64_t hostsim_vtime_ns(void) {
+  return now;
+}
+
+unsigned int hostsim_in_host(void) {
+  return running_host;
+}
+
+/* time at which the host wants to run next */
+static uint64_t host_time(void) {
+  if (wait_done)
+    return wait_done_time;
+  else
+    return host_wakeup;
+}
+
+/* called by the bus model for every change of the bus lines */
+void hostsim_bus_changed(iec_bus_t lines) {
+  if (wait_active && !wait_done && (lines & wait_mask) == wait_value) {
+    wait_done      = 1;
+    wait_done_time = now;
+  }
+}
+
+/**
+ * hostsim_advance - advance the firmware time
+ * @ns: number of nanoseconds
+ *
+ * This function advances the virtual time, running the timer tick
+ * and the host whenever they are due. Must not be called by the host.
+ */
+void hostsim_advance(uint64_t ns) {
+  uint64_t target = now + ns;
+
+  while (1) {
+    uint64_t host = host_time();
+    unsigned int matches;
+    uint64_t match = hostsim_match_next(&matches);
+
+    if (match <= next_tick && match <= host) {
+      if (match > target)
+        break;
+
+      set_time(match);
+      hostsim_match_fire(matches);
+    } else if (next_tick <= host) {
+      if (next_tick > target)
+        break;
+
+      set_time(next_tick);
+      next_tick += TICK_NS;
+      hostsim_timer_irq();
+    } else {
+      if (host > target)
+        break;
+
+      if (host > now)
+        set_time(host);
+
+      running_host = 1;
+      swapcontext(&firmware_context, &host_context);
+      running_host = 0;
+    }
+
+    hostsim_iec_irqs();
+  }
+
+  /* interrupt handlers may already have moved the time further */
+  if (now < target)
+    set_time(target);
+
+  hostsim_iec_irqs();
+}
+
+/* Advance to the next event, used instead of waiting for an interrupt */
+void hostsim_sleep(void) {
+  uint64_t next = host_time();
+  unsigned int matches;
+  uint64_t match = hostsim_match_next(&matches);
+
+  if (next_tick < next)
+    next = next_tick;
+  if (match < next)
+    next = match;
+
+  hostsim_advance(next > now ? next - now : 0);
+}
+
+/* ----- host side ----- */
+
+static void (*host_function)(void);
+
+static void host_entry(void) {
+  host_function();
+  fflush(stdout);
+  exit(0);
+}
+
+/**
+ * hostsim_start_host - set up the host coroutine
+ * @host_main: function to run, exits the simulation when it returns
+ *
+ * The host starts running the next time the firmware advances the time.
+ */
+void hostsim_start_host(void (*host_main)(void)) {
+  static uint8_t stack[HOST_STACK_SIZE];
+
+  host_function = host_main;
+
+  getcontext(&host_context);
+  host_context.uc_stack.ss_sp   = stack;
+  host_context.uc_stack.ss_size = sizeof(stack);
+  host_context.uc_link          = NULL;
+  makecontext(&host_context, host_entry, 0);
+
+  host_wakeup = now;
+}
+
+/* return control to the firmware until the host is due again */
+static void host_yield(void) {
+  running_host = 0;
+  swapcontext(&host_context, &firmware_context);
+  running_host = 1;
+}
+
+void host_delay_ns(uint64_t ns) {
+  host_wakeup = now + ns;
+  host_yield();
+}
+
+/**
+ * host_wait_bus - wait until the bus reaches a certain state
+ * @mask      : bus lines to check
+ * @value     : expected state of the lines in mask
+ * @timeout_ns: timeout in nanoseconds
+ *
+ * This function waits until (bus & mask) == value or the timeout
+ * has passed. Returns 1 if the state was reached, 0 on timeout.
+ */
+unsigned int host_wait_bus(iec_bus_t mask, iec_bus_t value, uint64_t timeout_ns) {
+  unsigned int result;
+
+  if ((host_bus_read() & mask) == value)
+    return 1;
+
+  wait_mask   = mask;
+  wait_value  = value;
+  wait_active = 1;
+  wait_done   = 0;
+  host_wakeup = now + timeout_ns;
+
+  host_yield();
+
+  result      = wait_done;
+  wait_active = 0;
+  wait_done   = 0;
+
+  return result;
+}
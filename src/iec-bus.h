@@ -47,4 +47,10 @@ static inline iec_bus_t iec_bus_read(void) {
 
 void iec_interface_init(void);
 
+#ifdef HAVE_IEC_TX
+/* Send the bits of a standard serial byte in the background */
+uint8_t iec_tx_start(uint8_t data, uint8_t vc20);
+uint8_t iec_tx_wait(void);
+#endif
+
 #endif
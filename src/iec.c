@@ -202,6 +202,65 @@ done:
 }
 
 
+/**
+ * iec_putc_ack - wait for the acknowledge of the listener
+ *
+ * This function waits until the listener has acknowledged the byte that
+ * was just sent. Returns 0 normally or -1 if the bus state has changed.
+ */
+static uint8_t iec_putc_ack(void) {
+  do {
+    if (iec_check_atn()) return -1;
+  } while (iec_debounced() & IEC_BIT_DATA);
+
+  /* More stuff that's not in the original rom:
+   *   Wait for 250us or until DATA is high or ATN is low.
+   * This fixes a problem with Castle Wolfenstein.
+   * Bus traces seem to indicate that a real 1541 needs
+   * about 350us between two bytes, sd2iec is usually WAY faster.
+   */
+  start_timeout(250);
+  while (!IEC_DATA && IEC_ATN && !has_timed_out()) ;
+
+  return 0;
+}
+
+#ifdef HAVE_IEC_TX
+/* Set while the bits of a byte are clocked out in the background */
+static uint8_t tx_pending;
+
+/**
+ * iec_putc_finish - complete a byte sent in the background
+ *
+ * This function waits until the data bits of the previous byte have
+ * been sent and handles the acknowledge of the listener. Returns 0
+ * normally or -1 if the bus state has changed.
+ */
+static uint8_t iec_putc_finish(void) {
+  if (!tx_pending)
+    return 0;
+
+  tx_pending = 0;
+  if (iec_tx_wait()) {
+    iec_data.bus_state = BUS_CLEANUP;
+    return -1;
+  }
+
+  return iec_putc_ack();
+}
+
+/* Stops waiting for a byte sent in the background */
+static void iec_putc_drain(void) {
+  if (tx_pending) {
+    iec_tx_wait();
+    tx_pending = 0;
+  }
+}
+#else
+#  define iec_putc_finish() 0
+#  define iec_putc_drain() do {} while (0)
+#endif
+
 /**
  * iec_putc - send a byte over the serial bus (E916)
  * @data    : byte to be sent
@@ -210,20 +269,16 @@ done:
  * This function sends the byte data over the serial bus, optionally including
  * a marker for the EOI condition. Returns 0 normally or -1 if the bus state has
  * changed, the caller should return to the main loop in that case.
+ * If the hardware can send the data bits in the background, a byte without
+ * EOI is only completed by the next call, so a failure may be reported
+ * one byte late.
  */
 static uint8_t iec_putc(uint8_t data, const uint8_t with_eoi) {
   uint8_t i;
 
-  if (iec_check_atn()) return -1;                      // E916
+  if (iec_putc_finish()) return -1;
 
-  if (iec_data.iecflags & JIFFY_ACTIVE) {
-    /* This is the non-load Jiffy case */
-    if (jiffy_send(data, with_eoi, 0)) {
-      iec_check_atn();
-      return -1;
-    }
-    return 0;
-  }
+  if (iec_check_atn()) return -1;                      // E916
 
   i = iec_debounced();
 
@@ -257,6 +312,19 @@ static uint8_t iec_putc(uint8_t data, const uint8_t with_eoi) {
   delay_us(21); // calculated - E951 (best case after bus read) - E95B
 
   if (!(iec_data.iecflags & FAST_SERIAL)) {
+#ifdef HAVE_IEC_TX
+    if (iec_tx_start(data, globalflags & VC20MODE)) { // E95C
+      iec_data.bus_state = BUS_CLEANUP;
+      return -1;
+    }
+
+    /* The acknowledge is handled by the next call unless EOI is sent */
+    tx_pending = 1;
+    if (!with_eoi)
+      return 0;
+
+    return iec_putc_finish();
+#else
     for (i=0;i<8;i++) {
       if (!(iec_debounced() & IEC_BIT_DATA)) { // E95C
         iec_data.bus_state = BUS_CLEANUP;
@@ -277,24 +345,12 @@ static uint8_t iec_putc(uint8_t data, const uint8_t with_eoi) {
       set_data(1);      // FEFE
       delay_us(14);     // Settle time, approximate
     }
+#endif
   } else { // fast_serial
     fs_send_byte(data); // releases DATA after the last bit
   }
 
-  do {
-    if (iec_check_atn()) return -1;
-  } while (iec_debounced() & IEC_BIT_DATA);
-
-  /* More stuff that's not in the original rom:
-   *   Wait for 250us or until DATA is high or ATN is low.
-   * This fixes a problem with Castle Wolfenstein.
-   * Bus traces seem to indicate that a real 1541 needs
-   * about 350us between two bytes, sd2iec is usually WAY faster.
-   */
-  start_timeout(250);
-  while (!IEC_DATA && IEC_ATN && !has_timed_out()) ;
-
-  return 0;
+  return iec_putc_ack();
 }
 
 
@@ -388,6 +444,71 @@ static uint8_t iec_listen_handler(const uint8_t cmd) {
   }
 }
 
+/**
+ * iec_jiffy_send_buffer - send the remaining buffer contents with JiffyDOS
+ * @buf: buffer to be sent
+ *
+ * This function sends all bytes from the current position to the end of
+ * the buffer using either the normal or the LOAD variant of the JiffyDOS
+ * protocol. ATN is checked by the caller only once for the whole block,
+ * the low-level code aborts the transfer if ATN becomes active between
+ * two bytes. Returns 0 normally or 1 if the transfer was aborted.
+ */
+static uint8_t iec_jiffy_send_buffer(buffer_t *buf) {
+  uint16_t count, sent;
+  uint8_t  flags;
+
+  if (buf->position <= buf->lastused)
+    count = buf->lastused - buf->position + 1;
+  else
+    count = 1;
+
+  if (iec_data.iecflags & JIFFY_LOAD) {
+    /* The final byte in the buffer is sent with Clock low to signal */
+    /* that the next transfer will take some time. The C64 samples   */
+    /* this just after it has set Data Low before the first bitpair. */
+    /* If this marker is not set the time between two bytes must not */
+    /* exceed ~38 C64 cycles (estimated) or the computer may see a   */
+    /* previous data bit as the marker.                              */
+    flags = JIFFY_BLOCK_LOAD;
+  } else {
+    if (iec_check_atn())
+      return 1;
+
+    flags = buf->sendeoi ? JIFFY_BLOCK_EOI : 0;
+  }
+
+  sent = jiffy_send_block(buf->data + buf->position, count, flags);
+  if (sent != count) {
+    /* Abort if ATN was seen */
+    buf->position += sent;
+    iec_check_atn();
+    return 1;
+  }
+
+  buf->position += count;
+
+  if (buf->sendeoi) {
+    if (iec_data.iecflags & JIFFY_LOAD) {
+      /* Send EOI marker */
+      delay_us(100);
+      set_clock(1);
+      delay_us(100);
+      set_clock(0);
+      delay_us(100);
+      set_clock(1);
+    } else {
+      /* Jiffy resets the EOI condition on the bus after 30-40us. */
+      /* We use 50 to play it safe.                               */
+      delay_us(50);
+      set_data(1);
+      set_clock(0);
+    }
+  }
+
+  return 0;
+}
+
 /**
  * iec_talk_handler - handle an incoming TALK request (E909)
  * @cmd: command byte received from the bus
@@ -432,34 +553,21 @@ static uint8_t iec_talk_handler(uint8_t cmd) {
   }
 
   while (buf->read) {
-    do {
-      uint8_t finalbyte = (buf->position == buf->lastused);
-      if (iec_data.iecflags & JIFFY_LOAD) {
-        /* Send a byte using the LOAD protocol variant */
-        /* The final byte in the buffer must be sent with Clock low   */
-        /* to signal that the next transfer will take some time.      */
-        /* The C64 samples this just after it has set Data Low before */
-        /* the first bitpair. If this marker is not set the time      */
-        /* between two bytes outside the assembler function must not  */
-        /* exceed ~38 C64 cycles (estimated) or the computer may      */
-        /* see a previous data bit as the marker.                     */
-        if (jiffy_send(buf->data[buf->position],0,128 | !finalbyte)) {
-          /* Abort if ATN was seen */
-          iec_check_atn();
-          return -1;
-        }
+    if (iec_data.iecflags & JIFFY_ACTIVE) {
+      /* Send the remainder of the buffer in a single call */
+      if (iec_jiffy_send_buffer(buf))
+        return 1;
+    } else {
+      do {
+        uint8_t finalbyte = (buf->position == buf->lastused);
+        uint8_t res;
 
-        if (finalbyte && buf->sendeoi) {
-          /* Send EOI marker */
-          delay_us(100);
-          set_clock(1);
-          delay_us(100);
-          set_clock(0);
-          delay_us(100);
-          set_clock(1);
+        /* The talker may hold Clock before a byte for as long as it */
+        /* wants, use this time to prepare the next buffer refill.   */
+        if (!(iec_data.iecflags & DOLPHIN_ACTIVE)) {
+          readahead_run();
+          buffer_prefetch(buf);
         }
-      } else {
-        uint8_t res;
 
         if (finalbyte && buf->sendeoi) {
           /* Send with EOI */
@@ -468,13 +576,6 @@ static uint8_t iec_talk_handler(uint8_t cmd) {
           else
             res = iec_putc(buf->data[buf->position], 1);
 
-          if (iec_data.iecflags & JIFFY_ACTIVE) {
-            /* Jiffy resets the EOI condition on the bus after 30-40us. */
-            /* We use 50 to play it safe.                               */
-            delay_us(50);
-            set_data(1);
-            set_clock(0);
-          }
           if (res) {
             uart_putc('Q');
             return 1;
@@ -491,8 +592,8 @@ static uint8_t iec_talk_handler(uint8_t cmd) {
             return 1;
           }
         }
-      }
-    } while (buf->position++ < buf->lastused);
+      } while (buf->position++ < buf->lastused);
+    }
 
     if (buf->sendeoi &&
         (cmd & 0x0f) != 0x0f &&
@@ -574,6 +675,7 @@ void iec_mainloop(void) {
       set_error(ERROR_OK);
       set_busy_led(0);
       set_dirty_led(1);
+      image_sync_all();
 
       /* Wait until the sleep key is used again */
       while (!key_pressed(KEY_SLEEP))
@@ -607,6 +709,7 @@ void iec_mainloop(void) {
           display_service();
           reset_key(KEY_DISPLAY);
         }
+        image_sync_idle();
         system_sleep();
       }
 
@@ -768,12 +871,16 @@ void iec_mainloop(void) {
         if (iec_listen_handler(cmd))
           break;
       } else if (iec_data.device_state == DEVICE_TALK) {
+        uint8_t res;
+
         set_data(1);
         delay_us(50);    // Implicit delay, fudged
         set_clock(0);
         delay_us(70);    // Implicit delay, estimated
 
-        if (iec_talk_handler(cmd))
+        res = iec_talk_handler(cmd);
+        iec_putc_drain();
+        if (res)
           break;
 
       }
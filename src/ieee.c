@@ -495,6 +495,10 @@ static uint8_t ieee_talk_handler (void)
 
   while (buf->read) {
     do {
+      /* DAV can be delayed freely, prepare the next refill meanwhile */
+      readahead_run();
+      buffer_prefetch(buf);
+
       finalbyte = (buf->position == buf->lastused);
       c = buf->data[buf->position];
       if (finalbyte && buf->sendeoi) {
@@ -592,6 +596,7 @@ void ieee_mainloop(void) {
         set_error(ERROR_OK);
         set_busy_led(0);
         uart_puts_P(PSTR("ieee.c/sleep ")); set_dirty_led(1);
+        image_sync_all();
 
         /* Wait until the sleep key is used again */
         while (!key_pressed(KEY_SLEEP))
@@ -622,6 +627,7 @@ void ieee_mainloop(void) {
             display_service();
             reset_key(KEY_DISPLAY);
           }
+          image_sync_idle();
           system_sleep();
       }
 
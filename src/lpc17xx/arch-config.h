@@ -52,11 +52,15 @@ typedef unsigned int rawbutton_t;
 /* IEC in/out are always seperate */
 #define IEC_SEPARATE_OUT
 
+/* Standard serial bytes are sent by the timer match unit, see iec-tx.c */
+#define HAVE_IEC_TX
+
 /* The GPIO interrupt is demuxed in system.c, function names are fixed */
 #define SD_CHANGE_HANDLER  void sdcard_change_handler(void)
 #define IEC_ATN_HANDLER    void iec_atn_handler(void)
 #define IEC_CLOCK_HANDLER  void iec_clock_handler(void)
 #define PARALLEL_HANDLER   void parallel_handler(void)
+#define IEC_TX_HANDLER     void iec_tx_handler(void)
 
 static inline void device_hw_address_init(void) {
   // Nothing, pins are input+pullups by default
@@ -69,6 +73,12 @@ static inline void iec_interrupts_init(void) {
 /* P00 name cache is in AHB ram */
 #define P00CACHE_ATTRIB __attribute__((section(".ahbram")))
 
+/* in-RAM BAM of Dxx images is in AHB ram too */
+#define FULLBAM_ATTRIB __attribute__((section(".ahbram")))
+
+/* Dxx image sector cache as well */
+#define IMAGECACHE_ATTRIB __attribute__((section(".ahbram")))
+
 // FIXME: Add a fully-commented example configuration that
 //        demonstrates all configuration possilibilites
 
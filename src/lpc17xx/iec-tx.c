@@ -0,0 +1,216 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   iec-tx.c: Timer-driven transmission of standard serial bytes
+
+   The eight data bits of a standard serial byte are clocked out by the
+   match unit of the IEC timer. The bus lines are changed by the match
+   hardware at the exact bit times, the interrupt handler only has to
+   schedule the next changes, so the main loop can do something useful
+   while the byte is on the bus.
+
+   Bit timing (in microseconds after the start of the bit, see iec.c):
+     45: DATA = bit
+     67: CLOCK high
+    142: CLOCK low   (101 in VC20 mode)
+    164: DATA high   (123 in VC20 mode)
+    178: next bit starts, DATA must be high (137 in VC20 mode)
+         After the last bit the listener may pull DATA low at once
+         to acknowledge the byte, so it is not checked there.
+
+   All supported boards have the CLOCK and DATA outputs on the same
+   timer, so both match registers share one time base.
+*/
+
+#include "config.h"
+#include "bitband.h"
+#include "iec-bus.h"
+#include "system.h"
+
+#ifdef IEC_OUTPUTS_INVERTED
+#  define EMR_LOW  2
+#  define EMR_HIGH 1
+#else
+#  define EMR_LOW  1
+#  define EMR_HIGH 2
+#endif
+
+#define EMR_SHIFT_CLOCK (4 + 2 * IEC_OPIN_CLOCK)
+#define EMR_SHIFT_DATA  (4 + 2 * IEC_OPIN_DATA)
+
+/* Timer ticks per microsecond */
+#define TICKS 10
+
+/* Minimum distance of a match time from the current time */
+#define MIN_AHEAD (2 * TICKS)
+
+typedef enum { TX_IDLE = 0, TX_CLOCKHIGH, TX_CLOCKLOW, TX_CHECK } txstate_t;
+
+static struct {
+  volatile txstate_t state;
+  volatile uint8_t   error;
+  uint8_t  data;
+  uint8_t  bit;
+  uint8_t  vc20;
+  uint32_t bitstart;
+} tx;
+
+/* Returns a match time that is not in the past */
+static uint32_t future(uint32_t time) {
+  uint32_t now = IEC_MTIMER_CLOCK->TC;
+
+  if ((int32_t)(time - now) < MIN_AHEAD)
+    return now + MIN_AHEAD;
+  else
+    return time;
+}
+
+static void set_clock_match(uint32_t time, unsigned int action, unsigned int irq) {
+  IEC_MTIMER_CLOCK->IEC_MATCH_CLOCK = future(time);
+  IEC_MTIMER_CLOCK->IR = BV(IEC_OPIN_CLOCK);
+  IEC_MTIMER_CLOCK->EMR = (IEC_MTIMER_CLOCK->EMR & ~(3 << EMR_SHIFT_CLOCK)) |
+                          action << EMR_SHIFT_CLOCK;
+  BITBAND(IEC_MTIMER_CLOCK->MCR, 3 * IEC_OPIN_CLOCK) = irq;
+}
+
+static void set_data_match(uint32_t time, unsigned int action) {
+  IEC_MTIMER_DATA->IEC_MATCH_DATA = future(time);
+  IEC_MTIMER_DATA->IR = BV(IEC_OPIN_DATA);
+  IEC_MTIMER_DATA->EMR = (IEC_MTIMER_DATA->EMR & ~(3 << EMR_SHIFT_DATA)) |
+                         action << EMR_SHIFT_DATA;
+}
+
+/* Schedules DATA and CLOCK of the current bit */
+static void start_bit(void) {
+  set_data_match(tx.bitstart + 45 * TICKS,
+                 (tx.data & (1 << tx.bit)) ? EMR_HIGH : EMR_LOW);
+  set_clock_match(tx.bitstart + 67 * TICKS, EMR_HIGH, 1);
+  tx.state = TX_CLOCKHIGH;
+}
+
+/* Stops all match actions, the lines keep their current state */
+static void finish(uint8_t error) {
+  BITBAND(IEC_MTIMER_CLOCK->MCR, 3 * IEC_OPIN_CLOCK) = 0;
+  IEC_MTIMER_CLOCK->EMR &= ~(3 << EMR_SHIFT_CLOCK);
+  IEC_MTIMER_DATA->EMR  &= ~(3 << EMR_SHIFT_DATA);
+  IEC_MTIMER_CLOCK->IR = BV(IEC_OPIN_CLOCK);
+  tx.error = error;
+  tx.state = TX_IDLE;
+}
+
+/**
+ * iec_tx_handler - timer match interrupt handler
+ *
+ * This function is called from the IEC timer interrupt when the
+ * clock match register of the transmitter has fired.
+ */
+void iec_tx_handler(void) {
+  uint32_t clocklow;
+
+  IEC_MTIMER_CLOCK->IR = BV(IEC_OPIN_CLOCK);
+
+  switch (tx.state) {
+  case TX_CLOCKHIGH:
+    /* CLOCK just went high, schedule the end of the bit */
+    if (tx.vc20)
+      clocklow = tx.bitstart + (67 + 34) * TICKS;
+    else
+      clocklow = tx.bitstart + (67 + 75) * TICKS;
+
+    set_clock_match(clocklow, EMR_LOW, 1);
+    set_data_match(clocklow + 22 * TICKS, EMR_HIGH);
+    tx.state = TX_CLOCKLOW;
+    break;
+
+  case TX_CLOCKLOW:
+    /* CLOCK is low again, wait for the settle time after DATA high */
+    tx.bitstart = IEC_MTIMER_CLOCK->IEC_MATCH_CLOCK + (22 + 14) * TICKS;
+    set_clock_match(tx.bitstart, 0, 1);
+    tx.state = TX_CHECK;
+    break;
+
+  case TX_CHECK:
+    /* The listener may acknowledge the byte as soon as it is complete */
+    if (++tx.bit == 8) {
+      finish(0);
+      break;
+    }
+
+    /* The listener must not hold DATA between the bits */
+    if (!IEC_DATA) {
+      finish(1);
+      break;
+    }
+
+    start_bit();
+    break;
+
+  default:
+    /* Should not happen */
+    finish(0);
+    break;
+  }
+}
+
+/**
+ * iec_tx_start - start sending a byte
+ * @data: byte to be sent
+ * @vc20: flags if VC20 timing should be used
+ *
+ * This function starts to send the eight bits of data using the
+ * standard serial protocol. It returns immediately, the bits are
+ * clocked out in the background. The caller must have completed the
+ * handshake that precedes the data bits and must call iec_tx_wait
+ * before touching the bus lines again. Returns 1 if the listener
+ * holds DATA low, 0 otherwise.
+ */
+uint8_t iec_tx_start(uint8_t data, uint8_t vc20) {
+  if (!IEC_DATA)
+    return 1;
+
+  tx.data     = data;
+  tx.bit      = 0;
+  tx.vc20     = vc20;
+  tx.error    = 0;
+  tx.bitstart = IEC_MTIMER_CLOCK->TC;
+  start_bit();
+  return 0;
+}
+
+/**
+ * iec_tx_wait - wait until the current byte has been sent
+ *
+ * This function waits until the byte started by iec_tx_start has been
+ * clocked out completely. Returns 1 if the listener has signalled a
+ * framing error by holding DATA low between two bits, 0 otherwise.
+ */
+uint8_t iec_tx_wait(void) {
+  /* WFI also wakes up for an interrupt that is pending while disabled */
+  disable_interrupts();
+  while (tx.state != TX_IDLE) {
+    system_sleep();
+    enable_interrupts();
+    disable_interrupts();
+  }
+  enable_interrupts();
+
+  return tx.error;
+}
@@ -29,6 +29,7 @@
 #include "llfl-common.h"
 #include "system.h"
 #include "timer.h"
+#include "fastloader.h"
 #include "fastloader-ll.h"
 
 
@@ -76,13 +77,9 @@ uint8_t jiffy_receive(iec_bus_t *busstate) {
   return result;
 }
 
-uint8_t jiffy_send(uint8_t value, uint8_t eoi, uint8_t loadflags) {
-  unsigned int loadmode = loadflags & 0x80;
-  unsigned int skipeoi  = loadflags & 0x7f;
-
-  llfl_setup();
-  disable_interrupts();
-
+/* sends a single byte, llfl_setup must have been called already */
+static void send_byte(uint8_t value, uint8_t eoi, unsigned int loadmode,
+                      unsigned int skipeoi) {
   /* Initial handshake */
   set_data(1);
   set_clock(1);
@@ -118,8 +115,58 @@ uint8_t jiffy_send(uint8_t value, uint8_t eoi, uint8_t loadflags) {
 
   /* hold time */
   delay_us(10);
+}
+
+uint8_t jiffy_send(uint8_t value, uint8_t eoi, uint8_t loadflags) {
+  llfl_setup();
+  disable_interrupts();
+
+  send_byte(value, eoi, loadflags & 0x80, loadflags & 0x7f);
 
   enable_interrupts();
   llfl_teardown();
   return !IEC_ATN;
 }
+
+/**
+ * jiffy_send_block - send multiple bytes using the Jiffy protocol
+ * @data : pointer to the data
+ * @count: number of bytes to send, must not be 0
+ * @flags: JIFFY_BLOCK_* flags
+ *
+ * This function sends count bytes from data using the Jiffy protocol.
+ * With JIFFY_BLOCK_LOAD the LOAD variant is used, all bytes except the
+ * final one skip the EOI marker. With JIFFY_BLOCK_EOI the final byte
+ * is sent with EOI. The timers are set up only once for the whole
+ * block. Returns the number of bytes sent, which is less than count
+ * if the transfer was aborted by ATN.
+ */
+uint16_t jiffy_send_block(const uint8_t *data, uint16_t count, uint8_t flags) {
+  unsigned int loadmode = flags & JIFFY_BLOCK_LOAD;
+  uint16_t sent = 0;
+
+  llfl_setup();
+  disable_interrupts();
+
+  while (sent < count) {
+    unsigned int finalbyte = (sent == count - 1);
+
+    send_byte(data[sent],
+              finalbyte && (flags & JIFFY_BLOCK_EOI),
+              loadmode,
+              loadmode && !finalbyte);
+
+    if (!IEC_ATN)
+      break;
+
+    sent++;
+
+    /* allow pending interrupts between two bytes like jiffy_send */
+    enable_interrupts();
+    disable_interrupts();
+  }
+
+  enable_interrupts();
+  llfl_teardown();
+  return sent;
+}
@@ -50,6 +50,18 @@
 #  error "Unknown SSP unit specified!"
 #endif
 
+/* Blocks shorter than this are transmitted without DMA */
+#define DMA_MIN_LENGTH 16
+
+/* DMA transfer size is limited to 12 bits */
+#define DMA_MAX_LENGTH 0xfff
+
+/* source of the dummy bytes sent while receiving a block */
+static uint8_t tx_dummy = 0xff;
+
+/* set if the current receive uses DMA */
+static uint8_t rx_dma_active;
+
 void spi_init(spi_speed_t speed) {
   /* Set clock prescaler to 1:1 */
   BITBAND(LPC_SC->SSP_PCLKREG, SSP_PCLKBIT) = 1;
@@ -97,18 +109,64 @@ uint8_t spi_rx_byte(void) {
   return SSP_REGS->DR;
 }
 
-void spi_tx_block(const void *ptr, unsigned int length) {
+/* set up DMA channel 1 to feed the SSP TX FIFO from memory */
+static void start_tx_dma(const void *ptr, unsigned int length, unsigned int increment) {
+  /* Clear interrupt flags of DMA channel 1 */
+  LPC_GPDMA->DMACIntTCClear = BV(1);
+  LPC_GPDMA->DMACIntErrClr  = BV(1);
+
+  /* Set up TX DMA channel */
+  LPC_GPDMACH1->DMACCSrcAddr  = (uint32_t)ptr;
+  LPC_GPDMACH1->DMACCDestAddr = (uint32_t)&SSP_REGS->DR;
+  LPC_GPDMACH1->DMACCLLI      = 0; // no linked list
+  LPC_GPDMACH1->DMACCControl  = length
+    | (0 << 12) // source burst size 1
+    | (0 << 15) // destination burst size 1
+    | (0 << 18) // source transfer width 1 byte
+    | (0 << 21) // destination transfer width 1 byte
+    | (increment << 26) // source address incremented if requested
+    | (0 << 27) // destination address not incremented
+    ;
+  LPC_GPDMACH1->DMACCConfig = 1 // enable channel
+    | (SSP_DMAID_TX << 6) // data destination SSP TX
+    | (1 << 11) // transfer from memory to peripheral
+    ;
+}
+
+void spi_tx_block_start(const void *ptr, unsigned int length) {
   const uint8_t *data = (const uint8_t *)ptr;
 
-  while (length--) {
-    /* Wait until TX fifo can accept data */
-    while (!BITBAND(SSP_REGS->SR, SSP_TNF)) ;
+  if (length < DMA_MIN_LENGTH || length > DMA_MAX_LENGTH) {
+    /* Short or overlong block, not worth/possible to use DMA */
+    while (length--) {
+      /* Wait until TX fifo can accept data */
+      while (!BITBAND(SSP_REGS->SR, SSP_TNF)) ;
 
-    SSP_REGS->DR = *data++;
+      SSP_REGS->DR = *data++;
+    }
+    return;
   }
+
+  start_tx_dma(ptr, length, 1);
+
+  /* Enable TX FIFO DMA */
+  SSP_REGS->DMACR = BV(1);
 }
 
-void spi_rx_block(void *ptr, unsigned int length) {
+void spi_tx_block_wait(void) {
+  /* Wait until DMA channel disables itself */
+  while (LPC_GPDMACH1->DMACCConfig & 1) ;
+
+  /* Disable TX FIFO DMA */
+  SSP_REGS->DMACR = 0;
+}
+
+void spi_tx_block(const void *ptr, unsigned int length) {
+  spi_tx_block_start(ptr, length);
+  spi_tx_block_wait();
+}
+
+void spi_rx_block_start(void *ptr, unsigned int length) {
   uint8_t *data = (uint8_t *)ptr;
   unsigned int txlen = length;
 
@@ -119,8 +177,10 @@ void spi_rx_block(void *ptr, unsigned int length) {
   while (BITBAND(SSP_REGS->SR, SSP_RNE))
     (void) SSP_REGS->DR;
 
-  if ((length & 3) != 0 || ((uint32_t)ptr & 3) != 0) {
-    /* Odd length or unaligned buffer */
+  if ((length & 3) != 0 || ((uint32_t)ptr & 3) != 0 ||
+      length > DMA_MAX_LENGTH) {
+    /* Odd length or unaligned buffer, receive synchronously */
+    rx_dma_active = 0;
     while (length > 0) {
       /* Wait until TX or RX FIFO are ready */
       while (txlen > 0 && !BITBAND(SSP_REGS->SR, SSP_TNF) &&
@@ -160,23 +220,31 @@ void spi_rx_block(void *ptr, unsigned int length) {
       | (2 << 11) // transfer from peripheral to memory
       ;
 
-    /* Enable RX FIFO DMA */
-    SSP_REGS->DMACR = 1;
+    /* Let the TX DMA channel clock out <length> dummy bytes */
+    start_tx_dma(&tx_dummy, length, 0);
 
-    /* Write <length> bytes into TX FIFO */
-    while (txlen > 0) {
-      while (txlen > 0 && BITBAND(SSP_REGS->SR, SSP_TNF)) {
-        txlen--;
-        SSP_REGS->DR = 0xff;
-      }
-    }
+    /* Enable RX and TX FIFO DMA */
+    rx_dma_active = 1;
+    SSP_REGS->DMACR = BV(0) | BV(1);
+  }
+}
 
-    /* Wait until DMA channel disables itself */
-    while (LPC_GPDMACH0->DMACCConfig & 1) ;
+void spi_rx_block_wait(void) {
+  if (!rx_dma_active)
+    return;
 
-    /* Disable RX FIFO DMA */
-    SSP_REGS->DMACR = 0;
-  }
+  /* Wait until both DMA channels disable themselves */
+  while (LPC_GPDMACH0->DMACCConfig & 1) ;
+  while (LPC_GPDMACH1->DMACCConfig & 1) ;
+
+  /* Disable RX and TX FIFO DMA */
+  SSP_REGS->DMACR = 0;
+  rx_dma_active = 0;
+}
+
+void spi_rx_block(void *ptr, unsigned int length) {
+  spi_rx_block_start(ptr, length);
+  spi_rx_block_wait();
 }
 
 void spi_set_speed(spi_speed_t speed) {
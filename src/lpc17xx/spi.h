@@ -44,15 +44,27 @@ void spi_select_device(spi_device_t dev);
 /* Transmit a single byte */
 void spi_tx_byte(uint8_t data);
 
-/* Receive a data block */
+/* Transmit a data block */
 void spi_tx_block(const void *data, unsigned int length);
 
+/* Start transmitting a data block in the background */
+void spi_tx_block_start(const void *data, unsigned int length);
+
+/* Wait until a block transmit started with spi_tx_block_start is done */
+void spi_tx_block_wait(void);
+
 /* Receive a single byte */
 uint8_t spi_rx_byte(void);
 
 /* Receive a data block */
 void spi_rx_block(void *data, unsigned int length);
 
+/* Start receiving a data block in the background */
+void spi_rx_block_start(void *data, unsigned int length);
+
+/* Wait until a block receive started with spi_rx_block_start is done */
+void spi_rx_block_wait(void);
+
 /* Switch speed of SPI interface */
 void spi_set_speed(spi_speed_t speed);
 
@@ -129,6 +129,7 @@ SD_CHANGE_HANDLER;
 PARALLEL_HANDLER;
 IEC_ATN_HANDLER;
 IEC_CLOCK_HANDLER;
+IEC_TX_HANDLER;
 
 /* timer interrupts, used to detect IEC pin changes */
 void IEC_TIMER_A_HANDLER(void) {
@@ -147,6 +148,12 @@ void IEC_TIMER_A_HANDLER(void) {
     }
   }
 #endif
+
+  if (IEC_MTIMER_CLOCK == IEC_TIMER_A) {
+    if (BITBAND(IEC_MTIMER_CLOCK->MCR, 3 * IEC_OPIN_CLOCK) &&
+        BITBAND(IEC_MTIMER_CLOCK->IR, IEC_OPIN_CLOCK))
+      iec_tx_handler();
+  }
 }
 
 void IEC_TIMER_B_HANDLER(void) {
@@ -165,6 +172,12 @@ void IEC_TIMER_B_HANDLER(void) {
     }
   }
 #endif
+
+  if (IEC_MTIMER_CLOCK == IEC_TIMER_B) {
+    if (BITBAND(IEC_MTIMER_CLOCK->MCR, 3 * IEC_OPIN_CLOCK) &&
+        BITBAND(IEC_MTIMER_CLOCK->IR, IEC_OPIN_CLOCK))
+      iec_tx_handler();
+  }
 }
 
 /* GPIO interrupt handler, shared with EINT3 */
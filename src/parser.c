@@ -30,6 +30,7 @@
 #include <string.h>
 #include "config.h"
 #include "dirent.h"
+#include "dirindex.h"
 #include "display.h"
 #include "eefs-ops.h"
 #include "errormsg.h"
@@ -192,6 +193,74 @@ uint8_t match_name(uint8_t *matchstr, cbmdirent_t *dent, uint8_t ignorecase) {
     return 1;
 }
 
+/**
+ * hash_name - calculate a hash value of a file name
+ * @name: file name or pattern without wildcards
+ *
+ * This function calculates a hash value of the part of name that
+ * match_name compares, ignoring case. Names that match each other
+ * without wildcards always have the same hash value.
+ */
+uint16_t hash_name(uint8_t *name) {
+  uint16_t hash = 0;
+  uint8_t  i;
+
+  for (i = 0; i < CBM_NAME_LENGTH && name[i]; i++)
+    hash = hash * 31 + tolower_pet(name[i]);
+
+  return hash;
+}
+
+/**
+ * check_match - check if a directory entry matches
+ * @dent      : pointer to the directory entry to be checked
+ * @matchstr  : pattern to be matched
+ * @start     : start date
+ * @end       : end date
+ * @type      : required file type (0 for any)
+ *
+ * This function checks if dent matches matchstr (if not NULL), the date
+ * range (if start/end are not NULL) and type (if != 0). Hidden files
+ * only match if FLAG_HIDDEN is set in type. Returns 1 for a match,
+ * 0 otherwise.
+ */
+uint8_t check_match(cbmdirent_t *dent, uint8_t *matchstr, date_t *start, date_t *end, uint8_t type) {
+  /* Skip if the type doesn't match */
+  if ((type & TYPE_MASK) &&
+      (dent->typeflags & TYPE_MASK) != (type & TYPE_MASK))
+    return 0;
+
+  /* Skip hidden files */
+  if ((dent->typeflags & FLAG_HIDDEN) &&
+      !(type & FLAG_HIDDEN))
+    return 0;
+
+  /* Skip if the name doesn't match */
+  if (matchstr) {
+    if (dent->opstype == OPSTYPE_FAT) {
+      /* FAT: Ignore case */
+      if (!match_name(matchstr, dent, 1))
+        return 0;
+    } else {
+      /* Honor case */
+      if (!match_name(matchstr, dent, 0))
+        return 0;
+    }
+  }
+
+  /* skip if earlier than start date */
+  if (start &&
+      memcmp(&dent->date, start, sizeof(date_t)) < 0)
+    return 0;
+
+  /* skip if later than end date */
+  if (end &&
+      memcmp(&dent->date, end, sizeof(date_t)) > 0)
+    return 0;
+
+  return 1;
+}
+
 /**
  * next_match - get next matching directory entry
  * @dh        : directory handle
@@ -209,42 +278,17 @@ uint8_t match_name(uint8_t *matchstr, cbmdirent_t *dent, uint8_t ignorecase) {
 int8_t next_match(dh_t *dh, uint8_t *matchstr, date_t *start, date_t *end, uint8_t type, cbmdirent_t *dent) {
   int8_t res;
 
+  /* Try the name index first for exact names in FAT and Dxx directories */
+  if (matchstr && !start && !end) {
+    res = dirindex_match(dh, matchstr, type, dent);
+    if (res != DIRINDEX_UNUSABLE)
+      return res;
+  }
+
   while (1) {
     res = readdir(dh, dent);
-    if (res == 0) {
-      /* Skip if the type doesn't match */
-      if ((type & TYPE_MASK) &&
-          (dent->typeflags & TYPE_MASK) != (type & TYPE_MASK))
-        continue;
-
-      /* Skip hidden files */
-      if ((dent->typeflags & FLAG_HIDDEN) &&
-          !(type & FLAG_HIDDEN))
-        continue;
-
-      /* Skip if the name doesn't match */
-      if (matchstr) {
-        if (dent->opstype == OPSTYPE_FAT) {
-          /* FAT: Ignore case */
-          if (!match_name(matchstr, dent, 1))
-            continue;
-        } else {
-          /* Honor case */
-          if (!match_name(matchstr, dent, 0))
-            continue;
-        }
-      }
-
-      /* skip if earlier than start date */
-      if (start &&
-          memcmp(&dent->date, start, sizeof(date_t)) < 0)
-        continue;
-
-      /* skip if later than end date */
-      if (end &&
-          memcmp(&dent->date, end, sizeof(date_t)) > 0)
-        continue;
-    }
+    if (res == 0 && !check_match(dent, matchstr, start, end, type))
+      continue;
 
     return res;
   }
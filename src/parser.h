@@ -47,6 +47,12 @@ uint8_t parse_partition(uint8_t **buf);
 /* Performs CBM DOS pattern matching */
 uint8_t match_name(uint8_t *matchstr, cbmdirent_t *dent, uint8_t ignorecase);
 
+/* Hashes a file name for exact matching */
+uint16_t hash_name(uint8_t *name);
+
+/* Checks if a dirent matches a pattern, date range and type */
+uint8_t check_match(cbmdirent_t *dent, uint8_t *matchstr, date_t *start, date_t *end, uint8_t type);
+
 /* Returns the next matching dirent */
 int8_t next_match(dh_t *dh, uint8_t *matchstr, date_t *start, date_t *end, uint8_t type, cbmdirent_t *dent);
 
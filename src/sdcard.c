@@ -200,6 +200,19 @@ static uint8_t expect_byte(uint8_t value) {
   return b == value;
 }
 
+/* wait until the card is no longer busy */
+/* (with 500ms timeout) */
+static uint8_t wait_not_busy(void) {
+  uint8_t b;
+  tick_t  timeout = getticks() + HZ/2;
+
+  do {
+    b = spi_rx_byte();
+  } while (b == 0 && time_before(getticks(), timeout));
+
+  return b != 0;
+}
+
 /* deselect card(s) and send 24 clocks */
 /* (was 8, but some cards prefer more) */
 static void deselect_card(void) {
@@ -265,6 +278,10 @@ static uint8_t send_command(const uint8_t  card,
     spi_tx_block(&tmp, 4);
     spi_tx_byte(crc);
 
+    /* skip the stuff byte after STOP_TRANSMISSION */
+    if (cmd == STOP_TRANSMISSION)
+      spi_rx_byte();
+
     /* wait up to 500ms for a valid response */
     timeout = getticks() + HZ/2;
     do {
@@ -489,6 +506,80 @@ DSTATUS sd_initialize(BYTE drv) {
 DSTATUS disk_initialize(BYTE drv) __attribute__ ((weak, alias("sd_initialize")));
 
 
+#ifdef CONFIG_SD_BLOCKTRANSFER
+/**
+ * receive_block_finish - complete a background block transfer
+ *
+ * This function waits until the data block started with
+ * spi_rx_block_start has been received and returns the CRC
+ * sent by the card after it.
+ */
+static uint16_t receive_block_finish(void) {
+  uint16_t recvcrc;
+
+  spi_rx_block_wait();
+
+  recvcrc  = spi_rx_byte() << 8;
+  recvcrc |= spi_rx_byte();
+  return recvcrc;
+}
+#else
+/**
+ * receive_block - receive a data block from the card
+ * @buffer: pointer to the buffer
+ *
+ * This function reads a 512 byte data block and its CRC after the
+ * start block token has been received. Returns 1 if the calculated
+ * data CRC matches the one sent by the card, 0 otherwise.
+ */
+static uint8_t receive_block(BYTE *buffer) {
+  uint16_t crc, recvcrc;
+
+  /* interleave transfer/CRC calculation, AVR-optimized */
+  uint16_t i;
+  uint8_t  tmp;
+
+  crc = 0;
+
+  /* start SPI data exchange */
+  SPDR = 0xff;
+
+  for (i=0; i<512; i++) {
+    /* wait until byte available */
+    loop_until_bit_is_set(SPSR, SPIF);
+    tmp = SPDR;
+    /* transmit the next byte while the current one is processed */
+    SPDR = 0xff;
+
+    *buffer++ = tmp;
+    crc = crc_xmodem_update(crc, tmp);
+  }
+  /* wait for the first CRC byte */
+  loop_until_bit_is_set(SPSR, SPIF);
+
+  recvcrc  = SPDR << 8;
+  recvcrc |= spi_rx_byte();
+
+  return recvcrc == crc;
+}
+#endif
+
+/* end a multi-block read and wait until the card is ready again */
+static void stop_transmission(uint8_t drv) {
+  send_command(drv, STOP_TRANSMISSION, 0);
+  wait_not_busy();
+  deselect_card();
+}
+
+/* abort a multi-block write after a rejected data block */
+/* (the error flags in the R2 status are only read to clear them) */
+static void abort_write(uint8_t drv) {
+  stop_transmission(drv);
+  send_command(drv, SEND_STATUS, 0);
+  spi_rx_byte();
+  deselect_card();
+}
+
 /**
  * sd_read - reads sectors from the SD card to buffer
  * @drv   : drive
@@ -498,14 +589,21 @@ DSTATUS disk_initialize(BYTE drv) __attribute__ ((weak, alias("sd_initialize")))
  *
  * This function reads count sectors from the SD card starting
  * at sector to buffer. Returns RES_ERROR if an error occured or
- * RES_OK if successful. Up to SD_AUTO_RETRIES will be made if
- * the calculated data CRC does not match the one sent by the
- * card. If there were errors during the command transmission
- * disk_state will be set to DISK_ERROR and no retries are made.
+ * RES_OK if successful. More than one sector is read with a
+ * single READ_MULTIPLE_BLOCK command. Up to SD_AUTO_RETRIES will
+ * be made if the calculated data CRC does not match the one sent
+ * by the card, a retry restarts the transfer at the failed sector.
+ * If there were errors during the command transmission disk_state
+ * will be set to DISK_ERROR and no retries are made.
+ * With CONFIG_SD_BLOCKTRANSFER the CRC of each sector is checked
+ * while the next one is transferred in the background.
  */
 DRESULT sd_read(BYTE drv, BYTE *buffer, DWORD sector, BYTE count) {
-  uint8_t  res, sec, errors;
-  uint16_t crc, recvcrc;
+  uint8_t  res, sec, errors, multi;
+#ifdef CONFIG_SD_BLOCKTRANSFER
+  uint8_t  pending, crcok;
+  uint16_t recvcrc = 0;
+#endif
 
   if (drv >= MAX_CARDS)
     return RES_PARERR;
@@ -514,79 +612,98 @@ DRESULT sd_read(BYTE drv, BYTE *buffer, DWORD sector, BYTE count) {
   if (cardtype[drv] == CARD_MMCSD)
     sector <<= 9;
 
-  for (sec = 0; sec < count; sec++) {
-    errors = 0;
-    while (errors < CONFIG_SD_AUTO_RETRIES) {
-      /* send read command */
-      if (cardtype[drv] & CARD_SDHC)
-        res = send_command(drv, READ_SINGLE_BLOCK, sector + sec);
-      else
-        res = send_command(drv, READ_SINGLE_BLOCK, sector + (sec << 9));
-
-      /* fail if the command wasn't accepted */
-      if (res != 0) {
-        deselect_card();
-        disk_state = DISK_ERROR;
-        return RES_ERROR;
+  sec    = 0;
+  errors = 0;
+  while (sec < count) {
+    multi = (count - sec > 1);
+
+    /* send read command */
+    if (cardtype[drv] & CARD_SDHC)
+      res = send_command(drv, multi ? READ_MULTIPLE_BLOCK : READ_SINGLE_BLOCK,
+                         sector + sec);
+    else
+      res = send_command(drv, multi ? READ_MULTIPLE_BLOCK : READ_SINGLE_BLOCK,
+                         sector + ((DWORD)sec << 9));
+
+    /* fail if the command wasn't accepted */
+    if (res != 0) {
+      deselect_card();
+      disk_state = DISK_ERROR;
+      return RES_ERROR;
+    }
+
+#ifdef CONFIG_SD_BLOCKTRANSFER
+    /* pending is set if the CRC of the sector at buffer is unchecked */
+    pending = 0;
+    while (sec < count) {
+      if (sec + pending < count) {
+        /* wait for start block token */
+        if (!expect_byte(0xfe)) {
+          if (multi)
+            stop_transmission(drv);
+          deselect_card();
+          disk_state = DISK_ERROR;
+          return RES_ERROR;
+        }
+
+        /* start transferring the next sector */
+        spi_rx_block_start(buffer + (pending ? 512 : 0), 512);
       }
 
+      /* check the previous sector while the transfer runs */
+      crcok = 1;
+      if (pending)
+        crcok = (crc_xmodem_block(0, buffer, 512) == recvcrc);
+
+      if (sec + pending < count) {
+        recvcrc = receive_block_finish();
+        if (!pending) {
+          pending = 1;
+          continue;
+        }
+      } else
+        pending = 0;
+
+      if (!crcok) {
+        uart_putc('X');
+        errors++;
+        break;
+      }
+
+      errors  = 0;
+      buffer += 512;
+      sec++;
+    }
+#else
+    while (sec < count) {
       /* wait for start block token */
       if (!expect_byte(0xfe)) {
+        if (multi)
+          stop_transmission(drv);
         deselect_card();
         disk_state = DISK_ERROR;
         return RES_ERROR;
       }
 
-      /* transfer data */
-      crc = 0;
-#ifdef CONFIG_SD_BLOCKTRANSFER
-      /* transfer data first, calculate CRC afterwards */
-      spi_rx_block(buffer, 512);
-
-      recvcrc = spi_rx_byte() << 8 | spi_rx_byte();
-      crc = crc_xmodem_block(0, buffer, 512);
-#else
-      /* interleave transfer/CRC calculation, AVR-optimized */
-      uint16_t i;
-      uint8_t  tmp;
-      BYTE     *ptr = buffer;
-
-      /* start SPI data exchange */
-      SPDR = 0xff;
-
-      for (i=0; i<512; i++) {
-        /* wait until byte available */
-        loop_until_bit_is_set(SPSR, SPIF);
-        tmp = SPDR;
-        /* transmit the next byte while the current one is processed */
-        SPDR = 0xff;
-
-        *ptr++ = tmp;
-        crc = crc_xmodem_update(crc, tmp);
-      }
-      /* wait for the first CRC byte */
-      loop_until_bit_is_set(SPSR, SPIF);
-
-      recvcrc  = SPDR << 8;
-      recvcrc |= spi_rx_byte();
-#endif
-
-      /* check CRC */
-      if (recvcrc != crc) {
+      /* transfer data, check CRC */
+      if (!receive_block(buffer)) {
         uart_putc('X');
-        deselect_card();
         errors++;
-        continue;
+        break;
       }
 
-      break; // FIXME: Ugly control flow
+      errors  = 0;
+      buffer += 512;
+      sec++;
     }
+#endif
+
+    if (multi)
+      stop_transmission(drv);
     deselect_card();
 
     if (errors >= CONFIG_SD_AUTO_RETRIES)
       return RES_ERROR;
-
-    buffer += 512;
   }
 
   return RES_OK;
@@ -594,6 +711,51 @@ DRESULT sd_read(BYTE drv, BYTE *buffer, DWORD sector, BYTE count) {
 DRESULT disk_read(BYTE drv, BYTE *buffer, DWORD sector, BYTE count) __attribute__ ((weak, alias("sd_read")));
 
 
+/**
+ * send_block - send a data block to the card
+ * @drv   : drive
+ * @buffer: pointer to the buffer
+ * @token : start block token
+ *
+ * This function transmits the start block token, 512 bytes of data
+ * from buffer and their CRC. Returns the data response token of the
+ * card.
+ */
+static uint8_t send_block(uint8_t drv, const BYTE *buffer, uint8_t token) {
+  uint16_t crc;
+
+  (void)drv;
+
+  /* send data token */
+  spi_tx_byte(token);
+
+  /* transfer data */
+#ifdef CONFIG_SD_BLOCKTRANSFER
+  /* calculate the CRC while the data is sent in the background */
+  spi_tx_block_start(buffer, 512);
+  crc = crc_xmodem_block(0, buffer, 512);
+  spi_tx_block_wait();
+#else
+  /* interleave transfer/CRC calculations, AVR-optimized */
+  uint16_t i;
+
+  crc = 0;
+  spi_select_device(drv+1);
+  for (i=0; i<512; i++) {
+    SPDR = *buffer;
+    crc = crc_xmodem_update(crc, *buffer++);
+    loop_until_bit_is_set(SPSR, SPIF);
+  }
+#endif
+
+  /* send CRC */
+  spi_tx_byte(crc >> 8);
+  spi_tx_byte(crc & 0xff);
+
+  /* read status byte */
+  return spi_rx_byte();
+}
+
 /**
  * sd_write - writes sectors from buffer to the SD card
  * @drv   : drive
@@ -604,14 +766,18 @@ DRESULT disk_read(BYTE drv, BYTE *buffer, DWORD sector, BYTE count) __attribute_
  * This function writes count sectors from buffer to the SD card
  * starting at sector. Returns RES_ERROR if an error occured,
  * RES_WPRT if the card is currently write-protected or RES_OK
- * if successful. Up to SD_AUTO_RETRIES will be made if the card
- * signals a CRC error. If there were errors during the command
- * transmission disk_state will be set to DISK_ERROR and no retries
- * are made.
+ * if successful. More than one sector is written with a single
+ * WRITE_MULTIPLE_BLOCK command, SD cards are told the number of
+ * sectors in advance so they can pre-erase them. Up to
+ * SD_AUTO_RETRIES will be made if the card rejects a data block.
+ * A block that is rejected during a multi-block write ends the
+ * transfer with STOP_TRANSMISSION, a retry restarts it at the failed
+ * sector. If there were errors during the command transmission or
+ * the card stays busy for too long disk_state will be set to
+ * DISK_ERROR and no retries are made.
  */
 DRESULT sd_write(BYTE drv, const BYTE *buffer, DWORD sector, BYTE count) {
-  uint8_t  res, sec, errors;
-  uint16_t crc;
+  uint8_t  res, sec, errors, multi;
 
   if (drv >= MAX_CARDS)
     return RES_PARERR;
@@ -624,73 +790,76 @@ DRESULT sd_write(BYTE drv, const BYTE *buffer, DWORD sector, BYTE count) {
   if (cardtype[drv] == CARD_MMCSD)
     sector <<= 9;
 
-  for (sec = 0; sec < count; sec++) {
-    errors = 0;
-    while (errors < CONFIG_SD_AUTO_RETRIES) {
-      /* send write command */
-      if (cardtype[drv] & CARD_SDHC)
-        res = send_command(drv, WRITE_BLOCK, sector + sec);
-      else
-        res = send_command(drv, WRITE_BLOCK, sector + (sec << 9));
-
-      /* fail if the command wasn't accepted */
-      if (res != 0) {
+  sec    = 0;
+  errors = 0;
+  while (sec < count) {
+    multi = (count - sec > 1);
+
+    if (multi) {
+      /* set the pre-erase count, MMC cards reject the APP_CMD */
+      res = send_command(drv, APP_CMD, 0);
+      deselect_card();
+      if (res == 0) {
+        send_command(drv, SD_SET_WR_BLK_ERASE_COUNT, count - sec);
         deselect_card();
-        disk_state = DISK_ERROR;
-        return RES_ERROR;
       }
+    }
 
-      /* send data token */
-      spi_tx_byte(0xfe);
-
-      /* transfer data */
-#ifdef CONFIG_SD_BLOCKTRANSFER
-      spi_tx_block(buffer, 512);
-      crc = crc_xmodem_block(0, buffer, 512);
-#else
-      /* interleave transfer/CRC calculations, AVR-optimized */
-      uint16_t i;
-      const BYTE *ptr = buffer;
-
-      crc = 0;
-      spi_select_device(drv+1);
-      for (i=0; i<512; i++) {
-        SPDR = *ptr;
-        crc = crc_xmodem_update(crc, *ptr++);
-        loop_until_bit_is_set(SPSR, SPIF);
-      }
-#endif
+    /* send write command */
+    if (cardtype[drv] & CARD_SDHC)
+      res = send_command(drv, multi ? WRITE_MULTIPLE_BLOCK : WRITE_BLOCK,
+                         sector + sec);
+    else
+      res = send_command(drv, multi ? WRITE_MULTIPLE_BLOCK : WRITE_BLOCK,
+                         sector + ((DWORD)sec << 9));
 
-      /* send CRC */
-      spi_tx_byte(crc >> 8);
-      spi_tx_byte(crc & 0xff);
+    /* fail if the command wasn't accepted */
+    if (res != 0) {
+      deselect_card();
+      disk_state = DISK_ERROR;
+      return RES_ERROR;
+    }
 
-      /* read status byte */
-      res = spi_rx_byte();
+    while (sec < count) {
+      res = send_block(drv, buffer, multi ? 0xfc : 0xfe);
 
-      /* retry on error */
       if ((res & 0x0f) != 0x05) {
         uart_putc('X');
-        deselect_card();
+
+        /* retry on error */
         errors++;
-        continue;
+        break;
       }
 
       /* wait until write is finished */
-      // FIXME: Timeout?
-      do {
-        res = spi_rx_byte();
-      } while (res == 0);
+      if (!wait_not_busy()) {
+        deselect_card();
+        disk_state = DISK_ERROR;
+        return RES_ERROR;
+      }
 
-      break; // FIXME: Ugly control flow
+      errors  = 0;
+      buffer += 512;
+      sec++;
     }
-    deselect_card();
 
-    if (errors >= CONFIG_SD_AUTO_RETRIES) {
-      return RES_ERROR;
+    if (multi && (res & 0x0f) != 0x05) {
+      /* stop the transfer, the retry restarts it at the failed sector */
+      abort_write(drv);
+    } else if (multi) {
+      /* send stop token, the card signals busy after one byte */
+      spi_tx_byte(0xfd);
+      spi_rx_byte();
+      if (!wait_not_busy()) {
+        deselect_card();
+        disk_state = DISK_ERROR;
+        return RES_ERROR;
+      }
     }
+    deselect_card();
 
-    buffer += 512;
+    if (errors >= CONFIG_SD_AUTO_RETRIES)
+      return RES_ERROR;
   }
 
   return RES_OK;